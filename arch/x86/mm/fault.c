@@ -1300,6 +1300,38 @@ __do_page_fault(struct pt_regs *regs, unsigned long error_code,
 	if (error_code & X86_PF_INSTR)
 		flags |= FAULT_FLAG_INSTRUCTION;
 
+#ifdef CONFIG_PER_VMA_LOCK
+	/*
+	 * Try to handle user faults under the vma lock first.  Without
+	 * mmap_sem held the fault cannot be retried by dropping it, so
+	 * FAULT_FLAG_ALLOW_RETRY is cleared, and anything that is not a
+	 * plain success is redone below under mmap_sem.
+	 */
+	if (!(flags & FAULT_FLAG_USER))
+		goto lock_mmap;
+
+	vma = lock_vma_under_rcu(mm, address);
+	if (!vma)
+		goto lock_mmap;
+
+	if (unlikely(access_error(error_code, vma))) {
+		vma_end_read(vma);
+		goto lock_mmap;
+	}
+	pkey = vma_pkey(vma);
+	fault = handle_mm_fault(vma, address, (flags & ~FAULT_FLAG_ALLOW_RETRY) |
+				FAULT_FLAG_VMA_LOCK);
+	vma_end_read(vma);
+
+	if (!(fault & VM_FAULT_RETRY)) {
+		count_vm_vma_lock_event(VMA_LOCK_SUCCESS);
+		major |= fault & VM_FAULT_MAJOR;
+		goto done;
+	}
+	count_vm_vma_lock_event(VMA_LOCK_RETRY);
+lock_mmap:
+#endif /* CONFIG_PER_VMA_LOCK */
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -1414,6 +1446,9 @@ good_area:
 	}
 
 	up_read(&mm->mmap_sem);
+#ifdef CONFIG_PER_VMA_LOCK
+done:
+#endif
 	if (unlikely(fault & VM_FAULT_ERROR)) {
 		mm_fault_error(regs, error_code, address, &pkey, fault);
 		return;
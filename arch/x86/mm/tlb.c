@@ -274,6 +274,7 @@ void switch_mm_irqs_off(struct mm_struct *prev, struct mm_struct *next,
 {
 	struct mm_struct *real_prev = this_cpu_read(cpu_tlbstate.loaded_mm);
 	u16 prev_asid = this_cpu_read(cpu_tlbstate.loaded_mm_asid);
+	bool was_lazy = this_cpu_read(cpu_tlbstate.is_lazy);
 	unsigned cpu = smp_processor_id();
 	u64 next_tlb_gen;
 
@@ -339,6 +340,25 @@ void switch_mm_irqs_off(struct mm_struct *prev, struct mm_struct *next,
 				 !cpumask_test_cpu(cpu, mm_cpumask(next))))
 			cpumask_set_cpu(cpu, mm_cpumask(next));
 
+		if (!was_lazy)
+			return;
+
+		/*
+		 * Flushes that don't free page tables skip cpus in lazy TLB
+		 * mode, so catch up with any we missed.  The barrier orders
+		 * the is_lazy store above against the tlb_gen read; it pairs
+		 * with the tlb_gen increment in the shootdown code.
+		 */
+		smp_mb();
+		next_tlb_gen = atomic64_read(&next->context.tlb_gen);
+		if (this_cpu_read(cpu_tlbstate.ctxs[prev_asid].tlb_gen) ==
+		    next_tlb_gen)
+			return;
+
+		this_cpu_write(cpu_tlbstate.ctxs[prev_asid].tlb_gen,
+			       next_tlb_gen);
+		load_new_mm_cr3(next->pgd, prev_asid, true);
+		trace_tlb_flush_rcuidle(TLB_FLUSH_ON_TASK_SWITCH, TLB_FLUSH_ALL);
 		return;
 	} else {
 		u16 new_asid;
@@ -677,6 +697,55 @@ void native_flush_tlb_others(const struct cpumask *cpumask,
 			       (void *)info, 1);
 }
 
+static DEFINE_PER_CPU(cpumask_var_t, flush_tlb_mask);
+
+/*
+ * Send the flush described by @info to the other cpus in @cpumask.
+ *
+ * A cpu in lazy TLB mode has no user space running on it, so unless page
+ * tables are being freed it can do without the IPI: switch_mm_irqs_off()
+ * sees the newer tlb_gen when the cpu leaves lazy mode and flushes then.
+ * Callers must have bumped the tlb_gen of the mm(s) being flushed.
+ */
+static void flush_tlb_others_nonlazy(const struct cpumask *cpumask,
+				     const struct flush_tlb_info *info)
+{
+	struct cpumask *mask = this_cpu_cpumask_var_ptr(flush_tlb_mask);
+	int cpu, this_cpu = smp_processor_id();
+	unsigned int skipped = 0;
+
+	if (info->freed_tables || !mask) {
+		flush_tlb_others(cpumask, info);
+		return;
+	}
+
+	cpumask_clear(mask);
+	for_each_cpu(cpu, cpumask) {
+		if (cpu == this_cpu)
+			continue;
+		if (per_cpu(cpu_tlbstate.is_lazy, cpu))
+			skipped++;
+		else
+			__cpumask_set_cpu(cpu, mask);
+	}
+
+	if (skipped)
+		count_vm_events(TLB_FLUSH_LAZY_SKIPPED, skipped);
+	if (!cpumask_empty(mask))
+		flush_tlb_others(mask, info);
+}
+
+static int __init flush_tlb_mask_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		zalloc_cpumask_var_node(per_cpu_ptr(&flush_tlb_mask, cpu),
+					GFP_KERNEL, cpu_to_node(cpu));
+	return 0;
+}
+arch_initcall(flush_tlb_mask_init);
+
 /*
  * See Documentation/x86/tlb.txt for details.  We choose 33
  * because it is large enough to cover the vast majority (at
@@ -690,12 +759,14 @@ void native_flush_tlb_others(const struct cpumask *cpumask,
 static unsigned long tlb_single_page_flush_ceiling __read_mostly = 33;
 
 void flush_tlb_mm_range(struct mm_struct *mm, unsigned long start,
-				unsigned long end, unsigned long vmflag)
+				unsigned long end, unsigned long vmflag,
+				bool freed_tables)
 {
 	int cpu;
 
 	struct flush_tlb_info info = {
 		.mm = mm,
+		.freed_tables = freed_tables,
 	};
 
 	cpu = get_cpu();
@@ -722,7 +793,7 @@ void flush_tlb_mm_range(struct mm_struct *mm, unsigned long start,
 	}
 
 	if (cpumask_any_but(mm_cpumask(mm), cpu) < nr_cpu_ids)
-		flush_tlb_others(mm_cpumask(mm), &info);
+		flush_tlb_others_nonlazy(mm_cpumask(mm), &info);
 
 	put_cpu();
 }
@@ -783,7 +854,7 @@ void arch_tlbbatch_flush(struct arch_tlbflush_unmap_batch *batch)
 	}
 
 	if (cpumask_any_but(&batch->cpumask, cpu) < nr_cpu_ids)
-		flush_tlb_others(&batch->cpumask, &info);
+		flush_tlb_others_nonlazy(&batch->cpumask, &info);
 
 	cpumask_clear(&batch->cpumask);
 
@@ -84,11 +84,14 @@ bool zcomp_available_algorithm(const char *comp)
 	return crypto_has_comp(comp, 0, 0) == 1;
 }
 
-/* show available compressors */
-ssize_t zcomp_available_show(const char *comp, char *buf)
+/*
+ * show available compressors, appending to the first @at bytes of @buf;
+ * returns the new length of @buf
+ */
+ssize_t zcomp_available_show(const char *comp, char *buf, ssize_t at)
 {
 	bool known_algorithm = false;
-	ssize_t sz = 0;
+	ssize_t sz = at;
 	int i = 0;
 
 	for (; backends[i]; i++) {
@@ -48,10 +48,30 @@ enum zram_pageflags {
 	ZRAM_SAME,	/* Page consists the same element */
 	ZRAM_WB,	/* page is stored on backing_device */
 	ZRAM_HUGE,	/* Incompressible page */
+	ZRAM_IDLE,	/* not accessed since the last "idle" mark */
+	ZRAM_INCOMPRESSIBLE, /* none of the algorithms could shrink it */
+
+	ZRAM_COMP_PRIORITY_BIT1, /* First bit of comp priority index */
+	ZRAM_COMP_PRIORITY_BIT2, /* Second bit of comp priority index */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
+#define ZRAM_COMP_PRIORITY_MASK	0x3UL
+
+/*
+ * Compression algorithms, in priority order.  Pages are always written
+ * with the primary one; the others are only used to recompress pages
+ * that are already stored.
+ */
+#define ZRAM_PRIMARY_COMP	0U
+#define ZRAM_SECONDARY_COMP	1U
+#ifdef CONFIG_ZRAM_MULTI_COMP
+#define ZRAM_MAX_COMPS	4U
+#else
+#define ZRAM_MAX_COMPS	1U
+#endif
+
 /*-- Data structures */
 
 /* Allocated for each disk page */
@@ -80,12 +100,13 @@ struct zram_stats {
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
 	atomic64_t writestall;		/* no. of write slow paths */
 	atomic64_t miss_free;		/* no. of missed free */
+	atomic64_t num_recompressed;	/* no. of recompressed pages */
 };
 
 struct zram {
 	struct zram_table_entry *table;
 	struct zs_pool *mem_pool;
-	struct zcomp *comp;
+	struct zcomp *comps[ZRAM_MAX_COMPS];
 	struct gendisk *disk;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
@@ -100,7 +121,8 @@ struct zram {
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
-	char compressor[CRYPTO_MAX_ALG_NAME];
+	/* Algorithm names, "" for unused priorities */
+	char comp_algs[ZRAM_MAX_COMPS][CRYPTO_MAX_ALG_NAME];
 	/*
 	 * zram is claimed so open request will be failed
 	 */
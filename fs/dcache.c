@@ -3109,7 +3109,8 @@ static void __init dcache_init(void)
 	 * 但由于 dcache 的缓存性质，它可能不值得。
 	 */
 	dentry_cache = KMEM_CACHE_USERCOPY(dentry,
-		SLAB_RECLAIM_ACCOUNT|SLAB_PANIC|SLAB_MEM_SPREAD|SLAB_ACCOUNT,
+		SLAB_RECLAIM_ACCOUNT|SLAB_PANIC|SLAB_MEM_SPREAD|SLAB_ACCOUNT|
+		SLAB_SHEAVES,
 		d_iname);
 
 	/* Hash may have been set up in dcache_init_early */
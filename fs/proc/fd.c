@@ -57,6 +57,11 @@ static int seq_show(struct seq_file *m, void *v)
 		   (long long)file->f_pos, f_flags,
 		   real_mount(file->f_path.mnt)->mnt_id);
 
+	if (S_ISREG(file_inode(file)->i_mode))
+		seq_printf(m, "ra_pages:\t%u\nra_hits:\t%u\nra_misses:\t%u\n",
+			   file->f_ra.ra_pages, file->f_ra.hits,
+			   file->f_ra.misses);
+
 	show_fd_locks(m, file, files);
 	if (seq_has_overflowed(m))
 		goto out;
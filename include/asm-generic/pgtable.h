@@ -753,6 +753,38 @@ static inline pmd_t pmd_swp_clear_soft_dirty(pmd_t pmd)
 }
 #endif
 
+#ifndef CONFIG_HAVE_ARCH_USERFAULTFD_WP
+static inline int pte_uffd_wp(pte_t pte)
+{
+	return 0;
+}
+
+static inline pte_t pte_mkuffd_wp(pte_t pte)
+{
+	return pte;
+}
+
+static inline pte_t pte_clear_uffd_wp(pte_t pte)
+{
+	return pte;
+}
+
+static inline pte_t pte_swp_mkuffd_wp(pte_t pte)
+{
+	return pte;
+}
+
+static inline int pte_swp_uffd_wp(pte_t pte)
+{
+	return 0;
+}
+
+static inline pte_t pte_swp_clear_uffd_wp(pte_t pte)
+{
+	return pte;
+}
+#endif /* CONFIG_HAVE_ARCH_USERFAULTFD_WP */
+
 #ifndef __HAVE_PFNMAP_TRACKING
 /*
  * Interfaces that can be used by architecture code to keep track of
@@ -423,6 +423,10 @@ struct address_space {
 	atomic_t i_mmap_writable; /* count VM_SHARED mappings */
 	struct rb_root_cached i_mmap; /* tree of private and shared mappings */
 	struct rw_semaphore i_mmap_rwsem; /* protect tree, count, list */
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	/* number of thp, only for non-shmem files */
+	atomic_t nr_thps;
+#endif
 	/* Protected by the i_pages lock */
 	unsigned long nrpages; /* number of total pages */
 	/* number of shadow or DAX exceptional entries */
@@ -555,6 +559,33 @@ static inline void mapping_allow_writable(struct address_space *mapping)
 	atomic_inc(&mapping->i_mmap_writable);
 }
 
+static inline int filemap_nr_thps(struct address_space *mapping)
+{
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	return atomic_read(&mapping->nr_thps);
+#else
+	return 0;
+#endif
+}
+
+static inline void filemap_nr_thps_inc(struct address_space *mapping)
+{
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	atomic_inc(&mapping->nr_thps);
+#else
+	WARN_ON_ONCE(1);
+#endif
+}
+
+static inline void filemap_nr_thps_dec(struct address_space *mapping)
+{
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	atomic_dec(&mapping->nr_thps);
+#else
+	WARN_ON_ONCE(1);
+#endif
+}
+
 /*
  * Use sequence counter to get consistent i_size on 32-bit processors.
  */
@@ -884,6 +915,9 @@ struct file_ra_state {
 	unsigned int ra_pages; /* Maximum readahead window */
 	unsigned int mmap_miss; /* Cache miss stat for mmap accesses */
 	loff_t prev_pos; /* Cache last read() position */
+
+	unsigned int hits; /* Async readahead found its window ready */
+	unsigned int misses; /* Reads that found readahead missing or late */
 };
 
 /*
@@ -3,6 +3,7 @@
 #define LINUX_MM_INLINE_H
 
 #include <linux/huge_mm.h>
+#include <linux/jump_label.h>
 #include <linux/swap.h>
 
 /**
@@ -44,9 +45,202 @@ static __always_inline void update_lru_size(struct lruvec *lruvec,
 #endif
 }
 
+#ifdef CONFIG_LRU_GEN
+
+DECLARE_STATIC_KEY_FALSE(lru_gen_key);
+
+static inline bool lru_gen_enabled(void)
+{
+	return static_branch_unlikely(&lru_gen_key);
+}
+
+static inline int lru_gen_from_seq(unsigned long seq)
+{
+	return seq % MAX_NR_GENS;
+}
+
+/* Returns the generation of a page on a multi-gen list, or -1 otherwise */
+static inline int page_lru_gen(struct page *page)
+{
+	unsigned long flags = READ_ONCE(page->flags);
+
+	return ((flags & LRU_GEN_MASK) >> LRU_GEN_PGOFF) - 1;
+}
+
+static inline bool lru_gen_is_active(struct lruvec *lruvec, int gen)
+{
+	unsigned long max_seq = lruvec->lrugen.max_seq;
+
+	return gen == lru_gen_from_seq(max_seq) ||
+	       gen == lru_gen_from_seq(max_seq - 1);
+}
+
+/*
+ * Moves the accounting of a page from @old_gen to @new_gen, either of which
+ * can be -1 for a page entering or leaving the multi-gen lists. The classic
+ * LRU sizes are kept in sync so that the vmstat and memcg counters remain
+ * meaningful.
+ */
+static inline void lru_gen_update_size(struct lruvec *lruvec,
+				struct page *page, int old_gen, int new_gen)
+{
+	int type = page_is_file_cache(page);
+	int zone = page_zonenum(page);
+	int delta = hpage_nr_pages(page);
+	enum lru_list lru = type * LRU_FILE;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	if (old_gen >= 0) {
+		lrugen->nr_pages[old_gen][type][zone] -= delta;
+		update_lru_size(lruvec, lru + lru_gen_is_active(lruvec, old_gen),
+				zone, -delta);
+	}
+	if (new_gen >= 0) {
+		lrugen->nr_pages[new_gen][type][zone] += delta;
+		update_lru_size(lruvec, lru + lru_gen_is_active(lruvec, new_gen),
+				zone, delta);
+	}
+}
+
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page,
+				    bool reclaiming)
+{
+	unsigned long seq;
+	int gen;
+	int type = page_is_file_cache(page);
+	int zone = page_zonenum(page);
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	if (PageUnevictable(page) || !lru_gen_enabled())
+		return false;
+
+	/*
+	 * Activated pages go to the youngest generation.  Anon pages that are
+	 * not in the swap cache are likely freshly faulted in, and dirty pages
+	 * under writeback need time to be cleaned, so they go to the second
+	 * youngest.  Everything else starts in the second oldest, or the
+	 * oldest if it is being put back by reclaim.
+	 */
+	if (PageActive(page))
+		seq = lrugen->max_seq;
+	else if ((!type && !PageSwapCache(page)) ||
+		 (PageReclaim(page) && (PageDirty(page) || PageWriteback(page))))
+		seq = lrugen->max_seq - 1;
+	else if (reclaiming ||
+		 lrugen->min_seq[type] + MIN_NR_GENS >= lrugen->max_seq)
+		seq = lrugen->min_seq[type];
+	else
+		seq = lrugen->min_seq[type] + 1;
+
+	gen = lru_gen_from_seq(seq);
+	VM_BUG_ON_PAGE(page_lru_gen(page) != -1, page);
+
+	/* the generation supersedes PG_active while on a multi-gen list */
+	set_mask_bits(&page->flags, LRU_GEN_MASK | BIT(PG_active),
+		      (gen + 1UL) << LRU_GEN_PGOFF);
+	lru_gen_update_size(lruvec, page, -1, gen);
+	if (reclaiming)
+		list_add_tail(&page->lru, &lrugen->lists[gen][type][zone]);
+	else
+		list_add(&page->lru, &lrugen->lists[gen][type][zone]);
+
+	return true;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	int gen = page_lru_gen(page);
+
+	if (gen < 0)
+		return false;
+
+	lru_gen_update_size(lruvec, page, gen, -1);
+	set_mask_bits(&page->flags, LRU_GEN_MASK, 0);
+	list_del(&page->lru);
+
+	return true;
+}
+
+/*
+ * Moves a page on a multi-gen list to the oldest generation of its type,
+ * for deactivate_page().  Unlike lru_gen_add_page(), this ages anon pages
+ * outside the swap cache too, since the caller knows they are cold.
+ */
+static inline bool lru_gen_deactivate_page(struct lruvec *lruvec,
+					   struct page *page)
+{
+	int type = page_is_file_cache(page);
+	int zone = page_zonenum(page);
+	int old_gen = page_lru_gen(page), new_gen;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	if (old_gen < 0)
+		return false;
+
+	new_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	set_mask_bits(&page->flags, LRU_GEN_MASK,
+		      (new_gen + 1UL) << LRU_GEN_PGOFF);
+	lru_gen_update_size(lruvec, page, old_gen, new_gen);
+	list_move(&page->lru, &lrugen->lists[new_gen][type][zone]);
+
+	return true;
+}
+
+/* Returns true if a page sits in one of the two youngest generations */
+static inline bool lru_gen_page_active(struct lruvec *lruvec, struct page *page)
+{
+	int gen = page_lru_gen(page);
+
+	return gen >= 0 && lru_gen_is_active(lruvec, gen);
+}
+
+/* Tail pages of a split THP inherit the generation of the head page */
+static inline void lru_gen_split_page(struct page *head, struct page *tail)
+{
+	set_mask_bits(&tail->flags, LRU_GEN_MASK, head->flags & LRU_GEN_MASK);
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline bool lru_gen_enabled(void)
+{
+	return false;
+}
+
+static inline bool lru_gen_add_page(struct lruvec *lruvec, struct page *page,
+				    bool reclaiming)
+{
+	return false;
+}
+
+static inline bool lru_gen_del_page(struct lruvec *lruvec, struct page *page)
+{
+	return false;
+}
+
+static inline bool lru_gen_deactivate_page(struct lruvec *lruvec,
+					   struct page *page)
+{
+	return false;
+}
+
+static inline bool lru_gen_page_active(struct lruvec *lruvec, struct page *page)
+{
+	return false;
+}
+
+static inline void lru_gen_split_page(struct page *head, struct page *tail)
+{
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static __always_inline void add_page_to_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_add_page(lruvec, page, false))
+		return;
+
 	update_lru_size(lruvec, lru, page_zonenum(page), hpage_nr_pages(page));
 	list_add(&page->lru, &lruvec->lists[lru]);
 }
@@ -54,6 +248,9 @@ static __always_inline void add_page_to_lru_list(struct page *page,
 static __always_inline void add_page_to_lru_list_tail(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_add_page(lruvec, page, true))
+		return;
+
 	update_lru_size(lruvec, lru, page_zonenum(page), hpage_nr_pages(page));
 	list_add_tail(&page->lru, &lruvec->lists[lru]);
 }
@@ -61,6 +258,9 @@ static __always_inline void add_page_to_lru_list_tail(struct page *page,
 static __always_inline void del_page_from_lru_list(struct page *page,
 				struct lruvec *lruvec, enum lru_list lru)
 {
+	if (lru_gen_del_page(lruvec, page))
+		return;
+
 	list_del(&page->lru);
 	update_lru_size(lruvec, lru, page_zonenum(page), -hpage_nr_pages(page));
 }
@@ -9,6 +9,7 @@
 #include <linux/spinlock.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/seqlock.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/uprobes.h>
@@ -26,6 +27,7 @@ typedef int vm_fault_t;
 
 struct address_space;
 struct mem_cgroup;
+struct obj_cgroup;
 struct hmm;
 
 /*
@@ -183,7 +185,10 @@ struct page {
 	atomic_t _refcount;
 
 #ifdef CONFIG_MEMCG
-	struct mem_cgroup *mem_cgroup;
+	union {
+		struct mem_cgroup *mem_cgroup;
+		struct obj_cgroup **obj_cgroups;
+	};
 #endif
 
 	/*
@@ -276,15 +281,11 @@ struct vm_area_struct {
 	/* linked list of VM areas per task, sorted by address */
 	struct vm_area_struct *vm_next, *vm_prev;
 
+#ifdef CONFIG_MMU
+	struct vma_tree_node *vm_tree_leaf;	/* leaf of mm->vma_tree */
+#else
 	struct rb_node vm_rb;
-
-	/*
-	 * Largest free memory gap in bytes to the left of this VMA.
-	 * Either between this VMA and vma->vm_prev, or between one of the
-	 * VMAs below us in the VMA rbtree and its ->vm_prev. This helps
-	 * get_unmapped_area find a free area of the right size.
-	 */
-	unsigned long rb_subtree_gap;
+#endif
 
 	/* Second cache line starts here. */
 
@@ -328,6 +329,17 @@ struct vm_area_struct {
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
 	struct vm_userfaultfd_ctx vm_userfaultfd_ctx;
+#ifdef CONFIG_PER_VMA_LOCK
+	/*
+	 * Page faults may run under vm_lock held for read instead of
+	 * mmap_sem.  Writers holding mmap_sem for write bump vm_write_count
+	 * under vm_lock to keep such faults off the vma while they modify
+	 * it; a vma that is unlinked from the mm keeps its count raised.
+	 */
+	struct rw_semaphore vm_lock;
+	int vm_write_count;
+	struct rcu_head vm_rcu;		/* vmas are freed after a grace period */
+#endif
 } __randomize_layout;
 
 struct core_thread {
@@ -341,12 +353,32 @@ struct core_state {
 	struct completion startup;
 };
 
+#ifdef CONFIG_MMU
+struct vma_tree_node;
+
+/*
+ * B-tree index of the VMAs of an mm, keyed by vm_end, see mm/vma_tree.c.
+ * Modified under mmap_sem held for write, or under mmap_sem held for read
+ * plus page_table_lock when a stack expands.  Lookups may run under RCU
+ * and retry on @seq.
+ */
+struct vma_tree {
+	struct vma_tree_node *root;
+	seqcount_t seq;
+	struct vma_tree_node *spare;	/* preallocated for insertions */
+	unsigned int nr_spare;
+};
+#endif
+
 struct kioctx_table;
 struct mm_struct {
 	struct {
 		struct vm_area_struct *mmap;		/* list of VMAs */
+#ifdef CONFIG_MMU
+		struct vma_tree vma_tree;
+#else
 		struct rb_root mm_rb;
-		u64 vmacache_seqnum;                   /* per-thread vmacache */
+#endif
 #ifdef CONFIG_MMU
 		unsigned long (*get_unmapped_area) (struct file *filp,
 				unsigned long addr, unsigned long len,
@@ -495,6 +527,10 @@ struct mm_struct {
 #if IS_ENABLED(CONFIG_HMM)
 		/* HMM needs to track a few things per mm */
 		struct hmm *hmm;
+#endif
+#ifdef CONFIG_LRU_GEN
+		/* linked on lru_gen_mm_list for the page table walk aging */
+		struct list_head lru_gen_list;
 #endif
 	} __randomize_layout;
 
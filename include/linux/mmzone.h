@@ -161,8 +161,10 @@ enum node_stat_item {
 	NR_SLAB_UNRECLAIMABLE,
 	NR_ISOLATED_ANON,	/* Temporary isolated pages from anon lru */
 	NR_ISOLATED_FILE,	/* Temporary isolated pages from file lru */
-	WORKINGSET_REFAULT,
-	WORKINGSET_ACTIVATE,
+	WORKINGSET_REFAULT,	/* Refaults of evicted file pages */
+	WORKINGSET_ACTIVATE,	/* File refaults that were activated */
+	WORKINGSET_REFAULT_ANON,
+	WORKINGSET_ACTIVATE_ANON,
 	WORKINGSET_NODERECLAIM,
 	NR_ANON_MAPPED,	/* Mapped anonymous pages */
 	NR_FILE_MAPPED,	/* pagecache pages mapped into pagetables.
@@ -175,11 +177,20 @@ enum node_stat_item {
 	NR_SHMEM_THPS,
 	NR_SHMEM_PMDMAPPED,
 	NR_ANON_THPS,
+	NR_FILE_THPS,
+	NR_FILE_PMDMAPPED,
 	NR_UNSTABLE_NFS,	/* NFS unstable pages */
 	NR_VMSCAN_WRITE,
 	NR_VMSCAN_IMMEDIATE,	/* Prioritise for reclaim when writeback ends */
 	NR_DIRTIED,		/* page dirtyings since bootup */
 	NR_WRITTEN,		/* page writings since bootup */
+#ifdef CONFIG_NUMA_BALANCING
+	PGPROMOTE_SUCCESS,	/* promoted to this node from a slower one */
+	PGPROMOTE_CANDIDATE,	/* hinting faults asking for promotion */
+#endif
+	PGDEMOTE_KSWAPD,	/* demoted from this node by kswapd */
+	PGDEMOTE_DIRECT,	/* demoted from this node by direct reclaim */
+	PGDEMOTE_CANDIDATE,	/* reclaimed pages offered for demotion */
 	NR_INDIRECTLY_RECLAIMABLE_BYTES, /* measured in bytes */
 	NR_VM_NODE_STAT_ITEMS
 };
@@ -197,6 +208,8 @@ enum node_stat_item {
 #define LRU_ACTIVE 1
 #define LRU_FILE 2
 
+#define ANON_AND_FILE 2
+
 enum lru_list {
 	LRU_INACTIVE_ANON = LRU_BASE,
 	LRU_ACTIVE_ANON = LRU_BASE + LRU_ACTIVE,
@@ -233,13 +246,50 @@ struct zone_reclaim_stat {
 	unsigned long		recent_scanned[2];
 };
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-gen LRU sorts evictable pages into generations.  The youngest
+ * generation number is max_seq and the oldest is min_seq, which is tracked
+ * separately for anon and file pages since they can be reclaimed at
+ * different rates.  A page's generation is stored in page->flags as
+ * gen + 1 (see LRU_GEN_MASK), where gen is seq % MAX_NR_GENS.
+ *
+ * The aging walks page tables and moves pages that have their accessed
+ * bit set into the max_seq generation, then creates a new generation by
+ * incrementing max_seq.  The eviction reclaims pages from the min_seq
+ * generations and increments min_seq when they become empty.
+ *
+ * The two youngest generations are accounted as active on the classic
+ * NR_ACTIVE_{ANON,FILE} counters, the rest as inactive.
+ */
+#define MIN_NR_GENS		2U
+#define MAX_NR_GENS		4U
+
+struct lru_gen_struct {
+	/* the youngest generation number, incremented by the aging */
+	unsigned long max_seq;
+	/* the oldest generation numbers, incremented by the eviction */
+	unsigned long min_seq[ANON_AND_FILE];
+	/* the birth time of each generation in jiffies */
+	unsigned long timestamps[MAX_NR_GENS];
+	/* the multi-gen LRU lists */
+	struct list_head lists[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* the sizes of the above lists, in pages */
+	long nr_pages[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+};
+#endif
+
 struct lruvec {
 	struct list_head		lists[NR_LRU_LISTS];
 	struct zone_reclaim_stat	reclaim_stat;
-	/* Evictions & activations on the inactive file list */
+	/* Evictions & activations on the inactive lists */
 	atomic_long_t			inactive_age;
-	/* Refaults at the time of last reclaim cycle */
-	unsigned long			refaults;
+	/* Anon and file refaults at the time of last reclaim cycle */
+	unsigned long			refaults[2];
+#ifdef CONFIG_LRU_GEN
+	/* protected by the lru_lock of the owning node */
+	struct lru_gen_struct		lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct pglist_data *pgdat;
 #endif
@@ -707,6 +757,19 @@ typedef struct pglist_data {
 
 	unsigned long		flags;
 
+#ifdef CONFIG_NUMA_BALANCING
+	/* Promotion rate limit: start of the current window, in jiffies */
+	unsigned long		promote_rl_start;
+	/* PGPROMOTE_CANDIDATE at the start of the window */
+	unsigned long		promote_rl_nr_cand;
+#endif
+#ifdef CONFIG_NUMA
+	/* Demotion rate limit: start of the current window, in jiffies */
+	unsigned long		demote_rl_start;
+	/* PGDEMOTE_CANDIDATE at the start of the window */
+	unsigned long		demote_rl_nr_cand;
+#endif
+
 	ZONE_PADDING(_pad2_)
 
 	/* Per-node vmstats */
@@ -766,6 +829,13 @@ extern void init_currently_empty_zone(struct zone *zone, unsigned long start_pfn
 				     unsigned long size);
 
 extern void lruvec_init(struct lruvec *lruvec);
+#ifdef CONFIG_LRU_GEN
+extern void lru_gen_init_lruvec(struct lruvec *lruvec);
+#else
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+#endif
 
 static inline struct pglist_data *lruvec_pgdat(struct lruvec *lruvec)
 {
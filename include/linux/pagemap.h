@@ -221,8 +221,15 @@ static inline int page_cache_add_speculative(struct page *page, int count)
 }
 
 #ifdef CONFIG_NUMA
+extern struct page *__page_cache_alloc_order(gfp_t gfp, unsigned int order);
 extern struct page *__page_cache_alloc(gfp_t gfp);
 #else
+static inline struct page *__page_cache_alloc_order(gfp_t gfp,
+						    unsigned int order)
+{
+	return alloc_pages(gfp, order);
+}
+
 static inline struct page *__page_cache_alloc(gfp_t gfp)
 {
 	return alloc_pages(gfp, 0);
@@ -36,6 +36,10 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	SHEAF_ALLOC,		/* Allocation from the cpu sheaf */
+	SHEAF_FREE,		/* Free to the cpu sheaf */
+	SHEAF_REFILL,		/* Cpu sheaf refilled from the slabs */
+	SHEAF_FLUSH,		/* Cpu sheaf flushed to the slabs */
 	NR_SLUB_STAT_ITEMS };
 
 struct kmem_cache_cpu {
@@ -50,6 +54,15 @@ struct kmem_cache_cpu {
 #endif
 };
 
+/*
+ * Per cpu array of free objects kept in front of the cpu slab of a
+ * SLAB_SHEAVES cache.
+ */
+struct kmem_cache_sheaf {
+	unsigned int nr;	/* Number of objects in the sheaf */
+	void *objects[];
+};
+
 #ifdef CONFIG_SLUB_CPU_PARTIAL
 #define slub_percpu_partial(c)		((c)->partial)
 
@@ -81,6 +94,9 @@ struct kmem_cache_order_objects {
  */
 struct kmem_cache {
 	struct kmem_cache_cpu __percpu *cpu_slab;
+	/* Per cpu object arrays, only with SLAB_SHEAVES */
+	struct kmem_cache_sheaf __percpu *sheaf;
+	unsigned int sheaf_capacity;
 	/* Used for retriving partial slabs etc */
 	slab_flags_t flags;
 	unsigned long min_partial;
@@ -108,15 +124,6 @@ struct kmem_cache {
 	struct kobject kobj;	/* For sysfs */
 	struct work_struct kobj_remove_work;
 #endif
-#ifdef CONFIG_MEMCG
-	struct memcg_cache_params memcg_params;
-	/* for propagation, maximum size of a stored attr */
-	unsigned int max_attr_size;
-#ifdef CONFIG_SYSFS
-	struct kset *memcg_kset;
-#endif
-#endif
-
 #ifdef CONFIG_SLAB_FREELIST_HARDENED
 	unsigned long random;
 #endif
@@ -182,4 +189,16 @@ static inline void *nearest_obj(struct kmem_cache *cache, struct page *page,
 	return result;
 }
 
+static inline unsigned int obj_to_index(const struct kmem_cache *cache,
+					const struct page *page, void *obj)
+{
+	return (obj - page_address(page)) / cache->size;
+}
+
+static inline int objs_per_slab_page(const struct kmem_cache *cache,
+				     const struct page *page)
+{
+	return page->objects;
+}
+
 #endif /* _LINUX_SLUB_DEF_H */
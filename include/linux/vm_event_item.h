@@ -102,13 +102,21 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		NR_TLB_LOCAL_FLUSH_ALL,
 		NR_TLB_LOCAL_FLUSH_ONE,
 #endif /* CONFIG_DEBUG_TLBFLUSH */
-#ifdef CONFIG_DEBUG_VM_VMACACHE
-		VMACACHE_FIND_CALLS,
-		VMACACHE_FIND_HITS,
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+		TLB_FLUSH_BATCHED,	/* shootdown deferred into a batch */
+		TLB_FLUSH_BATCH_SENT,	/* batched shootdown performed */
+#endif
+#ifdef CONFIG_X86
+		TLB_FLUSH_LAZY_SKIPPED,	/* lazy TLB cpu spared a flush IPI */
 #endif
 #ifdef CONFIG_SWAP
 		SWAP_RA,
 		SWAP_RA_HIT,
+#endif
+#ifdef CONFIG_PER_VMA_LOCK
+		VMA_LOCK_SUCCESS,	/* fault handled under the vma lock */
+		VMA_LOCK_ABORT,		/* vma could not be locked */
+		VMA_LOCK_RETRY,		/* fault had to be redone under mmap_sem */
 #endif
 		NR_VM_EVENT_ITEMS
 };
@@ -32,6 +32,8 @@
 #include <linux/sysfs.h>
 #include <linux/rcupdate.h>
 #include <linux/module.h>
+#include <linux/completion.h>
+#include <linux/topology.h>
 
 #define MAX_OBJ_NUM 1000
 
@@ -1100,6 +1102,147 @@ void padata_free(struct padata_instance *pinst)
 }
 EXPORT_SYMBOL(padata_free);
 
+/*
+ * Multithreaded jobs: a range of work is cut into chunks which the caller
+ * and a handful of unbound kworkers take turns claiming until none are left.
+ */
+
+/* Chunks per thread, so that a slow thread does not hold up the job. */
+#define PADATA_MT_LOAD_BALANCE_FACTOR	4
+
+struct padata_mt_job_state {
+	spinlock_t		lock;
+	struct completion	completion;
+	struct padata_mt_job	*job;
+	int			nworks;
+	int			nworks_fini;
+	unsigned long		chunk_size;
+};
+
+struct padata_mt_work {
+	struct work_struct		work;
+	struct list_head		list;
+	struct padata_mt_job_state	*ps;
+};
+
+static void padata_mt_helper(struct padata_mt_job_state *ps)
+{
+	struct padata_mt_job *job = ps->job;
+	bool done;
+
+	spin_lock(&ps->lock);
+
+	while (job->size > 0) {
+		unsigned long start, size, end;
+
+		start = job->start;
+		/* So end is chunk size aligned if enough work remains. */
+		size = roundup(start + 1, ps->chunk_size) - start;
+		size = min(size, job->size);
+		end = start + size;
+
+		job->start = end;
+		job->size -= size;
+
+		spin_unlock(&ps->lock);
+		job->thread_fn(start, end, job->fn_arg);
+		cond_resched();
+		spin_lock(&ps->lock);
+	}
+
+	++ps->nworks_fini;
+	done = (ps->nworks_fini == ps->nworks);
+	spin_unlock(&ps->lock);
+
+	if (done)
+		complete(&ps->completion);
+}
+
+static void padata_mt_work_fn(struct work_struct *work)
+{
+	struct padata_mt_work *pw = container_of(work, struct padata_mt_work,
+						 work);
+
+	padata_mt_helper(pw->ps);
+	kfree(pw);
+}
+
+/**
+ * padata_do_multithreaded - run a multithreaded job
+ *
+ * @job: Description of the job.
+ *
+ * The range [@job->start, @job->start + @job->size) is split into chunks
+ * that are a multiple of @job->align, and @job->thread_fn is called on them
+ * from the calling thread and up to @job->max_threads - 1 kworkers, queued
+ * near @job->nid.  Returns once every chunk has been processed.  Falls back
+ * to fewer threads, down to just the caller, if work items cannot be
+ * allocated.
+ *
+ * Context: may sleep, the caller must be able to block.
+ */
+void padata_do_multithreaded(struct padata_mt_job *job)
+{
+	struct padata_mt_job_state ps;
+	struct padata_mt_work *pw, *next;
+	LIST_HEAD(works);
+	int nworks, cpu = WORK_CPU_UNBOUND;
+
+	if (job->size == 0)
+		return;
+
+	/* Ensure at least one thread when size < min_chunk. */
+	nworks = min_t(unsigned long, max(job->size / job->min_chunk, 1ul),
+		       max(job->max_threads, 1));
+
+	if (nworks == 1) {
+		/* Single thread, no coordination needed, cut to the chase. */
+		job->thread_fn(job->start, job->start + job->size, job->fn_arg);
+		return;
+	}
+
+	spin_lock_init(&ps.lock);
+	init_completion(&ps.completion);
+	ps.job = job;
+	ps.nworks_fini = 0;
+
+	/*
+	 * Chunk size is the amount of work a helper does per call to the
+	 * thread function.  Load balance large jobs between threads by
+	 * increasing the number of chunks, guarantee at least the minimum
+	 * chunk size from the caller, and honor the caller's alignment.
+	 */
+	ps.chunk_size = job->size / (nworks * PADATA_MT_LOAD_BALANCE_FACTOR);
+	ps.chunk_size = max(ps.chunk_size, job->min_chunk);
+	ps.chunk_size = roundup(ps.chunk_size, job->align);
+
+	for (ps.nworks = 1; ps.nworks < nworks; ps.nworks++) {
+		pw = kmalloc(sizeof(*pw), GFP_KERNEL);
+		if (!pw)
+			break;
+		INIT_WORK(&pw->work, padata_mt_work_fn);
+		pw->ps = &ps;
+		list_add(&pw->list, &works);
+	}
+
+	/* An unbound workqueue runs work queued on a cpu on that cpu's node. */
+	if (job->nid != NUMA_NO_NODE) {
+		cpu = cpumask_any_and(cpumask_of_node(job->nid),
+				      cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = WORK_CPU_UNBOUND;
+	}
+
+	list_for_each_entry_safe(pw, next, &works, list)
+		queue_work_on(cpu, system_unbound_wq, &pw->work);
+
+	/* Use the current thread, which saves starting a workqueue worker. */
+	padata_mt_helper(&ps);
+
+	/* Wait for all the helpers to finish. */
+	wait_for_completion(&ps.completion);
+}
+
 #ifdef CONFIG_HOTPLUG_CPU
 
 static __init int padata_driver_init(void)
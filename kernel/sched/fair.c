@@ -1033,6 +1033,9 @@ unsigned int sysctl_numa_balancing_scan_size = 256;
 /* Scan @scan_size MB every @scan_period after an initial @scan_delay in ms */
 unsigned int sysctl_numa_balancing_scan_delay = 1000;
 
+/* Promotion from slower memory tiers, in MB/s per fast node */
+unsigned int sysctl_numa_balancing_promote_rate_limit = 65536;
+
 struct numa_group {
 	atomic_t refcount;
 
@@ -1414,6 +1417,25 @@ static inline unsigned long group_weight(struct task_struct *p, int nid,
 	return 1000 * faults / total_faults;
 }
 
+/*
+ * Count @nr promotion candidates for @pgdat and tell whether the current
+ * one-second window has already seen more than @rate_limit of them.
+ */
+static bool numa_promotion_rate_limit(struct pglist_data *pgdat,
+				      unsigned long rate_limit, int nr)
+{
+	unsigned long nr_cand, start;
+
+	mod_node_page_state(pgdat, PGPROMOTE_CANDIDATE, nr);
+	nr_cand = node_page_state(pgdat, PGPROMOTE_CANDIDATE);
+	start = READ_ONCE(pgdat->promote_rl_start);
+	if (time_after(jiffies, start + HZ) &&
+	    cmpxchg(&pgdat->promote_rl_start, start, jiffies) == start)
+		WRITE_ONCE(pgdat->promote_rl_nr_cand, nr_cand);
+
+	return nr_cand - READ_ONCE(pgdat->promote_rl_nr_cand) >= rate_limit;
+}
+
 bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 				int src_nid, int dst_cpu)
 {
@@ -1421,6 +1443,25 @@ bool should_numa_migrate_memory(struct task_struct *p, struct page * page,
 	int dst_nid = cpu_to_node(dst_cpu);
 	int last_cpupid, this_cpupid;
 
+	/*
+	 * A hinting fault on a slower memory tier means the page is in use:
+	 * promote it, within the rate limit, regardless of the task
+	 * placement heuristics below.
+	 */
+	if ((sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING) &&
+	    !node_is_toptier(src_nid)) {
+		unsigned long rate_limit;
+
+		rate_limit = (unsigned long)sysctl_numa_balancing_promote_rate_limit <<
+			     (20 - PAGE_SHIFT);
+		return !numa_promotion_rate_limit(NODE_DATA(dst_nid), rate_limit,
+						  hpage_nr_pages(page));
+	}
+
+	/* Tiering only: leave the pages on the fast nodes where they are */
+	if (!(sysctl_numa_balancing_mode & NUMA_BALANCING_NORMAL))
+		return false;
+
 	this_cpupid = cpu_pid_to_cpupid(dst_cpu, current->pid);
 	last_cpupid = page_cpupid_xchg_last(page, this_cpupid);
 
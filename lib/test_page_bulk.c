@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Compare the bulk page allocator against the single page path.
+ *
+ * Allocates and frees batches of order-0 pages through alloc_page() and
+ * through alloc_pages_bulk_array() and alloc_pages_bulk_list(), and
+ * reports the allocation rate of each.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+
+static unsigned int batch = 64;
+module_param(batch, uint, 0);
+MODULE_PARM_DESC(batch, "Pages allocated per batch (default: 64)");
+
+static unsigned int loops = 10000;
+module_param(loops, uint, 0);
+MODULE_PARM_DESC(loops, "Number of batches per variant (default: 10000)");
+
+enum test_page_bulk_mode {
+	TEST_SINGLE,
+	TEST_BULK_ARRAY,
+	TEST_BULK_LIST,
+};
+
+static const char * const test_page_bulk_names[] = {
+	[TEST_SINGLE]		= "alloc_page",
+	[TEST_BULK_ARRAY]	= "alloc_pages_bulk_array",
+	[TEST_BULK_LIST]	= "alloc_pages_bulk_list",
+};
+
+/* Returns the number of pages allocated in one batch */
+static unsigned int test_page_bulk_batch(enum test_page_bulk_mode mode,
+					 struct page **pages)
+{
+	struct page *page, *next;
+	unsigned int i, nr = 0;
+	LIST_HEAD(list);
+
+	switch (mode) {
+	case TEST_SINGLE:
+		for (nr = 0; nr < batch; nr++) {
+			pages[nr] = alloc_page(GFP_KERNEL);
+			if (!pages[nr])
+				break;
+		}
+		break;
+	case TEST_BULK_ARRAY:
+		memset(pages, 0, batch * sizeof(*pages));
+		nr = alloc_pages_bulk_array(GFP_KERNEL, batch, pages);
+		break;
+	case TEST_BULK_LIST:
+		nr = alloc_pages_bulk_list(GFP_KERNEL, batch, &list);
+		list_for_each_entry_safe(page, next, &list, lru) {
+			list_del(&page->lru);
+			__free_page(page);
+		}
+		return nr;
+	}
+
+	for (i = 0; i < nr; i++)
+		__free_page(pages[i]);
+	return nr;
+}
+
+static int test_page_bulk_run(enum test_page_bulk_mode mode,
+			      struct page **pages)
+{
+	unsigned long long total = 0;
+	unsigned int i, nr;
+	ktime_t start;
+	s64 ns;
+
+	start = ktime_get();
+	for (i = 0; i < loops; i++) {
+		nr = test_page_bulk_batch(mode, pages);
+		if (!nr) {
+			pr_err("%s: allocation failed\n",
+			       test_page_bulk_names[mode]);
+			return -ENOMEM;
+		}
+		total += nr;
+		cond_resched();
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	pr_info("%s: %llu pages in %lld us, %llu pages/sec\n",
+		test_page_bulk_names[mode], total, div_s64(ns, NSEC_PER_USEC),
+		ns ? div64_u64(total * NSEC_PER_SEC, ns) : 0);
+	return 0;
+}
+
+static int __init test_page_bulk_init(void)
+{
+	struct page **pages;
+	int mode, err = 0;
+
+	if (!batch)
+		return -EINVAL;
+
+	pages = kmalloc_array(batch, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	pr_info("%u batches of %u pages\n", loops, batch);
+	for (mode = TEST_SINGLE; mode <= TEST_BULK_LIST && !err; mode++)
+		err = test_page_bulk_run(mode, pages);
+
+	kfree(pages);
+	return err;
+}
+
+static void __exit test_page_bulk_exit(void)
+{
+}
+
+module_init(test_page_bulk_init);
+module_exit(test_page_bulk_exit);
+
+MODULE_DESCRIPTION("Bulk page allocator benchmark");
+MODULE_LICENSE("GPL");
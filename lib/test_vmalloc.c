@@ -0,0 +1,293 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Stress the vmalloc address space allocator from many CPUs at once.
+ *
+ * Every test case is run by one kthread per CPU, all started together, and
+ * the aggregate rate of allocation/free pairs across CPUs is reported.
+ * Cases that go through get_vm_area() only exercise the vmap_area
+ * allocator; the vmalloc() ones include populating the pages.
+ */
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/random.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
+
+static unsigned int nr_threads;
+module_param(nr_threads, uint, 0);
+MODULE_PARM_DESC(nr_threads, "Number of CPUs to run on (default: all online)");
+
+static unsigned int test_loop_count = 100000;
+module_param(test_loop_count, uint, 0);
+MODULE_PARM_DESC(test_loop_count, "Allocations per CPU per test (default: 100000)");
+
+static unsigned int run_test_mask = UINT_MAX;
+module_param(run_test_mask, uint, 0);
+MODULE_PARM_DESC(run_test_mask,
+		 "Bitmask of the tests to run (default: all)\n"
+		 "\t\tid: 1,  name: fix_size_alloc_test\n"
+		 "\t\tid: 2,  name: small_size_alloc_test\n"
+		 "\t\tid: 4,  name: random_size_alloc_test\n"
+		 "\t\tid: 8,  name: kva_only_alloc_test\n"
+		 "\t\tid: 16, name: align_kva_alloc_test\n"
+		 "\t\tid: 32, name: long_busy_list_alloc_test\n");
+
+/* Number of areas kept busy by long_busy_list_alloc_test, per CPU */
+#define TEST_VMALLOC_BUSY_AREAS	10000
+
+/* Fits the per-CPU vmap_area caches */
+static int fix_size_alloc_test(void)
+{
+	unsigned int i;
+	void *ptr;
+
+	for (i = 0; i < test_loop_count; i++) {
+		ptr = vmalloc(3 * PAGE_SIZE);
+		if (!ptr)
+			return -ENOMEM;
+		*((u8 *)ptr) = 0;
+		vfree(ptr);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static int small_size_alloc_test(void)
+{
+	unsigned int i;
+	void *ptr;
+
+	for (i = 0; i < test_loop_count; i++) {
+		ptr = vmalloc(((prandom_u32() % 8) + 1) * PAGE_SIZE);
+		if (!ptr)
+			return -ENOMEM;
+		vfree(ptr);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static int random_size_alloc_test(void)
+{
+	unsigned int i;
+	void *ptr;
+
+	for (i = 0; i < test_loop_count; i++) {
+		ptr = vmalloc(((prandom_u32() % 100) + 1) * PAGE_SIZE);
+		if (!ptr)
+			return -ENOMEM;
+		vfree(ptr);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static int kva_only_alloc_test(void)
+{
+	struct vm_struct *area;
+	unsigned int i;
+
+	for (i = 0; i < test_loop_count; i++) {
+		area = get_vm_area(((prandom_u32() % 16) + 1) * PAGE_SIZE,
+				   VM_ALLOC);
+		if (!area)
+			return -ENOMEM;
+		free_vm_area(area);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/* VM_IOREMAP areas are aligned to their size */
+static int align_kva_alloc_test(void)
+{
+	struct vm_struct *area;
+	unsigned int i;
+
+	for (i = 0; i < test_loop_count; i++) {
+		area = get_vm_area(PAGE_SIZE << (prandom_u32() % 10),
+				   VM_IOREMAP);
+		if (!area)
+			return -ENOMEM;
+		free_vm_area(area);
+		cond_resched();
+	}
+
+	return 0;
+}
+
+/* Allocate and free with a lot of other areas around */
+static int long_busy_list_alloc_test(void)
+{
+	struct vm_struct **busy;
+	unsigned int i;
+	int ret = 0;
+	void *ptr;
+
+	busy = vzalloc(TEST_VMALLOC_BUSY_AREAS * sizeof(*busy));
+	if (!busy)
+		return -ENOMEM;
+
+	for (i = 0; i < TEST_VMALLOC_BUSY_AREAS; i++) {
+		busy[i] = get_vm_area(PAGE_SIZE, VM_ALLOC);
+		if (!busy[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < test_loop_count; i++) {
+		ptr = vmalloc(((prandom_u32() % 8) + 1) * PAGE_SIZE);
+		if (!ptr) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		vfree(ptr);
+		cond_resched();
+	}
+
+out:
+	for (i = 0; i < TEST_VMALLOC_BUSY_AREAS && busy[i]; i++)
+		free_vm_area(busy[i]);
+	vfree(busy);
+	return ret;
+}
+
+static const struct test_vmalloc_case {
+	const char *name;
+	int (*fn)(void);
+} test_vmalloc_cases[] = {
+	{ "fix_size_alloc_test",	fix_size_alloc_test },
+	{ "small_size_alloc_test",	small_size_alloc_test },
+	{ "random_size_alloc_test",	random_size_alloc_test },
+	{ "kva_only_alloc_test",	kva_only_alloc_test },
+	{ "align_kva_alloc_test",	align_kva_alloc_test },
+	{ "long_busy_list_alloc_test",	long_busy_list_alloc_test },
+};
+
+struct test_vmalloc_thread {
+	const struct test_vmalloc_case *test;
+	int ret;
+	s64 ns;
+};
+
+static DECLARE_COMPLETION(test_start);
+static DECLARE_COMPLETION(test_done);
+static atomic_t test_running;
+
+static int test_vmalloc_thread_fn(void *arg)
+{
+	struct test_vmalloc_thread *t = arg;
+	ktime_t start;
+
+	wait_for_completion(&test_start);
+
+	start = ktime_get();
+	t->ret = t->test->fn();
+	t->ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (atomic_dec_and_test(&test_running))
+		complete(&test_done);
+	return 0;
+}
+
+static int test_vmalloc_run(const struct test_vmalloc_case *test,
+			    struct test_vmalloc_thread *threads,
+			    unsigned int nr)
+{
+	unsigned int i, started = 0, failed = 0;
+	struct task_struct *task;
+	s64 ns = 0;
+	u64 ops;
+	int cpu;
+
+	reinit_completion(&test_start);
+	reinit_completion(&test_done);
+	/* The extra count keeps test_done from firing before all started */
+	atomic_set(&test_running, 1);
+
+	for_each_online_cpu(cpu) {
+		if (started == nr)
+			break;
+
+		threads[started].test = test;
+		threads[started].ret = 0;
+		threads[started].ns = 0;
+		task = kthread_create(test_vmalloc_thread_fn,
+				      &threads[started], "test_vmalloc/%d", cpu);
+		if (IS_ERR(task)) {
+			pr_err("%s: failed to create thread on CPU%d\n",
+			       test->name, cpu);
+			continue;
+		}
+		kthread_bind(task, cpu);
+		atomic_inc(&test_running);
+		wake_up_process(task);
+		started++;
+	}
+
+	complete_all(&test_start);
+	if (!atomic_dec_and_test(&test_running))
+		wait_for_completion(&test_done);
+
+	for (i = 0; i < started; i++) {
+		if (threads[i].ret)
+			failed++;
+		ns = max(ns, threads[i].ns);
+	}
+
+	ops = (u64)(started - failed) * test_loop_count;
+	pr_info("%s: %u CPUs, %u failed, %llu alloc/free pairs in %lld us, %llu pairs/sec\n",
+		test->name, started, failed, ops, div_s64(ns, NSEC_PER_USEC),
+		ns ? div64_u64(ops * NSEC_PER_SEC, ns) : 0);
+
+	return failed ? -ENOMEM : 0;
+}
+
+static int __init test_vmalloc_init(void)
+{
+	struct test_vmalloc_thread *threads;
+	unsigned int i, nr;
+	int err = 0;
+
+	nr = num_online_cpus();
+	if (nr_threads && nr_threads < nr)
+		nr = nr_threads;
+
+	threads = kcalloc(nr, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	pr_info("%u allocations per CPU per test\n", test_loop_count);
+	for (i = 0; i < ARRAY_SIZE(test_vmalloc_cases); i++) {
+		if (!(run_test_mask & BIT(i)))
+			continue;
+		if (test_vmalloc_run(&test_vmalloc_cases[i], threads, nr))
+			err = -ENOMEM;
+	}
+
+	kfree(threads);
+	return err;
+}
+
+static void __exit test_vmalloc_exit(void)
+{
+}
+
+module_init(test_vmalloc_init);
+module_exit(test_vmalloc_exit);
+
+MODULE_DESCRIPTION("vmalloc allocator stress test");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,390 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Debugfs interface of the Data Access Monitor
+ *
+ * /sys/kernel/debug/damon/ holds:
+ *
+ *  attrs	"<sample us> <aggr us> <update us> <min nr regions> <max nr regions>"
+ *  target_ids	pids of the processes to monitor
+ *  schemes	one scheme per line, "<min size> <max size> <min accesses>
+ *		<max accesses> <min age> <max age> <action>", read back with
+ *		the number and total size of the regions it was applied to
+ *  monitor_on	"on" or "off"
+ *  regions	"<start>-<end> <accesses> <age>" of each region of each
+ *		target, as of the last aggregation interval
+ *
+ * Accesses are counted in sampling intervals per aggregation interval, ages
+ * in aggregation intervals.  Only regions, schemes stats and monitor_on can
+ * be accessed while monitoring is on.
+ */
+
+#define pr_fmt(fmt) "damon-dbgfs: " fmt
+
+#include <linux/damon.h>
+#include <linux/debugfs.h>
+#include <linux/file.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/pid.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+
+static struct damon_ctx *dbgfs_ctx;
+
+/*
+ * Returns non-empty string on success, negative error code otherwise.
+ */
+static char *user_input_str(const char __user *buf, size_t count, loff_t *ppos)
+{
+	char *kbuf;
+	ssize_t ret;
+
+	/* We do not accept continuous write */
+	if (*ppos)
+		return ERR_PTR(-EINVAL);
+
+	kbuf = kmalloc(count + 1, GFP_KERNEL | __GFP_NOWARN);
+	if (!kbuf)
+		return ERR_PTR(-ENOMEM);
+
+	ret = simple_write_to_buffer(kbuf, count + 1, ppos, buf, count);
+	if (ret != count) {
+		kfree(kbuf);
+		return ERR_PTR(-EIO);
+	}
+	kbuf[ret] = '\0';
+
+	return kbuf;
+}
+
+static ssize_t dbgfs_attrs_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = dbgfs_ctx;
+	char kbuf[128];
+	int ret;
+
+	mutex_lock(&ctx->kdamond_lock);
+	ret = scnprintf(kbuf, ARRAY_SIZE(kbuf), "%lu %lu %lu %lu %lu\n",
+			ctx->sample_interval, ctx->aggr_interval,
+			ctx->primitive_update_interval, ctx->min_nr_regions,
+			ctx->max_nr_regions);
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return simple_read_from_buffer(buf, count, ppos, kbuf, ret);
+}
+
+static ssize_t dbgfs_attrs_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = dbgfs_ctx;
+	unsigned long s, a, r, minr, maxr;
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	if (sscanf(kbuf, "%lu %lu %lu %lu %lu",
+				&s, &a, &r, &minr, &maxr) != 5) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		ret = -EBUSY;
+		goto unlock_out;
+	}
+
+	ret = damon_set_attrs(ctx, s, a, r, minr, maxr);
+	if (!ret)
+		ret = count;
+unlock_out:
+	mutex_unlock(&ctx->kdamond_lock);
+out:
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_target_ids_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = dbgfs_ctx;
+	struct damon_target *t;
+	ssize_t len = 0, ret;
+	char *kbuf;
+
+	kbuf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!kbuf)
+		return -ENOMEM;
+
+	mutex_lock(&ctx->kdamond_lock);
+	damon_for_each_target(t, ctx)
+		len += scnprintf(kbuf + len, PAGE_SIZE - len, "%d ",
+				 pid_vnr(t->pid));
+	mutex_unlock(&ctx->kdamond_lock);
+	len += scnprintf(kbuf + len, PAGE_SIZE - len, "\n");
+
+	ret = simple_read_from_buffer(buf, count, ppos, kbuf, len);
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_target_ids_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = dbgfs_ctx;
+	struct damon_target *t, *next;
+	LIST_HEAD(targets);
+	char *kbuf, *pos;
+	int nr_pid, id;
+	ssize_t ret = count;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	/* Build the new targets aside so that a bad pid changes nothing */
+	for (pos = kbuf; sscanf(pos, "%d%n", &id, &nr_pid) == 1;
+			pos += nr_pid) {
+		struct pid *pid = find_get_pid(id);
+
+		if (!pid) {
+			ret = -EINVAL;
+			goto free_targets;
+		}
+		t = damon_new_target(pid);
+		if (!t) {
+			put_pid(pid);
+			ret = -ENOMEM;
+			goto free_targets;
+		}
+		list_add_tail(&t->list, &targets);
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		mutex_unlock(&ctx->kdamond_lock);
+		ret = -EBUSY;
+		goto free_targets;
+	}
+
+	damon_for_each_target_safe(t, next, ctx)
+		damon_destroy_target(t);
+	list_splice_tail_init(&targets, &ctx->adaptive_targets);
+	mutex_unlock(&ctx->kdamond_lock);
+
+free_targets:
+	list_for_each_entry_safe(t, next, &targets, list)
+		damon_destroy_target(t);
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_schemes_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = dbgfs_ctx;
+	struct damos *s;
+	ssize_t len = 0, ret;
+	char *kbuf;
+
+	kbuf = kmalloc(count, GFP_KERNEL | __GFP_NOWARN);
+	if (!kbuf)
+		return -ENOMEM;
+
+	mutex_lock(&ctx->kdamond_lock);
+	damon_for_each_scheme(s, ctx) {
+		len += scnprintf(kbuf + len, count - len,
+				 "%lu %lu %u %u %u %u %d %lu %lu\n",
+				 s->min_sz_region, s->max_sz_region,
+				 s->min_nr_accesses, s->max_nr_accesses,
+				 s->min_age_region, s->max_age_region,
+				 s->action, s->stat_count, s->stat_sz);
+	}
+	mutex_unlock(&ctx->kdamond_lock);
+
+	ret = simple_read_from_buffer(buf, count, ppos, kbuf, len);
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_schemes_write(struct file *file, const char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = dbgfs_ctx;
+	unsigned long min_sz, max_sz;
+	unsigned int min_nr_a, max_nr_a, min_age, max_age;
+	unsigned int action;
+	struct damos *s, *next;
+	LIST_HEAD(schemes);
+	char *kbuf, *pos;
+	int parsed;
+	ssize_t ret = count;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	for (pos = kbuf; sscanf(pos, "%lu %lu %u %u %u %u %u%n",
+				&min_sz, &max_sz, &min_nr_a, &max_nr_a,
+				&min_age, &max_age, &action, &parsed) == 7;
+			pos += parsed) {
+		if (action >= NR_DAMOS_ACTIONS || min_sz > max_sz ||
+		    min_nr_a > max_nr_a || min_age > max_age) {
+			ret = -EINVAL;
+			goto free_schemes;
+		}
+
+		s = damon_new_scheme(min_sz, max_sz, min_nr_a, max_nr_a,
+				     min_age, max_age, action);
+		if (!s) {
+			ret = -ENOMEM;
+			goto free_schemes;
+		}
+		list_add_tail(&s->list, &schemes);
+	}
+
+	mutex_lock(&ctx->kdamond_lock);
+	if (ctx->kdamond) {
+		mutex_unlock(&ctx->kdamond_lock);
+		ret = -EBUSY;
+		goto free_schemes;
+	}
+
+	damon_for_each_scheme_safe(s, next, ctx)
+		damon_destroy_scheme(s);
+	list_splice_tail_init(&schemes, &ctx->schemes);
+	mutex_unlock(&ctx->kdamond_lock);
+
+free_schemes:
+	list_for_each_entry_safe(s, next, &schemes, list)
+		damon_destroy_scheme(s);
+	kfree(kbuf);
+	return ret;
+}
+
+static ssize_t dbgfs_monitor_on_read(struct file *file,
+		char __user *buf, size_t count, loff_t *ppos)
+{
+	char monitor_on_buf[5];
+	bool monitor_on = damon_is_running(dbgfs_ctx);
+	int len;
+
+	len = scnprintf(monitor_on_buf, 5, monitor_on ? "on\n" : "off\n");
+
+	return simple_read_from_buffer(buf, count, ppos, monitor_on_buf, len);
+}
+
+static ssize_t dbgfs_monitor_on_write(struct file *file,
+		const char __user *buf, size_t count, loff_t *ppos)
+{
+	struct damon_ctx *ctx = dbgfs_ctx;
+	char *kbuf;
+	ssize_t ret;
+
+	kbuf = user_input_str(buf, count, ppos);
+	if (IS_ERR(kbuf))
+		return PTR_ERR(kbuf);
+
+	/* Remove white space */
+	if (sscanf(kbuf, "%s", kbuf) != 1) {
+		kfree(kbuf);
+		return -EINVAL;
+	}
+
+	if (!strncmp(kbuf, "on", count)) {
+		mutex_lock(&ctx->kdamond_lock);
+		ret = list_empty(&ctx->adaptive_targets) ? -EINVAL : 0;
+		mutex_unlock(&ctx->kdamond_lock);
+		if (!ret)
+			ret = damon_start(ctx);
+	} else if (!strncmp(kbuf, "off", count)) {
+		ret = damon_stop(ctx);
+	} else {
+		ret = -EINVAL;
+	}
+
+	if (!ret)
+		ret = count;
+	kfree(kbuf);
+	return ret;
+}
+
+static int dbgfs_regions_show(struct seq_file *m, void *v)
+{
+	struct damon_ctx *ctx = dbgfs_ctx;
+	struct damon_target *t;
+	struct damon_region *r;
+
+	mutex_lock(&ctx->kdamond_lock);
+	damon_for_each_target(t, ctx) {
+		seq_printf(m, "pid %d\n", pid_vnr(t->pid));
+		damon_for_each_region(r, t)
+			seq_printf(m, "%lx-%lx %u %u\n", r->ar.start,
+				   r->ar.end, r->last_nr_accesses, r->age);
+	}
+	mutex_unlock(&ctx->kdamond_lock);
+
+	return 0;
+}
+
+static int dbgfs_regions_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dbgfs_regions_show, NULL);
+}
+
+static const struct file_operations attrs_fops = {
+	.read = dbgfs_attrs_read,
+	.write = dbgfs_attrs_write,
+};
+
+static const struct file_operations target_ids_fops = {
+	.read = dbgfs_target_ids_read,
+	.write = dbgfs_target_ids_write,
+};
+
+static const struct file_operations schemes_fops = {
+	.read = dbgfs_schemes_read,
+	.write = dbgfs_schemes_write,
+};
+
+static const struct file_operations monitor_on_fops = {
+	.read = dbgfs_monitor_on_read,
+	.write = dbgfs_monitor_on_write,
+};
+
+static const struct file_operations regions_fops = {
+	.open = dbgfs_regions_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init damon_dbgfs_init(void)
+{
+	struct dentry *root;
+
+	dbgfs_ctx = damon_new_ctx();
+	if (!dbgfs_ctx)
+		return -ENOMEM;
+
+	root = debugfs_create_dir("damon", NULL);
+	if (!root) {
+		pr_err("failed to create the debugfs directory\n");
+		damon_destroy_ctx(dbgfs_ctx);
+		return -ENOMEM;
+	}
+
+	debugfs_create_file("attrs", 0600, root, NULL, &attrs_fops);
+	debugfs_create_file("target_ids", 0600, root, NULL, &target_ids_fops);
+	debugfs_create_file("schemes", 0600, root, NULL, &schemes_fops);
+	debugfs_create_file("monitor_on", 0600, root, NULL, &monitor_on_fops);
+	debugfs_create_file("regions", 0400, root, NULL, &regions_fops);
+
+	return 0;
+}
+
+late_initcall(damon_dbgfs_init);
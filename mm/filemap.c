@@ -233,8 +233,9 @@ static void unaccount_page_cache_page(struct address_space *mapping,
 		__mod_node_page_state(page_pgdat(page), NR_SHMEM, -nr);
 		if (PageTransHuge(page))
 			__dec_node_page_state(page, NR_SHMEM_THPS);
-	} else {
-		VM_BUG_ON_PAGE(PageTransHuge(page), page);
+	} else if (PageTransHuge(page)) {
+		__dec_node_page_state(page, NR_FILE_THPS);
+		filemap_nr_thps_dec(mapping);
 	}
 
 	/*
@@ -939,7 +940,7 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 		 * get overwritten with something else, is a waste of memory.
 		 */
 		if (!(gfp_mask & __GFP_WRITE) &&
-		    shadow && workingset_refault(shadow)) {
+		    shadow && workingset_refault(page, shadow)) {
 			SetPageActive(page);
 			workingset_activation(page);
 		} else
@@ -951,7 +952,7 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
 #ifdef CONFIG_NUMA
-struct page *__page_cache_alloc(gfp_t gfp)
+struct page *__page_cache_alloc_order(gfp_t gfp, unsigned int order)
 {
 	int n;
 	struct page *page;
@@ -961,12 +962,17 @@ struct page *__page_cache_alloc(gfp_t gfp)
 		do {
 			cpuset_mems_cookie = read_mems_allowed_begin();
 			n = cpuset_mem_spread_node();
-			page = __alloc_pages_node(n, gfp, 0);
+			page = __alloc_pages_node(n, gfp, order);
 		} while (!page && read_mems_allowed_retry(cpuset_mems_cookie));
 
 		return page;
 	}
-	return alloc_pages(gfp, 0);
+	return alloc_pages(gfp, order);
+}
+
+struct page *__page_cache_alloc(gfp_t gfp)
+{
+	return __page_cache_alloc_order(gfp, 0);
 }
 EXPORT_SYMBOL(__page_cache_alloc);
 #endif
@@ -2058,6 +2064,47 @@ static void shrink_readahead_size_eio(struct file *filp,
 	ra->ra_pages /= 4;
 }
 
+/*
+ * Pages at consecutive indices that generic_file_buffered_read() looked up
+ * together, with one walk of the page cache tree, and holds references to.
+ */
+struct read_batch {
+	pgoff_t index;		/* index of pages[next] */
+	unsigned int next;
+	unsigned int nr;
+	struct page *pages[PAGEVEC_SIZE];
+};
+
+static void read_batch_release(struct read_batch *rb)
+{
+	while (rb->next < rb->nr)
+		put_page(rb->pages[rb->next++]);
+}
+
+/*
+ * Return the page at @index with a reference held, or NULL if it is not
+ * cached.  If the batch does not continue at @index, drop what is left of
+ * it and look up the pages from @index on, up to @last_index.
+ */
+static struct page *read_batch_get(struct read_batch *rb,
+				   struct address_space *mapping,
+				   pgoff_t index, pgoff_t last_index)
+{
+	if (rb->next == rb->nr || rb->index != index) {
+		read_batch_release(rb);
+		rb->nr = find_get_pages_contig(mapping, index,
+				clamp_t(pgoff_t, last_index - index, 1,
+					PAGEVEC_SIZE), rb->pages);
+		rb->next = 0;
+		rb->index = index;
+		if (!rb->nr)
+			return NULL;
+	}
+
+	rb->index++;
+	return rb->pages[rb->next++];
+}
+
 /**
  * generic_file_buffered_read - generic file read routine
  * @iocb:	the iocb to read
@@ -2078,6 +2125,7 @@ static ssize_t generic_file_buffered_read(struct kiocb *iocb,
 	struct inode *inode = mapping->host;
 	struct file_ra_state *ra = &filp->f_ra;
 	loff_t *ppos = &iocb->ki_pos;
+	struct read_batch rb = { .next = 0, .nr = 0 };
 	pgoff_t index;
 	pgoff_t last_index;
 	pgoff_t prev_index;
@@ -2108,14 +2156,14 @@ find_page:
 			goto out;
 		}
 
-		page = find_get_page(mapping, index);
+		page = read_batch_get(&rb, mapping, index, last_index);
 		if (!page) {
 			if (iocb->ki_flags & IOCB_NOWAIT)
 				goto would_block;
 			page_cache_sync_readahead(mapping,
 					ra, filp,
 					index, last_index - index);
-			page = find_get_page(mapping, index);
+			page = read_batch_get(&rb, mapping, index, last_index);
 			if (unlikely(page == NULL))
 				goto no_cached_page;
 		}
@@ -2314,6 +2362,7 @@ no_cached_page:
 would_block:
 	error = -EAGAIN;
 out:
+	read_batch_release(&rb);
 	ra->prev_pos = prev_index;
 	ra->prev_pos <<= PAGE_SHIFT;
 	ra->prev_pos |= prev_offset;
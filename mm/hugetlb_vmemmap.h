@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Free some vmemmap pages of HugeTLB
+ *
+ * The struct pages of the tail pages of a HugeTLB page are all alike,
+ * so the vmemmap pages backing most of them can be given back to the
+ * buddy allocator and their virtual range remapped read-only onto one
+ * page that is kept.  See mm/hugetlb_vmemmap.c.
+ */
+#ifndef _LINUX_HUGETLB_VMEMMAP_H
+#define _LINUX_HUGETLB_VMEMMAP_H
+#include <linux/hugetlb.h>
+#include <linux/seq_file.h>
+
+#ifdef CONFIG_HUGETLB_PAGE_FREE_VMEMMAP
+int alloc_huge_page_vmemmap(struct hstate *h, struct page *head);
+void free_huge_page_vmemmap(struct hstate *h, struct page *head);
+void hugetlb_vmemmap_init(struct hstate *h);
+void hugetlb_vmemmap_report_meminfo(struct seq_file *m);
+
+/*
+ * How many vmemmap pages associated with a HugeTLB page that can be freed
+ * to the buddy allocator.
+ */
+static inline unsigned int free_vmemmap_pages_per_hpage(struct hstate *h)
+{
+	return h->nr_free_vmemmap_pages;
+}
+
+/*
+ * PG_owner_priv_1 of the first tail page marks a HugeTLB page whose
+ * tail vmemmap pages have been freed.  The first tail page stays
+ * writable, it is backed by one of the vmemmap pages that are kept.
+ */
+static inline bool PageHugeVmemmapOptimized(struct page *head)
+{
+	return test_bit(PG_owner_priv_1, &head[1].flags);
+}
+
+static inline void SetPageHugeVmemmapOptimized(struct page *head)
+{
+	set_bit(PG_owner_priv_1, &head[1].flags);
+}
+
+static inline void ClearPageHugeVmemmapOptimized(struct page *head)
+{
+	clear_bit(PG_owner_priv_1, &head[1].flags);
+}
+#else
+static inline int alloc_huge_page_vmemmap(struct hstate *h, struct page *head)
+{
+	return 0;
+}
+
+static inline void free_huge_page_vmemmap(struct hstate *h, struct page *head)
+{
+}
+
+static inline void hugetlb_vmemmap_init(struct hstate *h)
+{
+}
+
+static inline void hugetlb_vmemmap_report_meminfo(struct seq_file *m)
+{
+}
+
+static inline unsigned int free_vmemmap_pages_per_hpage(struct hstate *h)
+{
+	return 0;
+}
+
+static inline bool PageHugeVmemmapOptimized(struct page *head)
+{
+	return false;
+}
+#endif /* CONFIG_HUGETLB_PAGE_FREE_VMEMMAP */
+#endif /* _LINUX_HUGETLB_VMEMMAP_H */
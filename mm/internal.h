@@ -43,7 +43,7 @@ vm_fault_t do_swap_page(struct vm_fault *vmf);
 void free_pgtables(struct mmu_gather *tlb, struct vm_area_struct *start_vma,
 		unsigned long floor, unsigned long ceiling);
 
-static inline bool can_madv_dontneed_vma(struct vm_area_struct *vma)
+static inline bool can_madv_lru_vma(struct vm_area_struct *vma)
 {
 	return !(vma->vm_flags & (VM_LOCKED|VM_HUGETLB|VM_PFNMAP));
 }
@@ -204,6 +204,7 @@ struct compact_control {
 	bool whole_zone;		/* Whole zone should/has been scanned */
 	bool contended;			/* Signal lock or sched contention */
 	bool finishing_block;		/* Finishing current pageblock */
+	bool proactive_compaction;	/* kcompactd proactive compaction */
 };
 
 unsigned long
@@ -282,7 +283,24 @@ static inline bool is_data_mapping(vm_flags_t flags)
 
 /* mm/util.c */
 void __vma_link_list(struct mm_struct *mm, struct vm_area_struct *vma,
-		struct vm_area_struct *prev, struct rb_node *rb_parent);
+		struct vm_area_struct *prev);
+
+/* mm/vma_tree.c */
+#ifdef CONFIG_MMU
+extern void vma_tree_cache_init(void);
+extern void vma_tree_update(struct mm_struct *mm, struct vm_area_struct *vma);
+extern void vma_tree_destroy(struct mm_struct *mm);
+extern struct vm_area_struct *vma_tree_find(struct mm_struct *mm,
+		unsigned long addr);
+extern struct vm_area_struct *vma_tree_last(struct mm_struct *mm);
+extern struct vm_area_struct *vma_tree_find_gap(struct mm_struct *mm,
+		unsigned long length, unsigned long low_limit,
+		unsigned long high_limit);
+extern struct vm_area_struct *vma_tree_find_gap_topdown(struct mm_struct *mm,
+		unsigned long length, unsigned long low_limit,
+		unsigned long high_limit);
+extern int vma_tree_validate(struct mm_struct *mm);
+#endif
 
 #ifdef CONFIG_MMU
 extern long populate_vma_page_range(struct vm_area_struct *vma,
@@ -29,6 +29,7 @@ enum scan_result {
 	SCAN_PMD_NULL,
 	SCAN_EXCEED_NONE_PTE,
 	SCAN_PTE_NON_PRESENT,
+	SCAN_PTE_UFFD_WP,
 	SCAN_PAGE_RO,
 	SCAN_LACK_REFERENCED_PAGE,
 	SCAN_PAGE_NULL,
@@ -48,6 +49,7 @@ enum scan_result {
 	SCAN_CGROUP_CHARGE_FAIL,
 	SCAN_EXCEED_SWAP_PTE,
 	SCAN_TRUNCATED,
+	SCAN_PAGE_HAS_PRIVATE,
 };
 
 #define CREATE_TRACE_POINTS
@@ -57,6 +59,10 @@ enum scan_result {
 static unsigned int khugepaged_pages_to_scan __read_mostly;
 static unsigned int khugepaged_pages_collapsed;
 static unsigned int khugepaged_full_scans;
+static unsigned int khugepaged_file_pages_collapsed;
+static unsigned int khugepaged_file_collapse_fail;
+/* collapse executable text of regular files, see hugepage_vma_check() */
+static bool khugepaged_collapse_file_text __read_mostly = true;
 static unsigned int khugepaged_scan_sleep_millisecs __read_mostly = 10000;
 /* during fragmentation poll the hugepage allocator once every minute */
 static unsigned int khugepaged_alloc_sleep_millisecs __read_mostly = 60000;
@@ -206,6 +212,51 @@ static ssize_t full_scans_show(struct kobject *kobj,
 static struct kobj_attribute full_scans_attr =
 	__ATTR_RO(full_scans);
 
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+static ssize_t collapse_file_text_show(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       char *buf)
+{
+	return sprintf(buf, "%d\n", khugepaged_collapse_file_text);
+}
+static ssize_t collapse_file_text_store(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					const char *buf, size_t count)
+{
+	bool enable;
+	int err;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return -EINVAL;
+
+	khugepaged_collapse_file_text = enable;
+
+	return count;
+}
+static struct kobj_attribute collapse_file_text_attr =
+	__ATTR(collapse_file_text, 0644, collapse_file_text_show,
+	       collapse_file_text_store);
+
+static ssize_t file_pages_collapsed_show(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_file_pages_collapsed);
+}
+static struct kobj_attribute file_pages_collapsed_attr =
+	__ATTR_RO(file_pages_collapsed);
+
+static ssize_t file_collapse_fail_show(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       char *buf)
+{
+	return sprintf(buf, "%u\n", khugepaged_file_collapse_fail);
+}
+static struct kobj_attribute file_collapse_fail_attr =
+	__ATTR_RO(file_collapse_fail);
+#endif
+
 static ssize_t khugepaged_defrag_show(struct kobject *kobj,
 				      struct kobj_attribute *attr, char *buf)
 {
@@ -292,6 +343,11 @@ static struct attribute *khugepaged_attr[] = {
 	&scan_sleep_millisecs_attr.attr,
 	&alloc_sleep_millisecs_attr.attr,
 	&khugepaged_max_ptes_swap_attr.attr,
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+	&collapse_file_text_attr.attr,
+	&file_pages_collapsed_attr.attr,
+	&file_collapse_fail_attr.attr,
+#endif
 	NULL,
 };
 
@@ -410,6 +466,20 @@ static bool hugepage_vma_check(struct vm_area_struct *vma,
 		return IS_ALIGNED((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff,
 				HPAGE_PMD_NR);
 	}
+	/*
+	 * Text mapped by execve() denies writes to the file for as long as
+	 * it is mapped, so its page cache can be collapsed without having
+	 * to write huge pages back.
+	 */
+	if (IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS) &&
+	    khugepaged_collapse_file_text && vma->vm_file &&
+	    (vm_flags & (VM_DENYWRITE | VM_EXEC | VM_WRITE)) ==
+	    (VM_DENYWRITE | VM_EXEC)) {
+		if (!S_ISREG(file_inode(vma->vm_file)->i_mode))
+			return false;
+		return IS_ALIGNED((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff,
+				HPAGE_PMD_NR);
+	}
 	if (!vma->anon_vma || vma->vm_ops)
 		return false;
 	if (is_vma_temporary_stack(vma))
@@ -456,8 +526,9 @@ int khugepaged_enter_vma_merge(struct vm_area_struct *vma,
 	unsigned long hstart, hend;
 
 	/*
-	 * khugepaged does not yet work on non-shmem files or special
-	 * mappings. And file-private shmem THP is not supported.
+	 * khugepaged only works on non-shmem files mapped as executable
+	 * text, and not on special mappings. And file-private shmem THP is
+	 * not supported.
 	 */
 	if (!hugepage_vma_check(vma, vm_flags))
 		return 0;
@@ -1015,6 +1086,8 @@ static void collapse_huge_page(struct mm_struct *mm,
 	if (mm_find_pmd(mm, address) != pmd)
 		goto out;
 
+	/* Keep out faults that do not take mmap_sem */
+	vma_start_write(vma);
 	anon_vma_lock_write(vma->anon_vma);
 
 	pte = pte_offset_map(pmd, address);
@@ -1050,6 +1123,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 		pmd_populate(mm, pmd, pmd_pgtable(_pmd));
 		spin_unlock(pmd_ptl);
 		anon_vma_unlock_write(vma->anon_vma);
+		vma_end_write(vma);
 		result = SCAN_FAIL;
 		goto out;
 	}
@@ -1084,6 +1158,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	set_pmd_at(mm, address, pmd, _pmd);
 	update_mmu_cache_pmd(vma, address, pmd);
 	spin_unlock(pmd_ptl);
+	vma_end_write(vma);
 
 	*hpage = NULL;
 
@@ -1128,6 +1203,11 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		pte_t pteval = *_pte;
 		if (is_swap_pte(pteval)) {
 			if (++unmapped <= khugepaged_max_ptes_swap) {
+				/* See the pte_uffd_wp() check below */
+				if (pte_swp_uffd_wp(pteval)) {
+					result = SCAN_PTE_UFFD_WP;
+					goto out_unmap;
+				}
 				continue;
 			} else {
 				result = SCAN_EXCEED_SWAP_PTE;
@@ -1147,6 +1227,14 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 			result = SCAN_PTE_NON_PRESENT;
 			goto out_unmap;
 		}
+		if (pte_uffd_wp(pteval)) {
+			/*
+			 * userfaultfd write-protection is tracked per pte,
+			 * a huge pmd would lose it: leave the range alone.
+			 */
+			result = SCAN_PTE_UFFD_WP;
+			goto out_unmap;
+		}
 		if (pte_write(pteval))
 			writable = true;
 
@@ -1286,8 +1374,41 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
 	i_mmap_unlock_write(mapping);
 }
 
+/*
+ * Read in the range of a regular file that collapse_file() is about to
+ * replace: unlike shmem, holes in its page cache can't be filled with
+ * zeroed subpages of the huge page.
+ */
+static int khugepaged_read_file(struct file *file, pgoff_t start)
+{
+	struct address_space *mapping = file->f_mapping;
+	pgoff_t index, end = start + HPAGE_PMD_NR;
+	struct page *page;
+	bool uptodate;
+
+	for (index = start; index < end; index++) {
+		page = find_get_page(mapping, index);
+		if (!page) {
+			page_cache_sync_readahead(mapping, &file->f_ra, file,
+					index, end - index);
+			page = find_get_page(mapping, index);
+			if (!page)
+				return SCAN_FAIL;
+		}
+		wait_on_page_locked(page);
+		uptodate = PageUptodate(page);
+		put_page(page);
+		if (!uptodate)
+			return SCAN_FAIL;
+	}
+
+	/* drain pagevecs to help isolate_lru_page() */
+	lru_add_drain();
+	return SCAN_SUCCEED;
+}
+
 /**
- * collapse_shmem - collapse small tmpfs/shmem pages into huge one.
+ * collapse_file - collapse filemap/tmpfs/shmem pages into huge one.
  *
  * Basic scheme is simple, details are more complex:
  *  - allocate and lock a new huge page;
@@ -1303,11 +1424,14 @@ static void retract_page_tables(struct address_space *mapping, pgoff_t pgoff)
  *    + put all pages back and unfreeze them;
  *    + restore gaps in the radix-tree;
  *    + unlock and free huge page;
+ *
+ * Pages of regular files are read in up front and must be clean: there
+ * are no gaps to fill in, and the huge page is never written back.
  */
-static void collapse_shmem(struct mm_struct *mm,
-		struct address_space *mapping, pgoff_t start,
-		struct page **hpage, int node)
+static void collapse_file(struct mm_struct *mm, struct file *file,
+		pgoff_t start, struct page **hpage, int node)
 {
+	struct address_space *mapping = file->f_mapping;
 	gfp_t gfp;
 	struct page *page, *new_page, *tmp;
 	struct mem_cgroup *memcg;
@@ -1316,9 +1440,17 @@ static void collapse_shmem(struct mm_struct *mm,
 	struct radix_tree_iter iter;
 	void **slot;
 	int nr_none = 0, result = SCAN_SUCCEED;
+	bool is_shmem = shmem_file(file);
 
+	VM_BUG_ON(!IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS) && !is_shmem);
 	VM_BUG_ON(start & (HPAGE_PMD_NR - 1));
 
+	if (!is_shmem) {
+		result = khugepaged_read_file(file, start);
+		if (result != SCAN_SUCCEED)
+			goto out;
+	}
+
 	/* Only allocate from the target node */
 	gfp = alloc_hugepage_khugepaged_gfpmask() | __GFP_THISNODE;
 
@@ -1334,7 +1466,8 @@ static void collapse_shmem(struct mm_struct *mm,
 	}
 
 	__SetPageLocked(new_page);
-	__SetPageSwapBacked(new_page);
+	if (is_shmem)
+		__SetPageSwapBacked(new_page);
 	new_page->index = start;
 	new_page->mapping = mapping;
 
@@ -1362,8 +1495,10 @@ static void collapse_shmem(struct mm_struct *mm,
 		/*
 		 * Handle holes in the radix tree: charge it from shmem and
 		 * insert relevant subpage of new_page into the radix-tree.
+		 * A regular file was read in above, so a hole means a page
+		 * got reclaimed or truncated since.
 		 */
-		if (n && !shmem_charge(mapping->host, n)) {
+		if (n && (!is_shmem || !shmem_charge(mapping->host, n))) {
 			result = SCAN_FAIL;
 			goto tree_locked;
 		}
@@ -1379,7 +1514,8 @@ static void collapse_shmem(struct mm_struct *mm,
 
 		page = radix_tree_deref_slot_protected(slot,
 				&mapping->i_pages.xa_lock);
-		if (radix_tree_exceptional_entry(page) || !PageUptodate(page)) {
+		if (is_shmem && (radix_tree_exceptional_entry(page) ||
+				 !PageUptodate(page))) {
 			xa_unlock_irq(&mapping->i_pages);
 			/* swap in or instantiate fallocated page */
 			if (shmem_getpage(mapping->host, index, &page,
@@ -1387,6 +1523,10 @@ static void collapse_shmem(struct mm_struct *mm,
 				result = SCAN_FAIL;
 				goto tree_unlocked;
 			}
+		} else if (radix_tree_exceptional_entry(page)) {
+			/* shadow entry of a regular file page reclaimed since */
+			result = SCAN_FAIL;
+			goto tree_locked;
 		} else if (trylock_page(page)) {
 			get_page(page);
 			xa_unlock_irq(&mapping->i_pages);
@@ -1400,7 +1540,12 @@ static void collapse_shmem(struct mm_struct *mm,
 		 * without racing with truncate.
 		 */
 		VM_BUG_ON_PAGE(!PageLocked(page), page);
-		VM_BUG_ON_PAGE(!PageUptodate(page), page);
+
+		/* A read error may have left a regular file page stale */
+		if (unlikely(!PageUptodate(page))) {
+			result = SCAN_FAIL;
+			goto out_unlock;
+		}
 
 		/*
 		 * If file was truncated then extended, or hole-punched, before
@@ -1416,11 +1561,27 @@ static void collapse_shmem(struct mm_struct *mm,
 			goto out_unlock;
 		}
 
+		/*
+		 * The huge page of a regular file is never written back, so
+		 * data that hasn't reached the disk yet must not go into it.
+		 */
+		if (!is_shmem && (PageDirty(page) || PageWriteback(page))) {
+			result = SCAN_FAIL;
+			goto out_unlock;
+		}
+
 		if (isolate_lru_page(page)) {
 			result = SCAN_DEL_PAGE_LRU;
 			goto out_unlock;
 		}
 
+		if (page_has_private(page) &&
+		    !try_to_release_page(page, GFP_KERNEL)) {
+			result = SCAN_PAGE_HAS_PRIVATE;
+			putback_lru_page(page);
+			goto out_unlock;
+		}
+
 		if (page_mapped(page))
 			unmap_mapping_pages(mapping, index, 1, false);
 
@@ -1476,7 +1637,7 @@ out_unlock:
 			result = SCAN_TRUNCATED;
 			goto tree_locked;
 		}
-		if (!shmem_charge(mapping->host, n)) {
+		if (!is_shmem || !shmem_charge(mapping->host, n)) {
 			result = SCAN_FAIL;
 			goto tree_locked;
 		}
@@ -1487,7 +1648,24 @@ out_unlock:
 		nr_none += n;
 	}
 
-	__inc_node_page_state(new_page, NR_SHMEM_THPS);
+	if (is_shmem) {
+		__inc_node_page_state(new_page, NR_SHMEM_THPS);
+	} else {
+		filemap_nr_thps_inc(mapping);
+		/*
+		 * Paired with smp_mb() in do_dentry_open() to ensure either
+		 * we see the file opened for write, or the opener sees
+		 * nr_thps and drops the huge page from the page cache.
+		 */
+		smp_mb();
+		if (atomic_read(&mapping->host->i_writecount) > 0) {
+			filemap_nr_thps_dec(mapping);
+			result = SCAN_FAIL;
+			goto tree_locked;
+		}
+		__inc_node_page_state(new_page, NR_FILE_THPS);
+	}
+
 	if (nr_none) {
 		struct zone *zone = page_zone(new_page);
 
@@ -1528,9 +1706,13 @@ tree_unlocked:
 
 		SetPageUptodate(new_page);
 		page_ref_add(new_page, HPAGE_PMD_NR - 1);
-		set_page_dirty(new_page);
+		if (is_shmem)
+			set_page_dirty(new_page);
 		mem_cgroup_commit_charge(new_page, memcg, false, true);
-		lru_cache_add_anon(new_page);
+		if (is_shmem)
+			lru_cache_add_anon(new_page);
+		else
+			lru_cache_add_file(new_page);
 
 		/*
 		 * Remove pte page tables, so we can re-fault the page as huge.
@@ -1539,11 +1721,14 @@ tree_unlocked:
 		*hpage = NULL;
 
 		khugepaged_pages_collapsed++;
+		if (!is_shmem)
+			khugepaged_file_pages_collapsed++;
 	} else {
 		/* Something went wrong: rollback changes to the radix-tree */
 		xa_lock_irq(&mapping->i_pages);
 		mapping->nrpages -= nr_none;
-		shmem_uncharge(mapping->host, nr_none);
+		if (is_shmem)
+			shmem_uncharge(mapping->host, nr_none);
 
 		radix_tree_for_each_slot(slot, &mapping->i_pages, &iter, start) {
 			if (iter.index >= end)
@@ -1581,13 +1766,15 @@ tree_unlocked:
 	unlock_page(new_page);
 out:
 	VM_BUG_ON(!list_empty(&pagelist));
+	if (!is_shmem && result != SCAN_SUCCEED)
+		khugepaged_file_collapse_fail++;
 	/* TODO: tracepoints */
 }
 
-static void khugepaged_scan_shmem(struct mm_struct *mm,
-		struct address_space *mapping,
+static void khugepaged_scan_file(struct mm_struct *mm, struct file *file,
 		pgoff_t start, struct page **hpage)
 {
+	struct address_space *mapping = file->f_mapping;
 	struct page *page = NULL;
 	struct radix_tree_iter iter;
 	void **slot;
@@ -1634,7 +1821,8 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 			break;
 		}
 
-		if (page_count(page) != 1 + page_mapcount(page)) {
+		if (page_count(page) !=
+		    1 + page_mapcount(page) + page_has_private(page)) {
 			result = SCAN_PAGE_COUNT;
 			break;
 		}
@@ -1659,15 +1847,14 @@ static void khugepaged_scan_shmem(struct mm_struct *mm,
 			result = SCAN_EXCEED_NONE_PTE;
 		} else {
 			node = khugepaged_find_target_node();
-			collapse_shmem(mm, mapping, start, hpage, node);
+			collapse_file(mm, file, start, hpage, node);
 		}
 	}
 
 	/* TODO: tracepoints */
 }
 #else
-static void khugepaged_scan_shmem(struct mm_struct *mm,
-		struct address_space *mapping,
+static void khugepaged_scan_file(struct mm_struct *mm, struct file *file,
 		pgoff_t start, struct page **hpage)
 {
 	BUILD_BUG();
@@ -1741,17 +1928,18 @@ skip:
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			if (shmem_file(vma->vm_file)) {
+			if (IS_ENABLED(CONFIG_SHMEM) && vma->vm_file &&
+			    !vma_is_anonymous(vma)) {
 				struct file *file;
 				pgoff_t pgoff = linear_page_index(vma,
 						khugepaged_scan.address);
-				if (!shmem_huge_enabled(vma))
+				if (shmem_file(vma->vm_file) &&
+				    !shmem_huge_enabled(vma))
 					goto skip;
 				file = get_file(vma->vm_file);
 				up_read(&mm->mmap_sem);
 				ret = 1;
-				khugepaged_scan_shmem(mm, file->f_mapping,
-						pgoff, hpage);
+				khugepaged_scan_file(mm, file, pgoff, hpage);
 				fput(file);
 			} else {
 				ret = khugepaged_scan_pmd(mm, vma,
@@ -36,6 +36,7 @@
 #include <linux/bootmem.h>
 #include <linux/compaction.h>
 #include <linux/rmap.h>
+#include <linux/padata.h>
 
 #include <asm/tlbflush.h>
 
@@ -743,11 +744,68 @@ static void __meminit resize_pgdat_range(struct pglist_data *pgdat, unsigned lon
 	pgdat->node_spanned_pages = max(start_pfn + nr_pages, old_end_pfn) - pgdat->node_start_pfn;
 }
 
+struct memmap_init_args {
+	int nid;
+	unsigned long zid;
+};
+
+static void __meminit memmap_init_chunk(unsigned long start_pfn,
+					unsigned long end_pfn, void *arg)
+{
+	struct memmap_init_args *args = arg;
+
+	memmap_init_zone(end_pfn - start_pfn, args->nid, args->zid, start_pfn,
+			 MEMMAP_HOTPLUG, NULL);
+}
+
+/*
+ * Initialize the memmap of [start_pfn, end_pfn) in section sized chunks,
+ * spread over the CPUs of the node the memory belongs to, or over all
+ * online CPUs if the node has none.
+ */
+static void __meminit memmap_init_range(struct zone *zone,
+		unsigned long start_pfn, unsigned long end_pfn,
+		struct vmem_altmap *altmap)
+{
+	struct memmap_init_args args = {
+		.nid = zone->zone_pgdat->node_id,
+		.zid = zone_idx(zone),
+	};
+	struct padata_mt_job job = {
+		.thread_fn   = memmap_init_chunk,
+		.fn_arg      = &args,
+		.align       = PAGES_PER_SECTION,
+		.min_chunk   = PAGES_PER_SECTION,
+		.max_threads = cpumask_weight(cpumask_of_node(args.nid)),
+		.nid         = args.nid,
+	};
+
+	/*
+	 * Honor reservation requested by the driver for this ZONE_DEVICE
+	 * memory here, the chunks do not know where the range starts.
+	 */
+	if (altmap && start_pfn == altmap->base_pfn)
+		start_pfn += altmap->reserve;
+	if (start_pfn >= end_pfn)
+		return;
+
+	/* Raised up front so that the chunks never race updating it. */
+	if (highest_memmap_pfn < end_pfn - 1)
+		highest_memmap_pfn = end_pfn - 1;
+
+	if (!job.max_threads) {
+		job.max_threads = num_online_cpus();
+		job.nid = NUMA_NO_NODE;
+	}
+	job.start = start_pfn;
+	job.size = end_pfn - start_pfn;
+	padata_do_multithreaded(&job);
+}
+
 void __ref move_pfn_range_to_zone(struct zone *zone, unsigned long start_pfn,
 		unsigned long nr_pages, struct vmem_altmap *altmap)
 {
 	struct pglist_data *pgdat = zone->zone_pgdat;
-	int nid = pgdat->node_id;
 	unsigned long flags;
 
 	if (zone_is_empty(zone))
@@ -769,8 +827,7 @@ void __ref move_pfn_range_to_zone(struct zone *zone, unsigned long start_pfn,
 	 * expects the zone spans the pfn range. All the pages in the range
 	 * are reserved so nobody should be touching them so we should be safe
 	 */
-	memmap_init_zone(nr_pages, nid, zone_idx(zone), start_pfn,
-			MEMMAP_HOTPLUG, altmap);
+	memmap_init_range(zone, start_pfn, start_pfn + nr_pages, altmap);
 
 	set_zone_contiguous(zone);
 }
@@ -46,7 +46,10 @@
 #include <linux/page_idle.h>
 #include <linux/page_owner.h>
 #include <linux/sched/mm.h>
+#include <linux/sched/sysctl.h>
 #include <linux/ptrace.h>
+#include <linux/memory.h>
+#include <linux/cpuhotplug.h>
 
 #include <asm/tlbflush.h>
 
@@ -241,6 +244,8 @@ static bool remove_migration_pte(struct page *page, struct vm_area_struct *vma,
 		entry = pte_to_swp_entry(*pvmw.pte);
 		if (is_write_migration_entry(entry))
 			pte = maybe_mkwrite(pte, vma);
+		else if (pte_swp_uffd_wp(*pvmw.pte))
+			pte = pte_mkuffd_wp(pte);
 
 		if (unlikely(is_zone_device_page(new))) {
 			if (is_device_private_page(new)) {
@@ -1099,8 +1104,14 @@ static int __unmap_and_move(struct page *page, struct page *newpage,
 		/* Establish migration ptes */
 		VM_BUG_ON_PAGE(PageAnon(page) && !PageKsm(page) && !anon_vma,
 				page);
-		try_to_unmap(page,
-			TTU_MIGRATION|TTU_IGNORE_MLOCK|TTU_IGNORE_ACCESS);
+		/*
+		 * Flush once for all the mappings of the page rather than
+		 * once per mapping.  The flush must happen before the
+		 * contents are copied.
+		 */
+		try_to_unmap(page, TTU_MIGRATION|TTU_IGNORE_MLOCK|
+				   TTU_IGNORE_ACCESS|TTU_BATCH_FLUSH);
+		try_to_unmap_flush();
 		page_was_mapped = 1;
 	}
 
@@ -1884,8 +1895,25 @@ static int numamigrate_isolate_page(pg_data_t *pgdat, struct page *page)
 	VM_BUG_ON_PAGE(compound_order(page) && !PageTransHuge(page), page);
 
 	/* Avoid migrating to a node that is nearly full */
-	if (!migrate_balanced_pgdat(pgdat, 1UL << compound_order(page)))
+	if (!migrate_balanced_pgdat(pgdat, 1UL << compound_order(page))) {
+		int z;
+
+		if (!(sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING))
+			return 0;
+
+		/*
+		 * Have kswapd make room on the fast node for the next
+		 * promotion, by demoting its coldest pages.
+		 */
+		for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+			if (populated_zone(pgdat->node_zones + z))
+				break;
+		}
+		if (z >= 0)
+			wakeup_kswapd(pgdat->node_zones + z, 0,
+				      compound_order(page), ZONE_MOVABLE);
 		return 0;
+	}
 
 	if (isolate_lru_page(page))
 		return 0;
@@ -1915,6 +1943,14 @@ static int numamigrate_isolate_page(pg_data_t *pgdat, struct page *page)
 	return 1;
 }
 
+/* Count NUMA balancing migrations from a slower tier as promotions */
+static void count_promotion(int src_nid, pg_data_t *pgdat, int nr_pages)
+{
+	if ((sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING) &&
+	    !node_is_toptier(src_nid) && node_is_toptier(pgdat->node_id))
+		mod_node_page_state(pgdat, PGPROMOTE_SUCCESS, nr_pages);
+}
+
 bool pmd_trans_migrating(pmd_t pmd)
 {
 	struct page *page = pmd_page(pmd);
@@ -1930,6 +1966,7 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			   int node)
 {
 	pg_data_t *pgdat = NODE_DATA(node);
+	int page_nid = page_to_nid(page);
 	int isolated;
 	int nr_remaining;
 	LIST_HEAD(migratepages);
@@ -1965,8 +2002,10 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			putback_lru_page(page);
 		}
 		isolated = 0;
-	} else
+	} else {
 		count_vm_numa_event(NUMA_PAGE_MIGRATE);
+		count_promotion(page_nid, pgdat, 1);
+	}
 	BUG_ON(!list_empty(&migratepages));
 	return isolated;
 
@@ -2094,6 +2133,7 @@ int migrate_misplaced_transhuge_page(struct mm_struct *mm,
 
 	count_vm_events(PGMIGRATE_SUCCESS, HPAGE_PMD_NR);
 	count_vm_numa_events(NUMA_PAGE_MIGRATE, HPAGE_PMD_NR);
+	count_promotion(page_to_nid(page), pgdat, HPAGE_PMD_NR);
 
 	mod_node_page_state(page_pgdat(page),
 			NR_ISOLATED_ANON + page_lru,
@@ -2301,6 +2341,8 @@ again:
 			swp_pte = swp_entry_to_pte(entry);
 			if (pte_soft_dirty(pte))
 				swp_pte = pte_swp_mksoft_dirty(swp_pte);
+			if (pte_uffd_wp(pte))
+				swp_pte = pte_swp_mkuffd_wp(swp_pte);
 			set_pte_at(mm, addr, ptep, swp_pte);
 
 			/*
@@ -2541,7 +2583,8 @@ static void migrate_vma_prepare(struct migrate_vma *migrate)
  */
 static void migrate_vma_unmap(struct migrate_vma *migrate)
 {
-	int flags = TTU_MIGRATION | TTU_IGNORE_MLOCK | TTU_IGNORE_ACCESS;
+	int flags = TTU_MIGRATION | TTU_IGNORE_MLOCK | TTU_IGNORE_ACCESS |
+		    TTU_BATCH_FLUSH;
 	const unsigned long npages = migrate->npages;
 	const unsigned long start = migrate->start;
 	unsigned long addr, i, restore = 0;
@@ -2567,6 +2610,9 @@ restore:
 		restore++;
 	}
 
+	/* one shootdown for the whole range, before anything is copied */
+	try_to_unmap_flush();
+
 	for (addr = start, i = 0; i < npages && restore; addr += PAGE_SIZE, i++) {
 		struct page *page = migrate_pfn_to_page(migrate->src[i]);
 
@@ -2979,3 +3025,192 @@ int migrate_vma(const struct migrate_vma_ops *ops,
 }
 EXPORT_SYMBOL(migrate_vma);
 #endif /* defined(MIGRATE_VMA_HELPER) */
+
+#ifdef CONFIG_NUMA
+/*
+ * Memory tiering: nodes with CPUs form the top tier, and CPU-less memory
+ * nodes (PMEM, CXL, ...) the tiers below it.  node_demotion[] maps each
+ * node to the node that reclaim migrates its pages to instead of dropping
+ * or swapping them, or to NUMA_NO_NODE at the bottom tier.
+ *
+ * Targets always point to a strictly lower tier, so they cannot form a
+ * cycle.  Readers look up one node at a time and may see the old or the
+ * new target while set_migration_target_nodes() runs.
+ */
+static int node_demotion[MAX_NUMNODES] __read_mostly =
+	{[0 ...  MAX_NUMNODES - 1] = NUMA_NO_NODE};
+static DEFINE_MUTEX(demotion_mutex);
+
+/* Off by default: demotion only pays off on real tiered machines */
+bool numa_demotion_enabled __read_mostly;
+
+/* vm.numa_demote_rate_limit_MBps: demotion budget of each node */
+unsigned int sysctl_numa_demote_rate_limit __read_mostly = 65536;
+
+/**
+ * next_demotion_node() - Get the next node in the demotion path
+ * @node: The starting node to lookup the next node
+ *
+ * Return: node id for the next memory node in the demotion path from
+ * @node; NUMA_NO_NODE if @node is in the bottom tier.
+ */
+int next_demotion_node(int node)
+{
+	return READ_ONCE(node_demotion[node]);
+}
+
+/*
+ * Demote each node of @sources to the nearest memory node outside @used,
+ * and return the nodes picked as the next tier in @targets.  Nodes of the
+ * same tier may share a target.
+ */
+static void establish_demotion_targets(nodemask_t *sources, nodemask_t *used,
+				       nodemask_t *targets)
+{
+	int node, target, best, best_distance;
+
+	nodes_clear(*targets);
+	for_each_node_mask(node, *sources) {
+		best = NUMA_NO_NODE;
+		best_distance = INT_MAX;
+
+		for_each_node_state(target, N_MEMORY) {
+			if (node_isset(target, *used))
+				continue;
+			if (node_distance(node, target) < best_distance) {
+				best = target;
+				best_distance = node_distance(node, target);
+			}
+		}
+
+		if (best == NUMA_NO_NODE)
+			continue;
+
+		WRITE_ONCE(node_demotion[node], best);
+		node_set(best, *targets);
+	}
+}
+
+/*
+ * Rebuild the demotion paths tier by tier, starting from the nodes that
+ * have both CPUs and memory.  Called on CPU and memory hotplug.
+ */
+static void set_migration_target_nodes(void)
+{
+	nodemask_t sources, targets, used;
+	int node;
+
+	mutex_lock(&demotion_mutex);
+
+	for_each_node(node)
+		WRITE_ONCE(node_demotion[node], NUMA_NO_NODE);
+
+	nodes_and(sources, node_states[N_MEMORY], node_states[N_CPU]);
+	used = sources;
+	while (!nodes_empty(sources)) {
+		establish_demotion_targets(&sources, &used, &targets);
+		nodes_or(used, used, targets);
+		sources = targets;
+	}
+
+	mutex_unlock(&demotion_mutex);
+}
+
+static int migration_cpu_hotplug(unsigned int cpu)
+{
+	set_migration_target_nodes();
+	return 0;
+}
+
+static int migrate_on_reclaim_callback(struct notifier_block *self,
+				       unsigned long action, void *arg)
+{
+	struct memory_notify *mnb = arg;
+
+	/* Only a node gaining or losing all of its memory changes the tiers */
+	if (mnb->status_change_nid < 0)
+		return NOTIFY_OK;
+
+	switch (action) {
+	case MEM_ONLINE:
+	case MEM_OFFLINE:
+		set_migration_target_nodes();
+		break;
+	}
+
+	return NOTIFY_OK;
+}
+
+static int __init migrate_on_reclaim_init(void)
+{
+	int ret;
+
+	ret = cpuhp_setup_state_nocalls(CPUHP_AP_ONLINE_DYN, "mm/demotion:online",
+					migration_cpu_hotplug,
+					migration_cpu_hotplug);
+	WARN_ON(ret < 0);
+
+	hotplug_memory_notifier(migrate_on_reclaim_callback, 100);
+	set_migration_target_nodes();
+	return 0;
+}
+late_initcall(migrate_on_reclaim_init);
+
+#ifdef CONFIG_SYSFS
+static ssize_t numa_demotion_enabled_show(struct kobject *kobj,
+					  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n",
+		       numa_demotion_enabled ? "true" : "false");
+}
+
+static ssize_t numa_demotion_enabled_store(struct kobject *kobj,
+					   struct kobj_attribute *attr,
+					   const char *buf, size_t count)
+{
+	bool enabled;
+	int err;
+
+	err = kstrtobool(buf, &enabled);
+	if (err)
+		return err;
+
+	WRITE_ONCE(numa_demotion_enabled, enabled);
+	return count;
+}
+
+static struct kobj_attribute numa_demotion_enabled_attr =
+	__ATTR(demotion_enabled, 0644, numa_demotion_enabled_show,
+	       numa_demotion_enabled_store);
+
+static struct attribute *numa_attrs[] = {
+	&numa_demotion_enabled_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group numa_attr_group = {
+	.attrs = numa_attrs,
+};
+
+static int __init numa_init_sysfs(void)
+{
+	struct kobject *numa_kobj;
+	int err;
+
+	numa_kobj = kobject_create_and_add("numa", mm_kobj);
+	if (!numa_kobj) {
+		pr_err("failed to create numa kobject\n");
+		return -ENOMEM;
+	}
+
+	err = sysfs_create_group(numa_kobj, &numa_attr_group);
+	if (err) {
+		pr_err("failed to register numa group\n");
+		kobject_put(numa_kobj);
+	}
+
+	return err;
+}
+subsys_initcall(numa_init_sysfs);
+#endif /* CONFIG_SYSFS */
+#endif /* CONFIG_NUMA */
@@ -294,6 +294,9 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 	if (!new_vma)
 		return -ENOMEM;
 
+	/* Faults under the vma lock must not race with moving the ptes */
+	vma_start_write(vma);
+	vma_start_write(new_vma);
 	moved_len = move_page_tables(vma, old_addr, new_vma, new_addr, old_len,
 				     need_rmap_locks);
 	if (moved_len < old_len) {
@@ -310,11 +313,15 @@ static unsigned long move_vma(struct vm_area_struct *vma,
 		 */
 		move_page_tables(new_vma, new_addr, vma, old_addr, moved_len,
 				 true);
+		vma_end_write(new_vma);
+		vma_end_write(vma);
 		vma = new_vma;
 		old_len = new_len;
 		old_addr = new_addr;
 		new_addr = err;
 	} else {
+		vma_end_write(new_vma);
+		vma_end_write(vma);
 		mremap_userfaultfd_prep(new_vma, uf);
 		arch_remap(mm, old_addr, old_addr + old_len,
 			   new_addr, new_addr + new_len);
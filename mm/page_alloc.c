@@ -66,6 +66,8 @@
 #include <linux/ftrace.h>
 #include <linux/lockdep.h>
 #include <linux/nmi.h>
+#include <linux/psi.h>
+#include <linux/padata.h>
 
 #include <asm/sections.h>
 #include <asm/tlbflush.h>
@@ -1295,7 +1297,6 @@ static void __init __free_pages_boot_core(struct page *page, unsigned int order)
 	__ClearPageReserved(p);
 	set_page_count(p, 0);
 
-	page_zone(page)->managed_pages += nr_pages;
 	set_page_refcounted(page);
 	__free_pages(page, order);
 }
@@ -1356,6 +1357,7 @@ void __init __free_pages_bootmem(struct page *page, unsigned long pfn,
 {
 	if (early_page_uninitialised(pfn))
 		return;
+	page_zone(page)->managed_pages += 1 << order;
 	return __free_pages_boot_core(page, order);
 }
 
@@ -1495,20 +1497,26 @@ static inline bool __init deferred_pfn_valid(
 /*
  * Free pages to buddy allocator. Try to free aligned pages in
  * pageblock_nr_pages sizes.
+ * Return number of pages freed, which the caller accounts to the zone's
+ * managed_pages: this may run on several threads at once.
  */
-static void __init deferred_free_pages(int nid, int zid, unsigned long pfn,
-				       unsigned long end_pfn)
+static unsigned long __init deferred_free_pages(int nid, int zid,
+						unsigned long pfn,
+						unsigned long end_pfn)
 {
 	struct mminit_pfnnid_cache nid_init_state = {};
 	unsigned long nr_pgmask = pageblock_nr_pages - 1;
 	unsigned long nr_free = 0;
+	unsigned long nr_pages = 0;
 
 	for (; pfn < end_pfn; pfn++) {
 		if (!deferred_pfn_valid(nid, pfn, &nid_init_state)) {
 			deferred_free_range(pfn - nr_free, nr_free);
+			nr_pages += nr_free;
 			nr_free = 0;
 		} else if (!(pfn & nr_pgmask)) {
 			deferred_free_range(pfn - nr_free, nr_free);
+			nr_pages += nr_free;
 			nr_free = 1;
 			touch_nmi_watchdog();
 		} else {
@@ -1517,6 +1525,7 @@ static void __init deferred_free_pages(int nid, int zid, unsigned long pfn,
 	}
 	/* Free the last block of pages to allocator */
 	deferred_free_range(pfn - nr_free, nr_free);
+	return nr_pages + nr_free;
 }
 
 /*
@@ -1549,19 +1558,61 @@ static unsigned long __init deferred_init_pages(int nid, int zid,
 	return (nr_pages);
 }
 
+struct deferred_init_args {
+	int nid;
+	int zid;
+	atomic_long_t nr_pages;
+};
+
+/* Initialize the struct pages of the free memory in [start_pfn, end_pfn) */
+static void __init deferred_init_chunk(unsigned long start_pfn,
+				       unsigned long end_pfn, void *arg)
+{
+	struct deferred_init_args *args = arg;
+	unsigned long spfn, epfn, nr_pages = 0;
+	phys_addr_t spa, epa;
+	u64 i;
+
+	for_each_free_mem_range(i, args->nid, MEMBLOCK_NONE, &spa, &epa, NULL) {
+		spfn = max_t(unsigned long, start_pfn, PFN_UP(spa));
+		epfn = min_t(unsigned long, end_pfn, PFN_DOWN(epa));
+		nr_pages += deferred_init_pages(args->nid, args->zid,
+						spfn, epfn);
+	}
+	atomic_long_add(nr_pages, &args->nr_pages);
+}
+
+/* Free the pages of the free memory in [start_pfn, end_pfn) to buddy */
+static void __init deferred_free_chunk(unsigned long start_pfn,
+				       unsigned long end_pfn, void *arg)
+{
+	struct deferred_init_args *args = arg;
+	unsigned long spfn, epfn, nr_pages = 0;
+	phys_addr_t spa, epa;
+	u64 i;
+
+	for_each_free_mem_range(i, args->nid, MEMBLOCK_NONE, &spa, &epa, NULL) {
+		spfn = max_t(unsigned long, start_pfn, PFN_UP(spa));
+		epfn = min_t(unsigned long, end_pfn, PFN_DOWN(epa));
+		nr_pages += deferred_free_pages(args->nid, args->zid,
+						spfn, epfn);
+	}
+	atomic_long_add(nr_pages, &args->nr_pages);
+}
+
 /* Initialise remaining memory on a node */
 static int __init deferred_init_memmap(void *data)
 {
 	pg_data_t *pgdat = data;
 	int nid = pgdat->node_id;
 	unsigned long start = jiffies;
-	unsigned long nr_pages = 0;
-	unsigned long spfn, epfn, first_init_pfn, flags;
-	phys_addr_t spa, epa;
+	unsigned long nr_pages;
+	unsigned long first_init_pfn, flags;
+	struct deferred_init_args args;
+	struct padata_mt_job job;
 	int zid;
 	struct zone *zone;
 	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
-	u64 i;
 
 	/* Bind memory initialisation thread to a local node if possible */
 	if (!cpumask_empty(cpumask))
@@ -1580,6 +1631,13 @@ static int __init deferred_init_memmap(void *data)
 	BUG_ON(pgdat->first_deferred_pfn > pgdat_end_pfn(pgdat));
 	pgdat->first_deferred_pfn = ULONG_MAX;
 
+	/*
+	 * Once we unlock here, the zone cannot be grown anymore, thus if an
+	 * interrupt thread must allocate this early in boot, zone must be
+	 * pre-grown prior to start of deferred page initialization.
+	 */
+	pgdat_resize_unlock(pgdat, &flags);
+
 	/* Only the highest zone is deferred so find it */
 	for (zid = 0; zid < MAX_NR_ZONES; zid++) {
 		zone = pgdat->node_zones + zid;
@@ -1589,22 +1647,43 @@ static int __init deferred_init_memmap(void *data)
 	first_init_pfn = max(zone->zone_start_pfn, first_init_pfn);
 
 	/*
-	 * Initialize and free pages. We do it in two loops: first we initialize
-	 * struct page, than free to buddy allocator, because while we are
-	 * freeing pages we can access pages that are ahead (computing buddy
-	 * page in __free_one_page()).
+	 * Initialize and free pages, split into section aligned chunks that
+	 * all of the node's CPUs work through.  We do it in two jobs: first
+	 * we initialize struct page, than free to buddy allocator, because
+	 * while we are freeing pages we can access pages that are ahead
+	 * (computing buddy page in __free_one_page()), possibly in another
+	 * chunk.  Chunks are multiples of a section, so a pageblock is never
+	 * split between two threads.
 	 */
-	for_each_free_mem_range (i, nid, MEMBLOCK_NONE, &spa, &epa, NULL) {
-		spfn = max_t(unsigned long, first_init_pfn, PFN_UP(spa));
-		epfn = min_t(unsigned long, zone_end_pfn(zone), PFN_DOWN(epa));
-		nr_pages += deferred_init_pages(nid, zid, spfn, epfn);
-	}
-	for_each_free_mem_range (i, nid, MEMBLOCK_NONE, &spa, &epa, NULL) {
-		spfn = max_t(unsigned long, first_init_pfn, PFN_UP(spa));
-		epfn = min_t(unsigned long, zone_end_pfn(zone), PFN_DOWN(epa));
-		deferred_free_pages(nid, zid, spfn, epfn);
-	}
-	pgdat_resize_unlock(pgdat, &flags);
+	args.nid = nid;
+	args.zid = zid;
+	atomic_long_set(&args.nr_pages, 0);
+
+	job = (struct padata_mt_job) {
+		.thread_fn   = deferred_init_chunk,
+		.fn_arg      = &args,
+		.start       = first_init_pfn,
+		.size        = zone_end_pfn(zone) - first_init_pfn,
+		.align       = PAGES_PER_SECTION,
+		.min_chunk   = PAGES_PER_SECTION,
+		.max_threads = cpumask_weight(cpumask),
+		.nid         = nid,
+	};
+	padata_do_multithreaded(&job);
+	nr_pages = atomic_long_xchg(&args.nr_pages, 0);
+
+	job = (struct padata_mt_job) {
+		.thread_fn   = deferred_free_chunk,
+		.fn_arg      = &args,
+		.start       = first_init_pfn,
+		.size        = zone_end_pfn(zone) - first_init_pfn,
+		.align       = PAGES_PER_SECTION,
+		.min_chunk   = PAGES_PER_SECTION,
+		.max_threads = cpumask_weight(cpumask),
+		.nid         = nid,
+	};
+	padata_do_multithreaded(&job);
+	zone->managed_pages += atomic_long_read(&args.nr_pages);
 
 	/* Sanity check that the next zone really is unpopulated */
 	WARN_ON(++zid < MAX_NR_ZONES && populated_zone(++zone));
@@ -1696,7 +1775,7 @@ static noinline bool __init deferred_grow_zone(struct zone *zone,
 	for_each_free_mem_range (i, nid, MEMBLOCK_NONE, &spa, &epa, NULL) {
 		spfn = max_t(unsigned long, first_init_pfn, PFN_UP(spa));
 		epfn = min_t(unsigned long, first_deferred_pfn, PFN_DOWN(epa));
-		deferred_free_pages(nid, zid, spfn, epfn);
+		zone->managed_pages += deferred_free_pages(nid, zid, spfn, epfn);
 
 		if (first_deferred_pfn == epfn)
 			break;
@@ -3578,15 +3657,20 @@ static struct page *__alloc_pages_direct_compact(
 	enum compact_result *compact_result)
 {
 	struct page *page;
+	unsigned long pflags;
 	unsigned int noreclaim_flag;
 
 	if (!order)
 		return NULL;
 
+	psi_memstall_enter(&pflags);
 	noreclaim_flag = memalloc_noreclaim_save();
+
 	*compact_result =
 		try_to_compact_pages(gfp_mask, order, alloc_flags, ac, prio);
+
 	memalloc_noreclaim_restore(noreclaim_flag);
+	psi_memstall_leave(&pflags);
 
 	if (*compact_result <= COMPACT_INACTIVE)
 		return NULL;
@@ -3786,11 +3870,13 @@ static int __perform_reclaim(gfp_t gfp_mask, unsigned int order,
 	struct reclaim_state reclaim_state;
 	int progress;
 	unsigned int noreclaim_flag;
+	unsigned long pflags;
 
 	cond_resched();
 
 	/* We now go into synchronous reclaim */
 	cpuset_memory_pressure_bump();
+	psi_memstall_enter(&pflags);
 	fs_reclaim_acquire(gfp_mask);
 	noreclaim_flag = memalloc_noreclaim_save();
 	reclaim_state.reclaimed_slab = 0;
@@ -3802,6 +3888,7 @@ static int __perform_reclaim(gfp_t gfp_mask, unsigned int order,
 	current->reclaim_state = NULL;
 	memalloc_noreclaim_restore(noreclaim_flag);
 	fs_reclaim_release(gfp_mask);
+	psi_memstall_leave(&pflags);
 
 	cond_resched();
 
@@ -4428,6 +4515,152 @@ out:
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/*
+ * __alloc_pages_bulk - Allocate a number of order-0 pages to a list or array
+ * @gfp: GFP flags for the allocation
+ * @preferred_nid: The preferred NUMA node ID to allocate from
+ * @nodemask: Set of nodes to allocate from, may be NULL
+ * @nr_pages: The number of pages desired on the list or array
+ * @page_list: Optional list to store the allocated pages
+ * @page_array: Optional array to store the pages
+ *
+ * This is a batched version of the page allocator that attempts to
+ * allocate nr_pages quickly from the first usable zone's pcplist, with
+ * interrupts disabled only once for the whole batch.  Pages are added to
+ * page_list if page_list is not NULL, otherwise it is assumed that the
+ * page_array is valid.
+ *
+ * For lists, nr_pages is the number of pages that should be allocated.
+ *
+ * For arrays, only NULL elements are populated with pages and nr_pages
+ * is the maximum number of pages that will be stored in the array.
+ *
+ * Returns the number of pages on the list or array.  This may be less
+ * than requested if the fast path runs dry; callers fall back to the
+ * single page allocator for the remainder, which can reclaim.
+ */
+unsigned long __alloc_pages_bulk(gfp_t gfp, int preferred_nid,
+			nodemask_t *nodemask, int nr_pages,
+			struct list_head *page_list,
+			struct page **page_array)
+{
+	struct page *page;
+	unsigned long flags;
+	struct zone *zone;
+	struct zoneref *z;
+	struct per_cpu_pages *pcp;
+	struct list_head *pcp_list;
+	struct alloc_context ac = {};
+	gfp_t alloc_mask;
+	unsigned int alloc_flags = ALLOC_WMARK_LOW;
+	int nr_populated = 0, nr_account = 0;
+
+	/* Skip populated array elements */
+	while (page_array && nr_populated < nr_pages &&
+	       page_array[nr_populated])
+		nr_populated++;
+
+	if (unlikely(nr_pages <= 0) || nr_pages == nr_populated)
+		goto out;
+
+	/* Charging and page owner tracking are left to the single page path */
+	if (memcg_kmem_enabled() && (gfp & __GFP_ACCOUNT))
+		goto failed;
+#ifdef CONFIG_PAGE_OWNER
+	if (static_branch_unlikely(&page_owner_inited))
+		goto failed;
+#endif
+
+	/* Use the single page allocator for one page */
+	if (nr_pages - nr_populated == 1)
+		goto failed;
+
+	gfp &= gfp_allowed_mask;
+	alloc_mask = gfp;
+	if (!prepare_alloc_pages(gfp, 0, preferred_nid, nodemask, &ac,
+				 &alloc_mask, &alloc_flags))
+		goto out;
+	gfp = alloc_mask;
+	finalise_ac(gfp, &ac);
+
+	/* Find an allowed local zone that meets the low watermark */
+	for_each_zone_zonelist_nodemask(zone, z, ac.zonelist, ac.high_zoneidx,
+					ac.nodemask) {
+		unsigned long mark;
+
+		if (cpusets_enabled() && (alloc_flags & ALLOC_CPUSET) &&
+		    !__cpuset_zone_allowed(zone, gfp))
+			continue;
+
+		if (nr_online_nodes > 1 && zone != ac.preferred_zoneref->zone &&
+		    zone_to_nid(zone) != zone_to_nid(ac.preferred_zoneref->zone))
+			goto failed;
+
+		mark = zone->watermark[alloc_flags & ALLOC_WMARK_MASK] +
+			nr_pages;
+		if (zone_watermark_fast(zone, 0, mark,
+					zonelist_zone_idx(ac.preferred_zoneref),
+					alloc_flags))
+			break;
+	}
+
+	/* No zone is fit for a batch, let the slow path sort it out */
+	if (unlikely(!zone))
+		goto failed;
+
+	/* Attempt the batch allocation */
+	local_irq_save(flags);
+	pcp = &this_cpu_ptr(zone->pageset)->pcp;
+	pcp_list = &pcp->lists[ac.migratetype];
+
+	while (nr_populated < nr_pages) {
+		/* Skip existing pages */
+		if (page_array && page_array[nr_populated]) {
+			nr_populated++;
+			continue;
+		}
+
+		page = __rmqueue_pcplist(zone, ac.migratetype, pcp, pcp_list);
+		if (unlikely(!page)) {
+			/* Try at least one page through the slow path */
+			if (!nr_account)
+				goto failed_irq;
+			break;
+		}
+
+		nr_account++;
+		zone_statistics(ac.preferred_zoneref->zone, zone);
+		prep_new_page(page, 0, gfp, 0);
+		if (page_list)
+			list_add(&page->lru, page_list);
+		else
+			page_array[nr_populated] = page;
+		nr_populated++;
+	}
+
+	__count_zid_vm_events(PGALLOC, zone_idx(zone), nr_account);
+	local_irq_restore(flags);
+
+out:
+	return nr_populated;
+
+failed_irq:
+	local_irq_restore(flags);
+
+failed:
+	page = __alloc_pages_nodemask(gfp, 0, preferred_nid, nodemask);
+	if (page) {
+		if (page_list)
+			list_add(&page->lru, page_list);
+		else
+			page_array[nr_populated] = page;
+		nr_populated++;
+	}
+
+	goto out;
+}
+EXPORT_SYMBOL_GPL(__alloc_pages_bulk);
+
 /*
  * Common helper functions. Never use with __GFP_HIGHMEM because the returned
  * address cannot represent highmem pages. Use alloc_pages and then kmap if
@@ -102,6 +102,7 @@ static inline int pcpu_chunk_map_bits(struct pcpu_chunk *chunk)
 #ifdef CONFIG_PERCPU_STATS
 
 #include <linux/spinlock.h>
+#include <linux/sched/clock.h>
 
 struct percpu_stats {
 	u64 nr_alloc;		/* lifetime # of allocations */
@@ -112,10 +113,39 @@ struct percpu_stats {
 	u32 nr_max_chunks;	/* max # of live chunks */
 	size_t min_alloc_size;	/* min allocaiton size */
 	size_t max_alloc_size;	/* max allocation size */
+	u64 nr_lock_contended;	/* contended pcpu_lock acquisitions */
+	u64 nr_mutex_contended;	/* contended pcpu_alloc_mutex acquisitions */
+};
+
+/* pcpu_alloc() latency buckets: <1us, <10us, <100us, <1ms and the rest */
+#define PCPU_STATS_NR_LAT	5
+
+/*
+ * Counters updated outside of pcpu_lock.  These are kept per cpu and
+ * summed up when percpu_stats is read.
+ */
+struct percpu_stats_cpu {
+	u64 nr_cache_alloc;	/* allocations served by the area cache */
+	u64 nr_cache_free;	/* frees absorbed by the area cache */
+	u64 alloc_lat_ns;	/* total time spent in pcpu_alloc() */
+	u64 alloc_lat_max_ns;	/* slowest pcpu_alloc() */
+	u64 alloc_lat[PCPU_STATS_NR_LAT];
 };
 
 extern struct percpu_stats pcpu_stats;
 extern struct pcpu_alloc_info pcpu_stats_ai;
+DECLARE_PER_CPU(struct percpu_stats_cpu, pcpu_stats_cpu);
+
+/*
+ * Acquire pcpu_lock, counting the acquisitions which had to wait.
+ */
+#define pcpu_lock_irqsave(flags)					\
+do {									\
+	if (!spin_trylock_irqsave(&pcpu_lock, flags)) {			\
+		spin_lock_irqsave(&pcpu_lock, flags);			\
+		pcpu_stats.nr_lock_contended++;				\
+	}								\
+} while (0)
 
 /*
  * For debug purposes. We don't care about the flexible array.
@@ -198,8 +228,63 @@ static inline void pcpu_stats_chunk_dealloc(void)
 	spin_unlock_irqrestore(&pcpu_lock, flags);
 }
 
+/*
+ * pcpu_stats_mutex_contended - count a contended pcpu_alloc_mutex
+ *
+ * CONTEXT:
+ * pcpu_alloc_mutex.
+ */
+static inline void pcpu_stats_mutex_contended(void)
+{
+	pcpu_stats.nr_mutex_contended++;
+}
+
+/*
+ * pcpu_stats_cache_alloc - count an allocation served by the area cache
+ */
+static inline void pcpu_stats_cache_alloc(void)
+{
+	this_cpu_inc(pcpu_stats_cpu.nr_cache_alloc);
+}
+
+/*
+ * pcpu_stats_cache_free - count a free absorbed by the area cache
+ */
+static inline void pcpu_stats_cache_free(void)
+{
+	this_cpu_inc(pcpu_stats_cpu.nr_cache_free);
+}
+
+static inline u64 pcpu_stats_alloc_start(void)
+{
+	return local_clock();
+}
+
+/*
+ * pcpu_stats_alloc_done - account the latency of a pcpu_alloc() call
+ * @start: the return value of pcpu_stats_alloc_start()
+ */
+static inline void pcpu_stats_alloc_done(u64 start)
+{
+	u64 delta = local_clock() - start;
+	u64 limit = NSEC_PER_USEC;
+	int bucket = 0;
+
+	while (bucket < PCPU_STATS_NR_LAT - 1 && delta >= limit) {
+		limit *= 10;
+		bucket++;
+	}
+
+	this_cpu_inc(pcpu_stats_cpu.alloc_lat[bucket]);
+	this_cpu_add(pcpu_stats_cpu.alloc_lat_ns, delta);
+	if (delta > this_cpu_read(pcpu_stats_cpu.alloc_lat_max_ns))
+		this_cpu_write(pcpu_stats_cpu.alloc_lat_max_ns, delta);
+}
+
 #else
 
+#define pcpu_lock_irqsave(flags)	spin_lock_irqsave(&pcpu_lock, flags)
+
 static inline void pcpu_stats_save_ai(const struct pcpu_alloc_info *ai)
 {
 }
@@ -220,6 +305,27 @@ static inline void pcpu_stats_chunk_dealloc(void)
 {
 }
 
+static inline void pcpu_stats_mutex_contended(void)
+{
+}
+
+static inline void pcpu_stats_cache_alloc(void)
+{
+}
+
+static inline void pcpu_stats_cache_free(void)
+{
+}
+
+static inline u64 pcpu_stats_alloc_start(void)
+{
+	return 0;
+}
+
+static inline void pcpu_stats_alloc_done(u64 start)
+{
+}
+
 #endif /* !CONFIG_PERCPU_STATS */
 
 #endif
@@ -10,6 +10,7 @@
  */
 #include <linux/debugfs.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 #include <linux/percpu.h>
 #include <linux/seq_file.h>
 #include <linux/sort.h>
@@ -22,6 +23,7 @@
 
 struct percpu_stats pcpu_stats;
 struct pcpu_alloc_info pcpu_stats_ai;
+DEFINE_PER_CPU(struct percpu_stats_cpu, pcpu_stats_cpu);
 
 static int cmpint(const void *a, const void *b)
 {
@@ -44,6 +46,27 @@ static int find_max_nr_alloc(void)
 	return max_nr_alloc;
 }
 
+/*
+ * Sums up the per cpu counters into @sum.
+ */
+static void sum_stats_cpu(struct percpu_stats_cpu *sum)
+{
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		struct percpu_stats_cpu *s = per_cpu_ptr(&pcpu_stats_cpu, cpu);
+
+		sum->nr_cache_alloc += s->nr_cache_alloc;
+		sum->nr_cache_free += s->nr_cache_free;
+		sum->alloc_lat_ns += s->alloc_lat_ns;
+		sum->alloc_lat_max_ns = max(sum->alloc_lat_max_ns,
+					    s->alloc_lat_max_ns);
+		for (i = 0; i < PCPU_STATS_NR_LAT; i++)
+			sum->alloc_lat[i] += s->alloc_lat[i];
+	}
+}
+
 /*
  * Prints out chunk state. Fragmentation is considered between
  * the beginning of the chunk to the last allocation.
@@ -134,8 +157,10 @@ static void chunk_map_stats(struct seq_file *m, struct pcpu_chunk *chunk,
 
 static int percpu_stats_show(struct seq_file *m, void *v)
 {
+	struct percpu_stats_cpu sum;
 	struct pcpu_chunk *chunk;
 	int slot, max_nr_alloc;
+	u64 nr_lat;
 	int *buffer;
 
 alloc_buffer:
@@ -191,6 +216,26 @@ alloc_buffer:
 	P("empty_pop_pages", pcpu_nr_empty_pop_pages);
 	seq_putc(m, '\n');
 
+	seq_printf(m,
+			"Contention and Latency:\n"
+			"----------------------------------------\n");
+	PU(nr_lock_contended);
+	PU(nr_mutex_contended);
+
+	sum_stats_cpu(&sum);
+	for (nr_lat = 0, slot = 0; slot < PCPU_STATS_NR_LAT; slot++)
+		nr_lat += sum.alloc_lat[slot];
+	P("nr_cache_alloc", sum.nr_cache_alloc);
+	P("nr_cache_free", sum.nr_cache_free);
+	P("alloc_lat_avg_ns", nr_lat ? div64_u64(sum.alloc_lat_ns, nr_lat) : 0);
+	P("alloc_lat_max_ns", sum.alloc_lat_max_ns);
+	P("alloc_lat_lt_1us", sum.alloc_lat[0]);
+	P("alloc_lat_lt_10us", sum.alloc_lat[1]);
+	P("alloc_lat_lt_100us", sum.alloc_lat[2]);
+	P("alloc_lat_lt_1ms", sum.alloc_lat[3]);
+	P("alloc_lat_ge_1ms", sum.alloc_lat[4]);
+	seq_putc(m, '\n');
+
 #undef PU
 
 	seq_printf(m,
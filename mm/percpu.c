@@ -194,6 +194,28 @@ static void pcpu_schedule_balance_work(void)
 		schedule_work(&pcpu_balance_work);
 }
 
+/*
+ * Small areas released by free_percpu() are parked in a per-cpu cache,
+ * one stack per power of two size, and handed back out by pcpu_alloc()
+ * without touching pcpu_alloc_mutex, pcpu_lock or the chunk bitmaps.
+ * Cached areas stay allocated in their chunk, so they are always
+ * populated.  pcpu_balance_workfn() and a failing pcpu_alloc() drain the
+ * caches to give the space back to the chunks.
+ */
+#define PCPU_CACHE_NR_CLASSES	5	/* 4, 8, 16, 32 and 64 bytes */
+#define PCPU_CACHE_MAX_BITS	(1 << (PCPU_CACHE_NR_CLASSES - 1))
+#define PCPU_CACHE_DEPTH	16
+
+struct pcpu_area_cache {
+	spinlock_t		lock;
+	int			nr[PCPU_CACHE_NR_CLASSES];
+	void			*addr[PCPU_CACHE_NR_CLASSES][PCPU_CACHE_DEPTH];
+};
+
+static DEFINE_PER_CPU(struct pcpu_area_cache, pcpu_area_cache) = {
+	.lock = __SPIN_LOCK_UNLOCKED(pcpu_area_cache.lock),
+};
+
 /**
  * pcpu_addr_in_chunk - check if the address is served from this chunk
  * @chunk: chunk of interest
@@ -1335,6 +1357,134 @@ static struct pcpu_chunk *pcpu_chunk_addr_search(void *addr)
 	return pcpu_get_page_chunk(pcpu_addr_to_page(addr));
 }
 
+/* returns the area cache class for an allocation of @bits, or -1 */
+static int pcpu_cache_class(int bits)
+{
+	if (bits > PCPU_CACHE_MAX_BITS || !is_power_of_2(bits))
+		return -1;
+	return ilog2(bits);
+}
+
+/**
+ * pcpu_cache_get - allocate an area from the local area cache
+ * @bits: size of request in allocation units
+ * @align: alignment of area in bytes
+ *
+ * RETURNS:
+ * The address of a cached area of @bits satisfying @align, NULL if the
+ * local cache has none.
+ */
+static void *pcpu_cache_get(int bits, size_t align)
+{
+	struct pcpu_area_cache *cache;
+	int class = pcpu_cache_class(bits);
+	unsigned long flags;
+	void *addr = NULL;
+	int i;
+
+	if (class < 0 || !pcpu_async_enabled)
+		return NULL;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(&pcpu_area_cache);
+	spin_lock(&cache->lock);
+	for (i = cache->nr[class] - 1; i >= 0; i--) {
+		if (IS_ALIGNED((unsigned long)cache->addr[class][i], align)) {
+			addr = cache->addr[class][i];
+			cache->nr[class]--;
+			cache->addr[class][i] =
+				cache->addr[class][cache->nr[class]];
+			break;
+		}
+	}
+	spin_unlock(&cache->lock);
+	local_irq_restore(flags);
+
+	return addr;
+}
+
+/**
+ * pcpu_cache_put - park an area being freed in the local area cache
+ * @chunk: chunk the area belongs to
+ * @addr: address of the area
+ *
+ * The size of the area is read from @chunk's bound_map without
+ * pcpu_lock.  That is safe because the bits describing a live area are
+ * only ever changed by the allocation and the free of that area.
+ *
+ * RETURNS:
+ * %true if the area was cached, %false if it must be freed to @chunk.
+ */
+static bool pcpu_cache_put(struct pcpu_chunk *chunk, void *addr)
+{
+	struct pcpu_area_cache *cache;
+	unsigned long flags;
+	int bit_off, end, class;
+	bool cached = false;
+
+	if (!pcpu_async_enabled || chunk == pcpu_reserved_chunk)
+		return false;
+
+	bit_off = (addr - chunk->base_addr) / PCPU_MIN_ALLOC_SIZE;
+	end = min(bit_off + PCPU_CACHE_MAX_BITS + 1,
+		  pcpu_chunk_map_bits(chunk) + 1);
+	end = find_next_bit(chunk->bound_map, end, bit_off + 1);
+	class = pcpu_cache_class(end - bit_off);
+	if (class < 0)
+		return false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(&pcpu_area_cache);
+	spin_lock(&cache->lock);
+	if (cache->nr[class] < PCPU_CACHE_DEPTH) {
+		cache->addr[class][cache->nr[class]++] = addr;
+		cached = true;
+	}
+	spin_unlock(&cache->lock);
+	local_irq_restore(flags);
+
+	return cached;
+}
+
+/**
+ * pcpu_drain_area_caches - free all cached areas back to their chunks
+ *
+ * RETURNS:
+ * The number of areas freed.
+ */
+static int pcpu_drain_area_caches(void)
+{
+	void *addrs[PCPU_CACHE_DEPTH];
+	struct pcpu_chunk *chunk;
+	int cpu, class, nr, i, drained = 0;
+
+	for_each_possible_cpu(cpu) {
+		struct pcpu_area_cache *cache;
+
+		cache = per_cpu_ptr(&pcpu_area_cache, cpu);
+		for (class = 0; class < PCPU_CACHE_NR_CLASSES; class++) {
+			spin_lock_irq(&cache->lock);
+			nr = cache->nr[class];
+			memcpy(addrs, cache->addr[class], nr * sizeof(void *));
+			cache->nr[class] = 0;
+			spin_unlock_irq(&cache->lock);
+
+			if (!nr)
+				continue;
+
+			spin_lock_irq(&pcpu_lock);
+			for (i = 0; i < nr; i++) {
+				chunk = pcpu_chunk_addr_search(addrs[i]);
+				pcpu_free_area(chunk, addrs[i] - chunk->base_addr);
+			}
+			spin_unlock_irq(&pcpu_lock);
+			drained += nr;
+		}
+	}
+
+	return drained;
+}
+
 /**
  * pcpu_alloc - the percpu allocator
  * @size: size of area to allocate in bytes
@@ -1364,6 +1514,9 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 	unsigned long flags;
 	void __percpu *ptr;
 	size_t bits, bit_align;
+	bool drained = false;
+	u64 start = pcpu_stats_alloc_start();
+	void *addr;
 
 	/*
 	 * There is now a minimum allocation size of PCPU_MIN_ALLOC_SIZE,
@@ -1385,7 +1538,18 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 		return NULL;
 	}
 
-	if (!is_atomic) {
+	/* small areas recently freed on this cpu need no locking */
+	if (!reserved) {
+		addr = pcpu_cache_get(bits, align);
+		if (addr) {
+			chunk = pcpu_chunk_addr_search(addr);
+			off = addr - chunk->base_addr;
+			pcpu_stats_cache_alloc();
+			goto area_ready;
+		}
+	}
+
+	if (!is_atomic && !mutex_trylock(&pcpu_alloc_mutex)) {
 		/*
 		 * pcpu_balance_workfn() allocates memory under this mutex,
 		 * and it may wait for memory reclaim. Allow current task
@@ -1395,9 +1559,10 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 			mutex_lock(&pcpu_alloc_mutex);
 		else if (mutex_lock_killable(&pcpu_alloc_mutex))
 			return NULL;
+		pcpu_stats_mutex_contended();
 	}
 
-	spin_lock_irqsave(&pcpu_lock, flags);
+	pcpu_lock_irqsave(flags);
 
 	/* serve reserved allocations from the reserved chunk if available */
 	if (reserved && pcpu_reserved_chunk) {
@@ -1435,6 +1600,15 @@ restart:
 
 	spin_unlock_irqrestore(&pcpu_lock, flags);
 
+	/* the area caches may be holding on to enough free space */
+	if (!is_atomic && !drained) {
+		drained = true;
+		if (pcpu_drain_area_caches()) {
+			pcpu_lock_irqsave(flags);
+			goto restart;
+		}
+	}
+
 	/*
 	 * No space left.  Create a new chunk.  We don't want multiple
 	 * tasks to create chunks simultaneously.  Serialize and create iff
@@ -1452,10 +1626,10 @@ restart:
 			goto fail;
 		}
 
-		spin_lock_irqsave(&pcpu_lock, flags);
+		pcpu_lock_irqsave(flags);
 		pcpu_chunk_relocate(chunk, -1);
 	} else {
-		spin_lock_irqsave(&pcpu_lock, flags);
+		pcpu_lock_irqsave(flags);
 	}
 
 	goto restart;
@@ -1477,7 +1651,7 @@ area_found:
 
 			ret = pcpu_populate_chunk(chunk, rs, re, pcpu_gfp);
 
-			spin_lock_irqsave(&pcpu_lock, flags);
+			pcpu_lock_irqsave(flags);
 			if (ret) {
 				pcpu_free_area(chunk, off);
 				err = "failed to populate";
@@ -1493,6 +1667,7 @@ area_found:
 	if (pcpu_nr_empty_pop_pages < PCPU_EMPTY_POP_PAGES_LOW)
 		pcpu_schedule_balance_work();
 
+area_ready:
 	/* clear the areas and return address relative to base address */
 	for_each_possible_cpu(cpu)
 		memset((void *)pcpu_chunk_addr(chunk, cpu, 0) + off, 0, size);
@@ -1503,6 +1678,7 @@ area_found:
 	trace_percpu_alloc_percpu(reserved, is_atomic, size, align,
 			chunk->base_addr, off, ptr);
 
+	pcpu_stats_alloc_done(start);
 	return ptr;
 
 fail_unlock:
@@ -1524,6 +1700,7 @@ fail:
 	} else {
 		mutex_unlock(&pcpu_alloc_mutex);
 	}
+	pcpu_stats_alloc_done(start);
 	return NULL;
 }
 
@@ -1605,8 +1782,10 @@ static void pcpu_balance_workfn(struct work_struct *work)
 	/*
 	 * There's no reason to keep around multiple unused chunks and VM
 	 * areas can be scarce.  Destroy all free chunks except for one.
+	 * Flush the area caches first so that they don't pin chunks.
 	 */
 	mutex_lock(&pcpu_alloc_mutex);
+	pcpu_drain_area_caches();
 	spin_lock_irq(&pcpu_lock);
 
 	list_for_each_entry_safe(chunk, next, free_head, list) {
@@ -1730,12 +1909,17 @@ void free_percpu(void __percpu *ptr)
 	kmemleak_free_percpu(ptr);
 
 	addr = __pcpu_ptr_to_addr(ptr);
-
-	spin_lock_irqsave(&pcpu_lock, flags);
-
 	chunk = pcpu_chunk_addr_search(addr);
 	off = addr - chunk->base_addr;
 
+	if (pcpu_cache_put(chunk, addr)) {
+		pcpu_stats_cache_free();
+		trace_percpu_free_percpu(chunk->base_addr, off, ptr);
+		return;
+	}
+
+	pcpu_lock_irqsave(flags);
+
 	pcpu_free_area(chunk, off);
 
 	/* if there are more than one fully free chunks, wake up grim reaper */
@@ -141,6 +141,40 @@ out:
 	return ret;
 }
 
+/*
+ * Readahead takes the pages for a run of missing indices in physically
+ * contiguous blocks of up to this order, split into base pages.  The page
+ * cache still holds order-0 pages, but the allocator is entered once per
+ * block, and the bios built from a block need a single segment.
+ */
+#define RA_ALLOC_MAX_ORDER	PAGE_ALLOC_COSTLY_ORDER
+
+/*
+ * Allocate pages for up to @nr consecutive indices and return the first;
+ * the others follow it in the memmap.  A block is only taken if one is
+ * free right away: readahead is opportunistic and must not reclaim or
+ * compact for contiguity, so fall back to a single page.
+ */
+static struct page *ra_alloc_block(gfp_t gfp, unsigned long nr,
+				   unsigned int *nr_pages)
+{
+	unsigned int order = min_t(unsigned int, ilog2(nr), RA_ALLOC_MAX_ORDER);
+	struct page *page;
+
+	if (order) {
+		page = __page_cache_alloc_order(gfp & ~__GFP_RECLAIM, order);
+		if (page) {
+			split_page(page, order);
+			*nr_pages = 1U << order;
+			return page;
+		}
+	}
+
+	page = __page_cache_alloc(gfp);
+	*nr_pages = page ? 1 : 0;
+	return page;
+}
+
 /*
  * __do_page_cache_readahead() actually reads a chunk of disk.  It allocates
  * the pages first, then submits them for I/O. This avoids the very bad
@@ -154,7 +188,8 @@ unsigned int __do_page_cache_readahead(struct address_space *mapping,
 		unsigned long lookahead_size)
 {
 	struct inode *inode = mapping->host;
-	struct page *page;
+	struct page *page, *block = NULL;
+	unsigned int block_pages = 0;
 	unsigned long end_index;	/* The last page we want to read */
 	LIST_HEAD(page_pool);
 	int page_idx;
@@ -192,9 +227,16 @@ unsigned int __do_page_cache_readahead(struct address_space *mapping,
 			continue;
 		}
 
-		page = __page_cache_alloc(gfp_mask);
-		if (!page)
-			break;
+		if (!block_pages) {
+			block = ra_alloc_block(gfp_mask,
+				min_t(unsigned long, nr_to_read - page_idx,
+				      end_index - page_offset + 1),
+				&block_pages);
+			if (!block)
+				break;
+		}
+		page = block++;
+		block_pages--;
 		page->index = page_offset;
 		list_add(&page->lru, &page_pool);
 		if (page_idx == nr_to_read - lookahead_size)
@@ -210,6 +252,10 @@ unsigned int __do_page_cache_readahead(struct address_space *mapping,
 	if (nr_pages)
 		read_pages(mapping, filp, &page_pool, nr_pages, gfp_mask);
 	BUG_ON(!list_empty(&page_pool));
+
+	/* Cached pages in the range leave the last block partly unused */
+	while (block_pages--)
+		put_page(block++);
 out:
 	return nr_pages;
 }
@@ -247,6 +293,42 @@ int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	return 0;
 }
 
+/*
+ * The readahead window of a file adapts to how fast the file is consumed
+ * relative to the device, from the bdi default up to this multiple of the
+ * larger of the default and the optimal device IO size.
+ */
+#define RA_GROW_MAX_SHIFT	3
+
+/*
+ * The reader caught up with readahead I/O still in flight: the window does
+ * not cover the device latency at the rate the file is read.  Double it.
+ */
+static void ra_grow_window(struct file_ra_state *ra,
+			   struct address_space *mapping)
+{
+	struct backing_dev_info *bdi = inode_to_bdi(mapping->host);
+	unsigned long max;
+
+	max = max(bdi->ra_pages, bdi->io_pages) << RA_GROW_MAX_SHIFT;
+	if (ra->ra_pages < max)
+		ra->ra_pages = min_t(unsigned long, ra->ra_pages * 2, max);
+}
+
+/*
+ * Pages of the current window were gone before the reader got to them,
+ * so readahead is thrashing.  Back off towards the bdi default.
+ */
+static void ra_shrink_window(struct file_ra_state *ra,
+			     struct address_space *mapping)
+{
+	struct backing_dev_info *bdi = inode_to_bdi(mapping->host);
+
+	if (ra->ra_pages > bdi->ra_pages)
+		ra->ra_pages = max_t(unsigned long, ra->ra_pages / 2,
+				     bdi->ra_pages);
+}
+
 /*
  * Set the initial window size, round to next power of 2 and square
  * for small size, x 4 for medium, and x 2 for large
@@ -515,6 +597,10 @@ void page_cache_sync_readahead(struct address_space *mapping,
 	if (!ra->ra_pages)
 		return;
 
+	ra->misses++;
+	if (ra_has_index(ra, offset))
+		ra_shrink_window(ra, mapping);
+
 	if (blk_cgroup_congested())
 		return;
 
@@ -550,6 +636,8 @@ page_cache_async_readahead(struct address_space *mapping,
 			   struct page *page, pgoff_t offset,
 			   unsigned long req_size)
 {
+	bool late;
+
 	/* no read-ahead */
 	if (!ra->ra_pages)
 		return;
@@ -562,6 +650,17 @@ page_cache_async_readahead(struct address_space *mapping,
 
 	ClearPageReadahead(page);
 
+	/*
+	 * The marker sits before the end of the window so that the next
+	 * window is under way by the time the reader needs it.  If the marked
+	 * page itself is still being read, the window is too small.
+	 */
+	late = !PageUptodate(page);
+	if (late)
+		ra->misses++;
+	else
+		ra->hits++;
+
 	/*
 	 * Defer asynchronous read-ahead on IO congestion.
 	 */
@@ -571,6 +670,9 @@ page_cache_async_readahead(struct address_space *mapping,
 	if (blk_cgroup_congested())
 		return;
 
+	if (late)
+		ra_grow_window(ra, mapping);
+
 	/* do read-ahead */
 	ondemand_readahead(mapping, ra, filp, true, offset, req_size);
 }
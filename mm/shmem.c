@@ -1359,7 +1359,7 @@ static int shmem_writepage(struct page *page, struct writeback_control *wbc)
 	if (list_empty(&info->swaplist))
 		list_add_tail(&info->swaplist, &shmem_swaplist);
 
-	if (add_to_swap_cache(page, swap, GFP_ATOMIC) == 0) {
+	if (add_to_swap_cache(page, swap, GFP_ATOMIC, NULL) == 0) {
 		spin_lock_irq(&info->lock);
 		shmem_recalc_inode(inode);
 		info->swapped++;
@@ -1660,6 +1660,19 @@ repeat:
 		goto unlock;
 	}
 
+	/*
+	 * The page is in the page cache (or swapped out from it) but not
+	 * mapped by this vma: a minor fault, resolved by UFFDIO_CONTINUE.
+	 */
+	if ((page || swap.val) && vma && userfaultfd_minor(vma)) {
+		if (page) {
+			unlock_page(page);
+			put_page(page);
+		}
+		*fault_type = handle_userfault(vmf, VM_UFFD_MINOR);
+		return 0;
+	}
+
 	if (page && sgp == SGP_WRITE)
 		mark_page_accessed(page);
 
@@ -215,13 +215,11 @@ enum track_item { TRACK_ALLOC, TRACK_FREE };
 #ifdef CONFIG_SYSFS
 static int sysfs_slab_add(struct kmem_cache *);
 static int sysfs_slab_alias(struct kmem_cache *, const char *);
-static void memcg_propagate_slab_attrs(struct kmem_cache *s);
 static void sysfs_slab_remove(struct kmem_cache *s);
 #else
 static inline int sysfs_slab_add(struct kmem_cache *s) { return 0; }
 static inline int sysfs_slab_alias(struct kmem_cache *s, const char *p)
 							{ return 0; }
-static inline void memcg_propagate_slab_attrs(struct kmem_cache *s) { }
 static inline void sysfs_slab_remove(struct kmem_cache *s) { }
 #endif
 
@@ -1439,10 +1437,8 @@ static inline struct page *alloc_slab_page(struct kmem_cache *s,
 	else
 		page = __alloc_pages_node(node, flags, order);
 
-	if (page && memcg_charge_slab(page, flags, order, s)) {
-		__free_pages(page, order);
-		page = NULL;
-	}
+	if (page)
+		charge_slab_page(page, order, s);
 
 	return page;
 }
@@ -1631,11 +1627,6 @@ out:
 	if (!page)
 		return NULL;
 
-	mod_lruvec_page_state(page,
-		(s->flags & SLAB_RECLAIM_ACCOUNT) ?
-		NR_SLAB_RECLAIMABLE : NR_SLAB_UNRECLAIMABLE,
-		1 << oo_order(oo));
-
 	inc_slabs_node(s, page_to_nid(page), page->objects);
 
 	return page;
@@ -1669,18 +1660,13 @@ static void __free_slab(struct kmem_cache *s, struct page *page)
 			check_object(s, page, p, SLUB_RED_INACTIVE);
 	}
 
-	mod_lruvec_page_state(page,
-		(s->flags & SLAB_RECLAIM_ACCOUNT) ?
-		NR_SLAB_RECLAIMABLE : NR_SLAB_UNRECLAIMABLE,
-		-pages);
-
 	__ClearPageSlabPfmemalloc(page);
 	__ClearPageSlab(page);
 
 	page->mapping = NULL;
 	if (current->reclaim_state)
 		current->reclaim_state->reclaimed_slab += pages;
-	memcg_uncharge_slab(page, order, s);
+	uncharge_slab_page(page, order, s);
 	__free_pages(page, order);
 }
 
@@ -2266,6 +2252,23 @@ static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 	c->tid = next_tid(c->tid);
 }
 
+static void __slab_free_bulk(struct kmem_cache *s, size_t size, void **p);
+
+/*
+ * Return all objects of a cpu sheaf to the slabs. Interrupts must be
+ * disabled, or @cpu must be dead.
+ */
+static void flush_sheaf(struct kmem_cache *s, int cpu)
+{
+	struct kmem_cache_sheaf *sheaf = per_cpu_ptr(s->sheaf, cpu);
+
+	if (sheaf->nr) {
+		__slab_free_bulk(s, sheaf->nr, sheaf->objects);
+		sheaf->nr = 0;
+		stat(s, SHEAF_FLUSH);
+	}
+}
+
 /*
  * Flush cpu slab.
  *
@@ -2275,6 +2278,9 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	if (s->sheaf)
+		flush_sheaf(s, cpu);
+
 	if (likely(c)) {
 		if (c->page)
 			flush_slab(s, c);
@@ -2295,6 +2301,9 @@ static bool has_cpu_slab(int cpu, void *info)
 	struct kmem_cache *s = info;
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	if (s->sheaf && per_cpu_ptr(s->sheaf, cpu)->nr)
+		return true;
+
 	return c->page || slub_percpu_partial(c);
 }
 
@@ -2611,6 +2620,110 @@ static void *__slab_alloc(struct kmem_cache *s, gfp_t gfpflags, int node,
 	return p;
 }
 
+/*
+ * Take up to @size objects from the cpu slab into @p, without the memcg
+ * and debug hooks. Returns the number of objects taken, which falls short
+ * of @size only if no new slab could be allocated.
+ */
+static int __slab_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			     void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long irqflags;
+	int i;
+
+	/*
+	 * Drain objects in the per cpu slab, while disabling local
+	 * IRQs, which protects against PREEMPT and interrupts
+	 * handlers invoking normal fastpath.
+	 */
+	local_irq_save(irqflags);
+	c = this_cpu_ptr(s->cpu_slab);
+
+	for (i = 0; i < size; i++) {
+		void *object = c->freelist;
+
+		if (unlikely(!object)) {
+			/*
+			 * Invoking slow path likely have side-effect
+			 * of re-populating per CPU c->freelist
+			 */
+			p[i] = ___slab_alloc(s, flags, NUMA_NO_NODE,
+					    _RET_IP_, c);
+			if (unlikely(!p[i]))
+				break;
+
+			c = this_cpu_ptr(s->cpu_slab);
+			continue; /* goto for-loop */
+		}
+		c->freelist = get_freepointer(s, object);
+		p[i] = object;
+	}
+	c->tid = next_tid(c->tid);
+	local_irq_restore(irqflags);
+
+	return i;
+}
+
+/*
+ * Sheaves: the cpus of a SLAB_SHEAVES cache keep arrays of free objects
+ * in front of their cpu slabs. Allocations and frees that the sheaf can
+ * serve only disable interrupts. The sheaf is refilled and flushed half
+ * a capacity at a time, so that the cost of a trip to the slabs, and of
+ * the node list_lock on the way, is shared by many objects.
+ *
+ * The objects in a sheaf are free as far as memcg, kasan and kmemleak
+ * are concerned: the hooks run when they are handed out and put back.
+ */
+#define SHEAF_MAX_CAPACITY	64
+
+static void *sheaf_alloc(struct kmem_cache *s, gfp_t gfpflags)
+{
+	void *batch[SHEAF_MAX_CAPACITY / 2];
+	struct kmem_cache_sheaf *sheaf;
+	unsigned long flags;
+	unsigned int room;
+	void *object;
+	int nr;
+
+	local_irq_save(flags);
+	sheaf = this_cpu_ptr(s->sheaf);
+	if (likely(sheaf->nr)) {
+		object = sheaf->objects[--sheaf->nr];
+		local_irq_restore(flags);
+		stat(s, SHEAF_ALLOC);
+		return object;
+	}
+	local_irq_restore(flags);
+
+	/*
+	 * Objects from pfmemalloc slabs must not end up in a sheaf where
+	 * any allocation could find them; leave reserves to the slow path.
+	 */
+	if (gfp_pfmemalloc_allowed(gfpflags))
+		return NULL;
+
+	nr = __slab_alloc_bulk(s, gfpflags, s->sheaf_capacity / 2, batch);
+	if (!nr)
+		return NULL;
+	stat(s, SHEAF_REFILL);
+	object = batch[--nr];
+
+	/* We may have moved to another cpu, whose sheaf is not empty */
+	local_irq_save(flags);
+	sheaf = this_cpu_ptr(s->sheaf);
+	room = min_t(unsigned int, nr, s->sheaf_capacity - sheaf->nr);
+	nr -= room;
+	memcpy(sheaf->objects + sheaf->nr, batch + nr, room * sizeof(void *));
+	sheaf->nr += room;
+	local_irq_restore(flags);
+
+	if (nr)
+		__slab_free_bulk(s, nr, batch);
+
+	return object;
+}
+
 /*
  * Inlined fastpath so that allocation functions (kmalloc, kmem_cache_alloc)
  * have the fastpath folded into their functions. So no function call
@@ -2628,10 +2741,17 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 	struct kmem_cache_cpu *c;
 	struct page *page;
 	unsigned long tid;
+	struct obj_cgroup *objcg = NULL;
 
-	s = slab_pre_alloc_hook(s, gfpflags);
+	s = slab_pre_alloc_hook(s, &objcg, 1, gfpflags);
 	if (!s)
 		return NULL;
+
+	if (s->sheaf && node == NUMA_NO_NODE) {
+		object = sheaf_alloc(s, gfpflags);
+		if (likely(object))
+			goto out;
+	}
 redo:
 	/*
 	 * Must read kmem_cache cpu data via this cpu ptr. Preemption is
@@ -2699,11 +2819,11 @@ redo:
 		prefetch_freepointer(s, next_object);
 		stat(s, ALLOC_FASTPATH);
 	}
-
+out:
 	if (unlikely(gfpflags & __GFP_ZERO) && object)
 		memset(object, 0, s->object_size);
 
-	slab_post_alloc_hook(s, gfpflags, 1, &object);
+	slab_post_alloc_hook(s, objcg, gfpflags, 1, &object);
 
 	return object;
 }
@@ -2942,6 +3062,44 @@ redo:
 
 }
 
+/*
+ * Put an object into the cpu sheaf. If the sheaf is full, flush its
+ * older half to the slabs first. Objects of remote nodes and of
+ * pfmemalloc slabs are not kept.
+ */
+static bool sheaf_free(struct kmem_cache *s, struct page *page, void *object)
+{
+	void *batch[SHEAF_MAX_CAPACITY / 2];
+	struct kmem_cache_sheaf *sheaf;
+	unsigned long flags;
+	unsigned int nr;
+
+	if (unlikely(PageSlabPfmemalloc(page)) ||
+	    page_to_nid(page) != numa_mem_id())
+		return false;
+
+	local_irq_save(flags);
+	sheaf = this_cpu_ptr(s->sheaf);
+	if (likely(sheaf->nr < s->sheaf_capacity)) {
+		sheaf->objects[sheaf->nr++] = object;
+		local_irq_restore(flags);
+		stat(s, SHEAF_FREE);
+		return true;
+	}
+
+	nr = s->sheaf_capacity / 2;
+	memcpy(batch, sheaf->objects, nr * sizeof(void *));
+	memmove(sheaf->objects, sheaf->objects + nr,
+		(sheaf->nr - nr) * sizeof(void *));
+	sheaf->nr -= nr;
+	sheaf->objects[sheaf->nr++] = object;
+	local_irq_restore(flags);
+
+	__slab_free_bulk(s, nr, batch);
+	stat(s, SHEAF_FLUSH);
+	return true;
+}
+
 static __always_inline void slab_free(struct kmem_cache *s, struct page *page,
 				      void *head, void *tail, int cnt,
 				      unsigned long addr)
@@ -2950,8 +3108,11 @@ static __always_inline void slab_free(struct kmem_cache *s, struct page *page,
 	 * With KASAN enabled slab_free_freelist_hook modifies the freelist
 	 * to remove objects, whose reuse must be delayed.
 	 */
-	if (slab_free_freelist_hook(s, &head, &tail))
+	if (slab_free_freelist_hook(s, &head, &tail)) {
+		if (s->sheaf && !tail && sheaf_free(s, page, head))
+			return;
 		do_slab_free(s, page, head, tail, cnt, addr);
+	}
 }
 
 #ifdef CONFIG_KASAN
@@ -2966,6 +3127,7 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 	s = cache_from_obj(s, x);
 	if (!s)
 		return;
+	memcg_slab_free_hook(s, &x, 1);
 	slab_free(s, virt_to_head_page(x), x, NULL, 1, _RET_IP_);
 	trace_kmem_cache_free(_RET_IP_, x);
 }
@@ -3062,12 +3224,31 @@ int build_detached_freelist(struct kmem_cache *s, size_t size,
 	return first_skipped_index;
 }
 
+/*
+ * Free objects that already went through the free hooks, as when a sheaf
+ * is flushed. Interrupts may be disabled.
+ */
+static void __slab_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	do {
+		struct detached_freelist df;
+
+		size = build_detached_freelist(s, size, p, &df);
+		if (!df.page)
+			continue;
+
+		do_slab_free(df.s, df.page, df.freelist, df.tail, df.cnt,
+			     _RET_IP_);
+	} while (likely(size));
+}
+
 /* Note that interrupts must be enabled when calling this function. */
 void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
 {
 	if (WARN_ON(!size))
 		return;
 
+	memcg_slab_free_hook(s, p, size);
 	do {
 		struct detached_freelist df;
 
@@ -3084,42 +3265,17 @@ EXPORT_SYMBOL(kmem_cache_free_bulk);
 int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 			  void **p)
 {
-	struct kmem_cache_cpu *c;
 	int i;
+	struct obj_cgroup *objcg = NULL;
 
 	/* memcg and kmem_cache debug support */
-	s = slab_pre_alloc_hook(s, flags);
+	s = slab_pre_alloc_hook(s, &objcg, size, flags);
 	if (unlikely(!s))
 		return false;
-	/*
-	 * Drain objects in the per cpu slab, while disabling local
-	 * IRQs, which protects against PREEMPT and interrupts
-	 * handlers invoking normal fastpath.
-	 */
-	local_irq_disable();
-	c = this_cpu_ptr(s->cpu_slab);
-
-	for (i = 0; i < size; i++) {
-		void *object = c->freelist;
-
-		if (unlikely(!object)) {
-			/*
-			 * Invoking slow path likely have side-effect
-			 * of re-populating per CPU c->freelist
-			 */
-			p[i] = ___slab_alloc(s, flags, NUMA_NO_NODE,
-					    _RET_IP_, c);
-			if (unlikely(!p[i]))
-				goto error;
 
-			c = this_cpu_ptr(s->cpu_slab);
-			continue; /* goto for-loop */
-		}
-		c->freelist = get_freepointer(s, object);
-		p[i] = object;
-	}
-	c->tid = next_tid(c->tid);
-	local_irq_enable();
+	i = __slab_alloc_bulk(s, flags, size, p);
+	if (unlikely(i < size))
+		goto error;
 
 	/* Clear memory outside IRQ disabled fastpath loop */
 	if (unlikely(flags & __GFP_ZERO)) {
@@ -3130,11 +3286,12 @@ int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 	}
 
 	/* memcg and kmem_cache debug support */
-	slab_post_alloc_hook(s, flags, size, p);
+	slab_post_alloc_hook(s, objcg, flags, size, p);
 	return i;
 error:
-	local_irq_enable();
-	slab_post_alloc_hook(s, flags, i, p);
+	/* Empty slots hand their share of the memcg charge back */
+	memset(p + i, 0, (size - i) * sizeof(void *));
+	slab_post_alloc_hook(s, objcg, flags, size, p);
 	__kmem_cache_free_bulk(s, i, p);
 	return 0;
 }
@@ -3278,6 +3435,32 @@ init_kmem_cache_node(struct kmem_cache_node *n)
 #endif
 }
 
+static int alloc_kmem_cache_sheaves(struct kmem_cache *s)
+{
+	unsigned int capacity;
+
+	if (!(s->flags & SLAB_SHEAVES) || kmem_cache_debug(s))
+		return 1;
+
+	/* As with the array caches of SLAB, keep fewer large objects */
+	if (s->size > PAGE_SIZE)
+		capacity = 8;
+	else if (s->size > 1024)
+		capacity = 16;
+	else if (s->size > 256)
+		capacity = 32;
+	else
+		capacity = SHEAF_MAX_CAPACITY;
+
+	s->sheaf = __alloc_percpu(sizeof(struct kmem_cache_sheaf) +
+				  capacity * sizeof(void *), sizeof(void *));
+	if (!s->sheaf)
+		return 0;
+
+	s->sheaf_capacity = capacity;
+	return 1;
+}
+
 static inline int alloc_kmem_cache_cpus(struct kmem_cache *s)
 {
 	BUILD_BUG_ON(PERCPU_DYNAMIC_EARLY_SIZE <
@@ -3295,6 +3478,11 @@ static inline int alloc_kmem_cache_cpus(struct kmem_cache *s)
 
 	init_kmem_cache_cpus(s);
 
+	if (!alloc_kmem_cache_sheaves(s)) {
+		free_percpu(s->cpu_slab);
+		return 0;
+	}
+
 	return 1;
 }
 
@@ -3360,6 +3548,7 @@ static void free_kmem_cache_nodes(struct kmem_cache *s)
 void __kmem_cache_release(struct kmem_cache *s)
 {
 	cache_random_seq_destroy(s);
+	free_percpu(s->sheaf);
 	free_percpu(s->cpu_slab);
 	free_kmem_cache_nodes(s);
 }
@@ -3906,6 +4095,7 @@ void kfree(const void *x)
 		__free_pages(page, compound_order(page));
 		return;
 	}
+	memcg_slab_free_hook(page->slab_cache, &object, 1);
 	slab_free(page->slab_cache, page, object, NULL, 1, _RET_IP_);
 }
 EXPORT_SYMBOL(kfree);
@@ -3983,42 +4173,6 @@ int __kmem_cache_shrink(struct kmem_cache *s)
 	return ret;
 }
 
-#ifdef CONFIG_MEMCG
-static void kmemcg_cache_deact_after_rcu(struct kmem_cache *s)
-{
-	/*
-	 * Called with all the locks held after a sched RCU grace period.
-	 * Even if @s becomes empty after shrinking, we can't know that @s
-	 * doesn't have allocations already in-flight and thus can't
-	 * destroy @s until the associated memcg is released.
-	 *
-	 * However, let's remove the sysfs files for empty caches here.
-	 * Each cache has a lot of interface files which aren't
-	 * particularly useful for empty draining caches; otherwise, we can
-	 * easily end up with millions of unnecessary sysfs files on
-	 * systems which have a lot of memory and transient cgroups.
-	 */
-	if (!__kmem_cache_shrink(s))
-		sysfs_slab_remove(s);
-}
-
-void __kmemcg_cache_deactivate(struct kmem_cache *s)
-{
-	/*
-	 * Disable empty slabs caching. Used to avoid pinning offline
-	 * memory cgroups by kmem pages that can be freed.
-	 */
-	slub_set_cpu_partial(s, 0);
-	s->min_partial = 0;
-
-	/*
-	 * s->cpu_partial is checked locklessly (see put_cpu_partial), so
-	 * we have to make sure the change is visible before shrinking.
-	 */
-	slab_deactivate_memcg_cache_rcu_sched(s, kmemcg_cache_deact_after_rcu);
-}
-#endif
-
 static int slab_mem_going_offline_callback(void *arg)
 {
 	struct kmem_cache *s;
@@ -4173,9 +4327,7 @@ static struct kmem_cache * __init bootstrap(struct kmem_cache *static_cache)
 			p->slab_cache = s;
 #endif
 	}
-	slab_init_memcg_params(s);
 	list_add(&s->list, &slab_caches);
-	memcg_link_cache(s);
 	return s;
 }
 
@@ -4230,7 +4382,7 @@ struct kmem_cache *
 __kmem_cache_alias(const char *name, unsigned int size, unsigned int align,
 		   slab_flags_t flags, void (*ctor)(void *))
 {
-	struct kmem_cache *s, *c;
+	struct kmem_cache *s;
 
 	s = find_mergeable(size, align, flags, name, ctor);
 	if (s) {
@@ -4243,11 +4395,6 @@ __kmem_cache_alias(const char *name, unsigned int size, unsigned int align,
 		s->object_size = max(s->object_size, size);
 		s->inuse = max(s->inuse, ALIGN(size, sizeof(void *)));
 
-		for_each_memcg_cache(c, s) {
-			c->object_size = s->object_size;
-			c->inuse = max(c->inuse, ALIGN(size, sizeof(void *)));
-		}
-
 		if (sysfs_slab_alias(s, name)) {
 			s->refcount--;
 			s = NULL;
@@ -4269,7 +4416,6 @@ int __kmem_cache_create(struct kmem_cache *s, slab_flags_t flags)
 	if (slab_state <= UP)
 		return 0;
 
-	memcg_propagate_slab_attrs(s);
 	err = sysfs_slab_add(s);
 	if (err)
 		__kmem_cache_release(s);
@@ -4730,21 +4876,6 @@ enum slab_stat_type {
 #define SO_OBJECTS	(1 << SL_OBJECTS)
 #define SO_TOTAL	(1 << SL_TOTAL)
 
-#ifdef CONFIG_MEMCG
-static bool memcg_sysfs_enabled = IS_ENABLED(CONFIG_SLUB_MEMCG_SYSFS_ON);
-
-static int __init setup_slub_memcg_sysfs(char *str)
-{
-	int v;
-
-	if (get_option(&str, &v) > 0)
-		memcg_sysfs_enabled = v;
-
-	return 1;
-}
-
-__setup("slub_memcg_sysfs=", setup_slub_memcg_sysfs);
-#endif
 
 static ssize_t show_slab_objects(struct kmem_cache *s,
 			    char *buf, unsigned long flags)
@@ -4973,6 +5104,12 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+static ssize_t sheaf_capacity_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%u\n", s->sheaf_capacity);
+}
+SLAB_ATTR_RO(sheaf_capacity);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -5108,6 +5245,13 @@ static ssize_t sanity_checks_show(struct kmem_cache *s, char *buf)
 static ssize_t sanity_checks_store(struct kmem_cache *s,
 				const char *buf, size_t length)
 {
+	/*
+	 * Objects that the cpu sheaves serve never reach the debug code,
+	 * so a cache with sheaves cannot turn on debugging at runtime.
+	 */
+	if (s->sheaf && buf[0] == '1')
+		return -EINVAL;
+
 	s->flags &= ~SLAB_CONSISTENCY_CHECKS;
 	if (buf[0] == '1') {
 		s->flags &= ~__CMPXCHG_DOUBLE;
@@ -5132,6 +5276,8 @@ static ssize_t trace_store(struct kmem_cache *s, const char *buf,
 	 */
 	if (s->refcount > 1)
 		return -EINVAL;
+	if (s->sheaf && buf[0] == '1')
+		return -EINVAL;
 
 	s->flags &= ~SLAB_TRACE;
 	if (buf[0] == '1') {
@@ -5150,6 +5296,8 @@ static ssize_t red_zone_show(struct kmem_cache *s, char *buf)
 static ssize_t red_zone_store(struct kmem_cache *s,
 				const char *buf, size_t length)
 {
+	if (s->sheaf && buf[0] == '1')
+		return -EINVAL;
 	if (any_slab_objects(s))
 		return -EBUSY;
 
@@ -5170,6 +5318,8 @@ static ssize_t poison_show(struct kmem_cache *s, char *buf)
 static ssize_t poison_store(struct kmem_cache *s,
 				const char *buf, size_t length)
 {
+	if (s->sheaf && buf[0] == '1')
+		return -EINVAL;
 	if (any_slab_objects(s))
 		return -EBUSY;
 
@@ -5190,6 +5340,8 @@ static ssize_t store_user_show(struct kmem_cache *s, char *buf)
 static ssize_t store_user_store(struct kmem_cache *s,
 				const char *buf, size_t length)
 {
+	if (s->sheaf && buf[0] == '1')
+		return -EINVAL;
 	if (any_slab_objects(s))
 		return -EBUSY;
 
@@ -5379,6 +5531,10 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(SHEAF_ALLOC, sheaf_alloc);
+STAT_ATTR(SHEAF_FREE, sheaf_free);
+STAT_ATTR(SHEAF_REFILL, sheaf_refill);
+STAT_ATTR(SHEAF_FLUSH, sheaf_flush);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -5388,6 +5544,7 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+	&sheaf_capacity_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
@@ -5445,6 +5602,10 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&sheaf_alloc_attr.attr,
+	&sheaf_free_attr.attr,
+	&sheaf_refill_attr.attr,
+	&sheaf_flush_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
@@ -5483,7 +5644,6 @@ static ssize_t slab_attr_store(struct kobject *kobj,
 {
 	struct slab_attribute *attribute;
 	struct kmem_cache *s;
-	int err;
 
 	attribute = to_slab_attr(attr);
 	s = to_slab(kobj);
@@ -5491,96 +5651,7 @@ static ssize_t slab_attr_store(struct kobject *kobj,
 	if (!attribute->store)
 		return -EIO;
 
-	err = attribute->store(s, buf, len);
-#ifdef CONFIG_MEMCG
-	if (slab_state >= FULL && err >= 0 && is_root_cache(s)) {
-		struct kmem_cache *c;
-
-		mutex_lock(&slab_mutex);
-		if (s->max_attr_size < len)
-			s->max_attr_size = len;
-
-		/*
-		 * This is a best effort propagation, so this function's return
-		 * value will be determined by the parent cache only. This is
-		 * basically because not all attributes will have a well
-		 * defined semantics for rollbacks - most of the actions will
-		 * have permanent effects.
-		 *
-		 * Returning the error value of any of the children that fail
-		 * is not 100 % defined, in the sense that users seeing the
-		 * error code won't be able to know anything about the state of
-		 * the cache.
-		 *
-		 * Only returning the error code for the parent cache at least
-		 * has well defined semantics. The cache being written to
-		 * directly either failed or succeeded, in which case we loop
-		 * through the descendants with best-effort propagation.
-		 */
-		for_each_memcg_cache(c, s)
-			attribute->store(c, buf, len);
-		mutex_unlock(&slab_mutex);
-	}
-#endif
-	return err;
-}
-
-static void memcg_propagate_slab_attrs(struct kmem_cache *s)
-{
-#ifdef CONFIG_MEMCG
-	int i;
-	char *buffer = NULL;
-	struct kmem_cache *root_cache;
-
-	if (is_root_cache(s))
-		return;
-
-	root_cache = s->memcg_params.root_cache;
-
-	/*
-	 * This mean this cache had no attribute written. Therefore, no point
-	 * in copying default values around
-	 */
-	if (!root_cache->max_attr_size)
-		return;
-
-	for (i = 0; i < ARRAY_SIZE(slab_attrs); i++) {
-		char mbuf[64];
-		char *buf;
-		struct slab_attribute *attr = to_slab_attr(slab_attrs[i]);
-		ssize_t len;
-
-		if (!attr || !attr->store || !attr->show)
-			continue;
-
-		/*
-		 * It is really bad that we have to allocate here, so we will
-		 * do it only as a fallback. If we actually allocate, though,
-		 * we can just use the allocated buffer until the end.
-		 *
-		 * Most of the slub attributes will tend to be very small in
-		 * size, but sysfs allows buffers up to a page, so they can
-		 * theoretically happen.
-		 */
-		if (buffer)
-			buf = buffer;
-		else if (root_cache->max_attr_size < ARRAY_SIZE(mbuf))
-			buf = mbuf;
-		else {
-			buffer = (char *) get_zeroed_page(GFP_KERNEL);
-			if (WARN_ON(!buffer))
-				continue;
-			buf = buffer;
-		}
-
-		len = attr->show(root_cache, buf);
-		if (len > 0)
-			attr->store(s, buf, len);
-	}
-
-	if (buffer)
-		free_page((unsigned long)buffer);
-#endif
+	return attribute->store(s, buf, len);
 }
 
 static void kmem_cache_release(struct kobject *k)
@@ -5615,10 +5686,6 @@ static struct kset *slab_kset;
 
 static inline struct kset *cache_kset(struct kmem_cache *s)
 {
-#ifdef CONFIG_MEMCG
-	if (!is_root_cache(s))
-		return s->memcg_params.root_cache->memcg_kset;
-#endif
 	return slab_kset;
 }
 
@@ -5667,17 +5734,8 @@ static void sysfs_slab_remove_workfn(struct work_struct *work)
 		container_of(work, struct kmem_cache, kobj_remove_work);
 
 	if (!s->kobj.state_in_sysfs)
-		/*
-		 * For a memcg cache, this may be called during
-		 * deactivation and again on shutdown.  Remove only once.
-		 * A cache is never shut down before deactivation is
-		 * complete, so no need to worry about synchronization.
-		 */
 		goto out;
 
-#ifdef CONFIG_MEMCG
-	kset_unregister(s->memcg_kset);
-#endif
 	kobject_uevent(&s->kobj, KOBJ_REMOVE);
 out:
 	kobject_put(&s->kobj);
@@ -5726,16 +5784,6 @@ static int sysfs_slab_add(struct kmem_cache *s)
 	if (err)
 		goto out_del_kobj;
 
-#ifdef CONFIG_MEMCG
-	if (is_root_cache(s) && memcg_sysfs_enabled) {
-		s->memcg_kset = kset_create_and_add("cgroup", NULL, &s->kobj);
-		if (!s->memcg_kset) {
-			err = -ENOMEM;
-			goto out_del_kobj;
-		}
-	}
-#endif
-
 	kobject_uevent(&s->kobj, KOBJ_ADD);
 	if (!unmergeable) {
 		/* Setup first alias */
@@ -5874,6 +5922,8 @@ void get_slabinfo(struct kmem_cache *s, struct slabinfo *sinfo)
 	sinfo->num_objs = nr_objs;
 	sinfo->active_slabs = nr_slabs;
 	sinfo->num_slabs = nr_slabs;
+	sinfo->limit = s->sheaf_capacity;
+	sinfo->batchcount = s->sheaf_capacity / 2;
 	sinfo->objects_per_slab = oo_objects(s->oo);
 	sinfo->cache_order = oo_order(s->oo);
 }
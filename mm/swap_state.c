@@ -21,6 +21,7 @@
 #include <linux/vmalloc.h>
 #include <linux/swap_slots.h>
 #include <linux/huge_mm.h>
+#include <linux/shmem_fs.h>
 
 #include <asm/pgtable.h>
 
@@ -106,15 +107,32 @@ void show_swap_cache_info(void)
 	printk("Total swap = %lukB\n", total_swap_pages << (PAGE_SHIFT - 10));
 }
 
+void *get_shadow_from_swap_cache(swp_entry_t entry)
+{
+	struct address_space *address_space = swap_address_space(entry);
+	struct page *page;
+
+	page = find_get_entry(address_space, swp_offset(entry));
+	if (radix_tree_exceptional_entry(page))
+		return page;
+	if (page)
+		put_page(page);
+	return NULL;
+}
+
 /*
  * __add_to_swap_cache resembles add_to_page_cache_locked on swapper_space,
- * but sets SwapCache flag and private instead of mapping and index.
+ * but sets SwapCache flag and private instead of mapping and index.  A
+ * shadow entry left behind by the previous eviction from the slot is
+ * replaced and returned in @shadowp.
  */
-int __add_to_swap_cache(struct page *page, swp_entry_t entry)
+int __add_to_swap_cache(struct page *page, swp_entry_t entry, void **shadowp)
 {
 	int error, i, nr = hpage_nr_pages(page);
 	struct address_space *address_space;
 	pgoff_t idx = swp_offset(entry);
+	struct radix_tree_node *node;
+	void **slot;
 
 	VM_BUG_ON_PAGE(!PageLocked(page), page);
 	VM_BUG_ON_PAGE(PageSwapCache(page), page);
@@ -127,10 +145,26 @@ int __add_to_swap_cache(struct page *page, swp_entry_t entry)
 	xa_lock_irq(&address_space->i_pages);
 	for (i = 0; i < nr; i++) {
 		set_page_private(page + i, entry.val + i);
-		error = radix_tree_insert(&address_space->i_pages,
-					  idx + i, page + i);
+		error = __radix_tree_create(&address_space->i_pages, idx + i,
+					    0, &node, &slot);
 		if (unlikely(error))
 			break;
+		if (*slot) {
+			void *p;
+
+			p = radix_tree_deref_slot_protected(slot,
+					&address_space->i_pages.xa_lock);
+			if (!radix_tree_exceptional_entry(p)) {
+				error = -EEXIST;
+				break;
+			}
+			address_space->nrexceptional--;
+			if (shadowp)
+				*shadowp = p;
+		}
+		__radix_tree_replace(&address_space->i_pages, node, slot,
+				     page + i,
+				     workingset_lookup_update(address_space));
 	}
 	if (likely(!error)) {
 		address_space->nrpages += nr;
@@ -145,7 +179,11 @@ int __add_to_swap_cache(struct page *page, swp_entry_t entry)
 		VM_BUG_ON(error == -EEXIST);
 		set_page_private(page + i, 0UL);
 		while (i--) {
-			radix_tree_delete(&address_space->i_pages, idx + i);
+			__radix_tree_lookup(&address_space->i_pages, idx + i,
+					    &node, &slot);
+			__radix_tree_replace(&address_space->i_pages, node,
+					slot, NULL,
+					workingset_lookup_update(address_space));
 			set_page_private(page + i, 0UL);
 		}
 		ClearPageSwapCache(page);
@@ -157,13 +195,14 @@ int __add_to_swap_cache(struct page *page, swp_entry_t entry)
 }
 
 
-int add_to_swap_cache(struct page *page, swp_entry_t entry, gfp_t gfp_mask)
+int add_to_swap_cache(struct page *page, swp_entry_t entry, gfp_t gfp_mask,
+		      void **shadowp)
 {
 	int error;
 
 	error = radix_tree_maybe_preload_order(gfp_mask, compound_order(page));
 	if (!error) {
-		error = __add_to_swap_cache(page, entry);
+		error = __add_to_swap_cache(page, entry, shadowp);
 		radix_tree_preload_end();
 	}
 	return error;
@@ -171,9 +210,10 @@ int add_to_swap_cache(struct page *page, swp_entry_t entry, gfp_t gfp_mask)
 
 /*
  * This must be called only on pages that have
- * been verified to be in the swap cache.
+ * been verified to be in the swap cache.  A non-NULL @shadow is left
+ * in the slots of the page to detect a later refault.
  */
-void __delete_from_swap_cache(struct page *page)
+void __delete_from_swap_cache(struct page *page, void *shadow)
 {
 	struct address_space *address_space;
 	int i, nr = hpage_nr_pages(page);
@@ -188,10 +228,20 @@ void __delete_from_swap_cache(struct page *page)
 	address_space = swap_address_space(entry);
 	idx = swp_offset(entry);
 	for (i = 0; i < nr; i++) {
-		radix_tree_delete(&address_space->i_pages, idx + i);
+		struct radix_tree_node *node;
+		void **slot;
+
+		__radix_tree_lookup(&address_space->i_pages, idx + i,
+				    &node, &slot);
+		radix_tree_clear_tags(&address_space->i_pages, node, slot);
+		__radix_tree_replace(&address_space->i_pages, node, slot,
+				     shadow,
+				     workingset_lookup_update(address_space));
 		set_page_private(page + i, 0);
 	}
 	ClearPageSwapCache(page);
+	if (shadow)
+		address_space->nrexceptional += nr;
 	address_space->nrpages -= nr;
 	__mod_node_page_state(page_pgdat(page), NR_FILE_PAGES, -nr);
 	ADD_CACHE_INFO(del_total, nr);
@@ -228,7 +278,7 @@ int add_to_swap(struct page *page)
 	 * Add it to the swap cache.
 	 */
 	err = add_to_swap_cache(page, entry,
-			__GFP_HIGH|__GFP_NOMEMALLOC|__GFP_NOWARN);
+			__GFP_HIGH|__GFP_NOMEMALLOC|__GFP_NOWARN, NULL);
 	/* -ENOMEM radix-tree allocation failure */
 	if (err)
 		/*
@@ -270,13 +320,51 @@ void delete_from_swap_cache(struct page *page)
 
 	address_space = swap_address_space(entry);
 	xa_lock_irq(&address_space->i_pages);
-	__delete_from_swap_cache(page);
+	__delete_from_swap_cache(page, NULL);
 	xa_unlock_irq(&address_space->i_pages);
 
 	put_swap_page(page, entry);
 	page_ref_sub(page, hpage_nr_pages(page));
 }
 
+/*
+ * Drop the shadow entries of a range of swap slots that are being
+ * freed, the refault information is meaningless once the slot can
+ * be reused.
+ */
+void clear_shadow_from_swap_cache(int type, unsigned long begin,
+				  unsigned long end)
+{
+	unsigned long curr = begin, last;
+	struct address_space *address_space;
+	struct radix_tree_node *node;
+	void **slot;
+
+	for (;;) {
+		address_space = swap_address_space(swp_entry(type, curr));
+		last = min(end, curr | (SWAP_ADDRESS_SPACE_PAGES - 1));
+
+		xa_lock_irq(&address_space->i_pages);
+		for (; address_space->nrexceptional && curr <= last; curr++) {
+			void *entry;
+
+			entry = __radix_tree_lookup(&address_space->i_pages,
+						    curr, &node, &slot);
+			if (!radix_tree_exceptional_entry(entry))
+				continue;
+			__radix_tree_replace(&address_space->i_pages, node,
+					slot, NULL,
+					workingset_lookup_update(address_space));
+			address_space->nrexceptional--;
+		}
+		xa_unlock_irq(&address_space->i_pages);
+
+		if (last == end)
+			break;
+		curr = last + 1;
+	}
+}
+
 /* 
  * If we are the only user, then try to free up the swap cache. 
  * 
@@ -380,6 +468,7 @@ struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 {
 	struct page *found_page, *new_page = NULL;
 	struct address_space *swapper_space = swap_address_space(entry);
+	void *shadow = NULL;
 	int err;
 	*new_page_allocated = false;
 
@@ -442,9 +531,13 @@ struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		/* May fail (-ENOMEM) if radix-tree node allocation failed. */
 		__SetPageLocked(new_page);
 		__SetPageSwapBacked(new_page);
-		err = __add_to_swap_cache(new_page, entry);
+		err = __add_to_swap_cache(new_page, entry, &shadow);
 		if (likely(!err)) {
 			radix_tree_preload_end();
+			if (shadow && workingset_refault(new_page, shadow)) {
+				SetPageActive(new_page);
+				workingset_activation(new_page);
+			}
 			/*
 			 * Initiate read into locked page and return.
 			 */
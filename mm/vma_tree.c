@@ -0,0 +1,682 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * mm/vma_tree.c - B-tree index of the VMAs of an address space
+ *
+ * An rbtree of VMAs costs a cache miss per level, each on an otherwise
+ * cold vm_area_struct.  This tree packs the vm_end keys and the free gap
+ * sizes of several VMAs into each node, so find_vma() and the unmapped
+ * area searches touch a few cache lines per level of a tree that is about
+ * three times shallower.
+ *
+ * Leaves hold the VMAs in address order, keyed by vm_end.  Internal nodes
+ * hold, for each child, the largest vm_end and the largest gap below it.
+ * The gap of a VMA is the free space between it and the previous VMA,
+ * stack guard gaps included.  Each VMA points back at its leaf, so writers
+ * locate entries without comparing keys and the mm->mmap list order is
+ * the only order that matters.
+ *
+ * Writers are serialized by mmap_sem held for write, or by page_table_lock
+ * for stack expansion under mmap_sem held for read, which only updates
+ * keys.  Every change is bracketed by mm->vma_tree.seq, nodes are freed by
+ * RCU and a slot only holds NULL or a pointer which was valid when it was
+ * stored, so lookups may also run under rcu_read_lock() and simply retry
+ * when they raced with a writer.
+ *
+ * Insertions allocate from a per-mm pool which vma_tree_preload() tops up
+ * before the callers take i_mmap_rwsem and the anon_vma locks, since
+ * reclaim may need those to unmap pages.
+ */
+
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
+#include <linux/err.h>
+
+#include "internal.h"
+
+#define VMA_TREE_SLOTS		9
+#define VMA_TREE_MIN_SLOTS	(VMA_TREE_SLOTS / 2)
+
+struct vma_tree_node {
+	union {
+		struct vma_tree_node *parent;	/* NULL for the root */
+		struct rcu_head rcu;
+	};
+	unsigned char level;			/* 0 for leaves */
+	unsigned char nr;			/* slots in use */
+	unsigned long end[VMA_TREE_SLOTS];
+	unsigned long gap[VMA_TREE_SLOTS];
+	void *slot[VMA_TREE_SLOTS];
+};
+
+static struct kmem_cache *vma_tree_node_cachep __read_mostly;
+
+void __init vma_tree_cache_init(void)
+{
+	vma_tree_node_cachep = KMEM_CACHE(vma_tree_node,
+				SLAB_HWCACHE_ALIGN | SLAB_PANIC | SLAB_ACCOUNT);
+}
+
+void vma_tree_init(struct mm_struct *mm)
+{
+	mm->vma_tree.root = NULL;
+	seqcount_init(&mm->vma_tree.seq);
+	mm->vma_tree.spare = NULL;
+	mm->vma_tree.nr_spare = 0;
+}
+
+static inline unsigned int vma_tree_height(struct vma_tree *t)
+{
+	return t->root ? t->root->level + 1 : 0;
+}
+
+/*
+ * Make sure the next vma_tree_insert() finds enough nodes in the pool to
+ * split every level and add a new root.  Called with mmap_sem held for
+ * write and no other mm locks, so the allocation may sleep.
+ */
+void vma_tree_preload(struct mm_struct *mm)
+{
+	struct vma_tree *t = &mm->vma_tree;
+	struct vma_tree_node *node;
+
+	while (t->nr_spare <= vma_tree_height(t)) {
+		/* Small, and just like the vma itself not worth failing over */
+		node = kmem_cache_alloc(vma_tree_node_cachep,
+					GFP_KERNEL | __GFP_NOFAIL);
+		node->parent = t->spare;
+		t->spare = node;
+		t->nr_spare++;
+	}
+}
+
+static struct vma_tree_node *vma_tree_spare(struct vma_tree *t,
+					    unsigned int level)
+{
+	struct vma_tree_node *node = t->spare;
+
+	BUG_ON(!node);
+	t->spare = node->parent;
+	t->nr_spare--;
+	memset(node, 0, sizeof(*node));
+	node->level = level;
+	return node;
+}
+
+static void vma_tree_node_free_rcu(struct rcu_head *head)
+{
+	kmem_cache_free(vma_tree_node_cachep,
+			container_of(head, struct vma_tree_node, rcu));
+}
+
+static inline void vma_tree_node_free(struct vma_tree_node *node)
+{
+	call_rcu(&node->rcu, vma_tree_node_free_rcu);
+}
+
+static inline void vma_tree_write_begin(struct vma_tree *t)
+{
+	preempt_disable();
+	write_seqcount_begin(&t->seq);
+}
+
+static inline void vma_tree_write_end(struct vma_tree *t)
+{
+	write_seqcount_end(&t->seq);
+	preempt_enable();
+}
+
+/* Free space below the vma, including the stack guard gaps */
+static inline unsigned long vma_tree_gap(struct vm_area_struct *vma)
+{
+	unsigned long gap = vm_start_gap(vma);
+
+	if (vma->vm_prev) {
+		unsigned long prev_end = vm_end_gap(vma->vm_prev);
+
+		gap = gap > prev_end ? gap - prev_end : 0;
+	}
+	return gap;
+}
+
+static inline unsigned long node_end(struct vma_tree_node *node)
+{
+	return node->end[node->nr - 1];
+}
+
+static unsigned long node_max_gap(struct vma_tree_node *node)
+{
+	unsigned long max = 0;
+	unsigned int i;
+
+	for (i = 0; i < node->nr; i++)
+		if (node->gap[i] > max)
+			max = node->gap[i];
+	return max;
+}
+
+static unsigned int node_index(struct vma_tree_node *node, void *entry)
+{
+	unsigned int i;
+
+	for (i = 0; i < node->nr; i++)
+		if (node->slot[i] == entry)
+			return i;
+	BUG();
+}
+
+/*
+ * Publish @entry in @node.  The release orders the initialization of a
+ * new child node before lockless readers can find it.
+ */
+static inline void node_set_slot(struct vma_tree_node *node, unsigned int i,
+				 void *entry)
+{
+	smp_store_release(&node->slot[i], entry);
+}
+
+static void node_set_summary(struct vma_tree_node *parent, unsigned int i,
+			     struct vma_tree_node *child)
+{
+	WRITE_ONCE(parent->end[i], node_end(child));
+	parent->gap[i] = node_max_gap(child);
+}
+
+static void node_insert(struct vma_tree_node *node, unsigned int idx,
+			void *entry, unsigned long end, unsigned long gap)
+{
+	unsigned int i;
+
+	for (i = node->nr; i > idx; i--) {
+		WRITE_ONCE(node->end[i], node->end[i - 1]);
+		node->gap[i] = node->gap[i - 1];
+		node_set_slot(node, i, node->slot[i - 1]);
+	}
+	WRITE_ONCE(node->end[idx], end);
+	node->gap[idx] = gap;
+	node_set_slot(node, idx, entry);
+	WRITE_ONCE(node->nr, node->nr + 1);
+
+	if (node->level)
+		((struct vma_tree_node *)entry)->parent = node;
+	else
+		((struct vm_area_struct *)entry)->vm_tree_leaf = node;
+}
+
+static void node_remove(struct vma_tree_node *node, unsigned int idx)
+{
+	unsigned int i;
+
+	for (i = idx; i + 1 < node->nr; i++) {
+		WRITE_ONCE(node->end[i], node->end[i + 1]);
+		node->gap[i] = node->gap[i + 1];
+		node_set_slot(node, i, node->slot[i + 1]);
+	}
+	WRITE_ONCE(node->slot[node->nr - 1], NULL);
+	WRITE_ONCE(node->nr, node->nr - 1);
+}
+
+/* Refresh the summaries above @node, stopping once nothing changes */
+static void vma_tree_propagate(struct vma_tree_node *node)
+{
+	struct vma_tree_node *parent;
+
+	while ((parent = node->parent)) {
+		unsigned int i = node_index(parent, node);
+
+		if (parent->end[i] == node_end(node) &&
+		    parent->gap[i] == node_max_gap(node))
+			break;
+		node_set_summary(parent, i, node);
+		node = parent;
+	}
+}
+
+/* Insert @entry at @idx of @node, splitting full nodes on the way up */
+static void vma_tree_insert_slot(struct vma_tree *t, struct vma_tree_node *node,
+				 unsigned int idx, void *entry,
+				 unsigned long end, unsigned long gap)
+{
+	for (;;) {
+		struct vma_tree_node *right, *parent;
+		unsigned int keep, i;
+		bool left;
+
+		if (node->nr < VMA_TREE_SLOTS) {
+			node_insert(node, idx, entry, end, gap);
+			vma_tree_propagate(node);
+			return;
+		}
+
+		/* Split evenly, counting the entry to be inserted */
+		left = idx <= VMA_TREE_SLOTS / 2;
+		keep = VMA_TREE_SLOTS / 2 + !left;
+		right = vma_tree_spare(t, node->level);
+		for (i = keep; i < VMA_TREE_SLOTS; i++)
+			node_insert(right, i - keep, node->slot[i],
+				    node->end[i], node->gap[i]);
+		for (i = keep; i < VMA_TREE_SLOTS; i++)
+			WRITE_ONCE(node->slot[i], NULL);
+		WRITE_ONCE(node->nr, keep);
+
+		if (left)
+			node_insert(node, idx, entry, end, gap);
+		else
+			node_insert(right, idx - keep, entry, end, gap);
+
+		parent = node->parent;
+		if (!parent) {
+			parent = vma_tree_spare(t, node->level + 1);
+			node_insert(parent, 0, node, node_end(node),
+				    node_max_gap(node));
+			node_insert(parent, 1, right, node_end(right),
+				    node_max_gap(right));
+			smp_store_release(&t->root, parent);
+			return;
+		}
+
+		i = node_index(parent, node);
+		node_set_summary(parent, i, node);
+		node = parent;
+		idx = i + 1;
+		entry = right;
+		end = node_end(right);
+		gap = node_max_gap(right);
+	}
+}
+
+/*
+ * Add @vma, which must already be on the mm->mmap list, right after its
+ * vm_prev.  The caller must have called vma_tree_preload().
+ */
+void vma_tree_insert(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+	struct vma_tree *t = &mm->vma_tree;
+	struct vma_tree_node *leaf;
+	unsigned int idx = 0;
+
+	vma_tree_write_begin(t);
+	if (!t->root) {
+		leaf = vma_tree_spare(t, 0);
+		node_insert(leaf, 0, vma, vma->vm_end, vma_tree_gap(vma));
+		smp_store_release(&t->root, leaf);
+		goto out;
+	}
+
+	if (vma->vm_prev) {
+		leaf = vma->vm_prev->vm_tree_leaf;
+		idx = node_index(leaf, vma->vm_prev) + 1;
+	} else {
+		for (leaf = t->root; leaf->level; leaf = leaf->slot[0])
+			;
+	}
+	vma_tree_insert_slot(t, leaf, idx, vma, vma->vm_end, vma_tree_gap(vma));
+out:
+	vma_tree_write_end(t);
+}
+
+/* Restore the minimum fill of @node after an entry was removed from it */
+static void vma_tree_rebalance(struct vma_tree *t, struct vma_tree_node *node)
+{
+	for (;;) {
+		struct vma_tree_node *parent = node->parent;
+		struct vma_tree_node *left, *right;
+		unsigned int i;
+
+		if (!parent) {
+			if (!node->nr) {
+				WRITE_ONCE(t->root, NULL);
+				vma_tree_node_free(node);
+			} else if (node->level && node->nr == 1) {
+				struct vma_tree_node *child = node->slot[0];
+
+				child->parent = NULL;
+				WRITE_ONCE(t->root, child);
+				vma_tree_node_free(node);
+			}
+			return;
+		}
+
+		if (node->nr >= VMA_TREE_MIN_SLOTS) {
+			vma_tree_propagate(node);
+			return;
+		}
+
+		i = node_index(parent, node);
+		if (i + 1 < parent->nr) {
+			left = node;
+			right = parent->slot[i + 1];
+		} else {
+			left = parent->slot[--i];
+			right = node;
+		}
+
+		if (left->nr + right->nr <= VMA_TREE_SLOTS) {
+			unsigned int j;
+
+			for (j = 0; j < right->nr; j++)
+				node_insert(left, left->nr, right->slot[j],
+					    right->end[j], right->gap[j]);
+			node_set_summary(parent, i, left);
+			node_remove(parent, i + 1);
+			vma_tree_node_free(right);
+			node = parent;
+			continue;
+		}
+
+		/* The sibling has entries to spare, borrow one */
+		if (left == node) {
+			node_insert(left, left->nr, right->slot[0],
+				    right->end[0], right->gap[0]);
+			node_remove(right, 0);
+		} else {
+			unsigned int last = left->nr - 1;
+
+			node_insert(right, 0, left->slot[last],
+				    left->end[last], left->gap[last]);
+			node_remove(left, last);
+		}
+		node_set_summary(parent, i, left);
+		node_set_summary(parent, i + 1, right);
+		vma_tree_propagate(parent);
+		return;
+	}
+}
+
+void vma_tree_erase(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+	struct vma_tree *t = &mm->vma_tree;
+	struct vma_tree_node *leaf = vma->vm_tree_leaf;
+
+	if (!leaf)
+		return;
+
+	vma_tree_write_begin(t);
+	node_remove(leaf, node_index(leaf, vma));
+	vma->vm_tree_leaf = NULL;
+	vma_tree_rebalance(t, leaf);
+	vma_tree_write_end(t);
+}
+
+/*
+ * Refresh the key and gap of @vma after its boundaries, or those of its
+ * vm_prev, changed.  Does nothing if @vma is not in the tree yet.
+ */
+void vma_tree_update(struct mm_struct *mm, struct vm_area_struct *vma)
+{
+	struct vma_tree *t = &mm->vma_tree;
+	struct vma_tree_node *leaf = vma->vm_tree_leaf;
+	unsigned int i;
+
+	if (!leaf)
+		return;
+
+	vma_tree_write_begin(t);
+	i = node_index(leaf, vma);
+	WRITE_ONCE(leaf->end[i], vma->vm_end);
+	leaf->gap[i] = vma_tree_gap(vma);
+	vma_tree_propagate(leaf);
+	vma_tree_write_end(t);
+}
+
+/* Free all nodes, the mm is going away and nobody can look it up anymore */
+void vma_tree_destroy(struct mm_struct *mm)
+{
+	struct vma_tree *t = &mm->vma_tree;
+	struct vma_tree_node *node = t->root, *parent;
+
+	while (node) {
+		if (node->level && node->nr) {
+			node = node->slot[--node->nr];
+			continue;
+		}
+		parent = node->parent;
+		kmem_cache_free(vma_tree_node_cachep, node);
+		node = parent;
+	}
+	t->root = NULL;
+
+	while ((node = t->spare)) {
+		t->spare = node->parent;
+		kmem_cache_free(vma_tree_node_cachep, node);
+	}
+	t->nr_spare = 0;
+}
+
+/*
+ * Look up the first VMA which satisfies addr < vm_end, NULL if none.
+ *
+ * Callers hold mmap_sem, or rcu_read_lock() and then must validate the
+ * VMA under its own lock, as it may be detached by the time it is used.
+ */
+struct vm_area_struct *vma_tree_find(struct mm_struct *mm, unsigned long addr)
+{
+	struct vma_tree *t = &mm->vma_tree;
+	struct vma_tree_node *node;
+	unsigned int seq, i, nr;
+	void *entry;
+
+	do {
+		seq = read_seqcount_begin(&t->seq);
+		entry = NULL;
+		node = READ_ONCE(t->root);
+		while (node) {
+			nr = min_t(unsigned int, READ_ONCE(node->nr),
+				   VMA_TREE_SLOTS);
+			for (i = 0; i < nr; i++)
+				if (READ_ONCE(node->end[i]) > addr)
+					break;
+			if (i == nr) {
+				entry = NULL;
+				break;
+			}
+			entry = READ_ONCE(node->slot[i]);
+			if (!node->level || !entry)
+				break;
+			/* A stale child from a racing split or merge */
+			if (((struct vma_tree_node *)entry)->level !=
+			    node->level - 1) {
+				entry = NULL;
+				break;
+			}
+			node = entry;
+		}
+	} while (read_seqcount_retry(&t->seq, seq));
+
+	return entry;
+}
+
+/* The VMA with the highest vm_end, NULL if none.  Called under mmap_sem. */
+struct vm_area_struct *vma_tree_last(struct mm_struct *mm)
+{
+	struct vma_tree_node *node = mm->vma_tree.root;
+
+	while (node && node->nr) {
+		if (!node->level)
+			return node->slot[node->nr - 1];
+		node = node->slot[node->nr - 1];
+	}
+	return NULL;
+}
+
+/*
+ * The gap searches below return the VMA following the lowest (highest)
+ * gap of at least @length which ends at or above @low_limit and starts at
+ * or below @high_limit, NULL if there is none below the highest VMA, or
+ * ERR_PTR(-ENOMEM) when the bottom-up search can stop looking.
+ *
+ * Both run with mmap_sem held, so they walk the tree without retrying.
+ */
+struct vm_area_struct *vma_tree_find_gap(struct mm_struct *mm,
+		unsigned long length, unsigned long low_limit,
+		unsigned long high_limit)
+{
+	struct vma_tree_node *node = mm->vma_tree.root;
+	unsigned long lo = 0;	/* end of everything left of slot i */
+	unsigned int i = 0;
+
+	while (node) {
+		if (i == node->nr) {
+			struct vma_tree_node *parent = node->parent;
+
+			if (!parent)
+				break;
+			i = node_index(parent, node);
+			lo = parent->end[i++];
+			node = parent;
+			continue;
+		}
+
+		if (lo > high_limit)
+			return ERR_PTR(-ENOMEM);
+
+		if (node->gap[i] >= length && node->end[i] > low_limit) {
+			struct vm_area_struct *vma;
+			unsigned long gap_start, gap_end;
+
+			if (node->level) {
+				node = node->slot[i];
+				i = 0;
+				continue;
+			}
+
+			vma = node->slot[i];
+			gap_start = vma->vm_prev ? vm_end_gap(vma->vm_prev) : 0;
+			if (gap_start > high_limit)
+				return ERR_PTR(-ENOMEM);
+			gap_end = vm_start_gap(vma);
+			if (gap_end >= low_limit && gap_end > gap_start &&
+			    gap_end - gap_start >= length)
+				return vma;
+		}
+		lo = node->end[i++];
+	}
+	return NULL;
+}
+
+struct vm_area_struct *vma_tree_find_gap_topdown(struct mm_struct *mm,
+		unsigned long length, unsigned long low_limit,
+		unsigned long high_limit)
+{
+	struct vma_tree_node *node = mm->vma_tree.root;
+	/* lower bound of the gaps below each level's current node */
+	unsigned long node_lo[BITS_PER_LONG];
+	int i;
+
+	if (!node)
+		return NULL;
+	node_lo[node->level] = 0;
+	i = node->nr - 1;
+
+	for (;;) {
+		unsigned long lo;
+
+		if (i < 0) {
+			struct vma_tree_node *parent = node->parent;
+
+			if (!parent)
+				return NULL;
+			i = (int)node_index(parent, node) - 1;
+			node = parent;
+			continue;
+		}
+
+		if (node->end[i] <= low_limit)
+			return NULL;
+
+		lo = i ? node->end[i - 1] : node_lo[node->level];
+		if (node->gap[i] >= length && lo <= high_limit) {
+			struct vm_area_struct *vma;
+			unsigned long gap_start, gap_end;
+
+			if (node->level) {
+				node = node->slot[i];
+				node_lo[node->level] = lo;
+				i = node->nr - 1;
+				continue;
+			}
+
+			vma = node->slot[i];
+			gap_end = vm_start_gap(vma);
+			if (gap_end < low_limit)
+				return NULL;
+			gap_start = vma->vm_prev ? vm_end_gap(vma->vm_prev) : 0;
+			if (gap_start <= high_limit && gap_end > gap_start &&
+			    gap_end - gap_start >= length)
+				return vma;
+		}
+		i--;
+	}
+}
+
+#ifdef CONFIG_DEBUG_VM_RB
+/*
+ * Check the tree against the mm->mmap list.  Returns the number of VMAs
+ * found in the tree, or -1 if it is inconsistent.
+ */
+int vma_tree_validate(struct mm_struct *mm)
+{
+	struct vma_tree_node *node = mm->vma_tree.root;
+	struct vm_area_struct *vma = mm->mmap;
+	int i = 0, count = 0, bug = 0;
+
+	while (node) {
+		if (i == node->nr) {
+			struct vma_tree_node *parent = node->parent;
+
+			if (!parent)
+				break;
+			i = node_index(parent, node);
+			if (parent->end[i] != node_end(node) ||
+			    parent->gap[i] != node_max_gap(node)) {
+				pr_emerg("vma_tree: stale summary at level %d\n",
+					 parent->level);
+				bug = 1;
+			}
+			node = parent;
+			i++;
+			continue;
+		}
+
+		if (node->parent && i == 0 && node->nr < VMA_TREE_MIN_SLOTS) {
+			pr_emerg("vma_tree: underfull node %d\n", node->nr);
+			bug = 1;
+		}
+
+		if (node->level) {
+			struct vma_tree_node *child = node->slot[i];
+
+			if (child->parent != node ||
+			    child->level != node->level - 1) {
+				pr_emerg("vma_tree: bad child at level %d\n",
+					 node->level);
+				bug = 1;
+			}
+			node = child;
+			i = 0;
+			continue;
+		}
+
+		if (node->slot[i] != vma) {
+			pr_emerg("vma_tree: vma %px found, %px expected\n",
+				 node->slot[i], vma);
+			return -1;
+		}
+		if (vma->vm_tree_leaf != node ||
+		    node->end[i] != vma->vm_end ||
+		    node->gap[i] != vma_tree_gap(vma)) {
+			pr_emerg("vma_tree: stale entry for vma %px\n", vma);
+			bug = 1;
+		}
+		vma = vma->vm_next;
+		count++;
+		i++;
+	}
+	if (vma) {
+		pr_emerg("vma_tree: vma %px missing\n", vma);
+		bug = 1;
+	}
+	return bug ? -1 : count;
+}
+#endif
@@ -0,0 +1,375 @@
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/sched/mm.h>
+#include <linux/rbtree_augmented.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/err.h>
+#include <linux/security.h>
+#include <linux/slab.h>
+
+#include "internal.h"
+
+#define VMA_TREE_BENCHMARK	_IOWR('v', 1, struct vma_tree_benchmark)
+
+struct vma_tree_benchmark {
+	__u64 nr_lookups;
+	__u64 gap_length;
+	__u64 find_rb_usec;
+	__u64 find_tree_usec;
+	__u64 gap_rb_usec;
+	__u64 gap_tree_usec;
+	__u32 map_count;
+	__u32 mismatches;
+};
+
+/*
+ * The reference: an rbtree of the VMAs augmented with the largest gap in
+ * each subtree, the way the VMAs were indexed before the B-tree, built
+ * over a snapshot of the calling process's VMAs.
+ */
+struct vtb_node {
+	struct rb_node rb;
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long gap_start;	/* vm_end_gap() of the previous VMA */
+	unsigned long gap_end;		/* vm_start_gap() of this VMA */
+	unsigned long subtree_gap;
+	struct vm_area_struct *vma;
+};
+
+static inline struct vtb_node *vtb_entry(struct rb_node *rb)
+{
+	return rb ? rb_entry(rb, struct vtb_node, rb) : NULL;
+}
+
+static unsigned long vtb_compute_subtree_gap(struct vtb_node *node)
+{
+	unsigned long max = node->gap_end > node->gap_start ?
+			    node->gap_end - node->gap_start : 0;
+
+	if (node->rb.rb_left)
+		max = max(max, vtb_entry(node->rb.rb_left)->subtree_gap);
+	if (node->rb.rb_right)
+		max = max(max, vtb_entry(node->rb.rb_right)->subtree_gap);
+	return max;
+}
+
+RB_DECLARE_CALLBACKS(static, vtb_gap_callbacks, struct vtb_node, rb,
+		     unsigned long, subtree_gap, vtb_compute_subtree_gap)
+
+/* Called with mmap_sem held, the VMAs are added in address order */
+static struct vtb_node *vtb_build(struct mm_struct *mm, struct rb_root *root)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct vm_area_struct *vma;
+	struct vtb_node *nodes, *node;
+
+	nodes = kvmalloc_array(max(mm->map_count, 1), sizeof(*nodes),
+			       GFP_KERNEL);
+	if (!nodes)
+		return NULL;
+
+	node = nodes;
+	for (vma = mm->mmap; vma; vma = vma->vm_next, node++) {
+		node->vm_start = vma->vm_start;
+		node->vm_end = vma->vm_end;
+		node->gap_start = vma->vm_prev ? vm_end_gap(vma->vm_prev) : 0;
+		node->gap_end = vm_start_gap(vma);
+		node->vma = vma;
+
+		rb_link_node(&node->rb, parent, link);
+		node->subtree_gap = 0;
+		vtb_gap_callbacks_propagate(&node->rb, NULL);
+		rb_insert_augmented(&node->rb, root, &vtb_gap_callbacks);
+
+		/* The next VMA goes right of the rightmost node */
+		parent = &node->rb;
+		link = &node->rb.rb_right;
+		while (*link) {
+			parent = *link;
+			link = &parent->rb_right;
+		}
+	}
+	return nodes;
+}
+
+static struct vm_area_struct *vtb_find(struct rb_root *root,
+				       unsigned long addr)
+{
+	struct rb_node *rb = root->rb_node;
+	struct vtb_node *found = NULL;
+
+	while (rb) {
+		struct vtb_node *node = vtb_entry(rb);
+
+		if (node->vm_end > addr) {
+			found = node;
+			if (node->vm_start <= addr)
+				break;
+			rb = rb->rb_left;
+		} else
+			rb = rb->rb_right;
+	}
+	return found ? found->vma : NULL;
+}
+
+/* The gap searches as unmapped_area() used to run them on the rbtree */
+static struct vm_area_struct *vtb_find_gap(struct rb_root *root,
+		unsigned long length, unsigned long low_limit,
+		unsigned long high_limit)
+{
+	struct vtb_node *node;
+	unsigned long gap_start, gap_end;
+
+	node = vtb_entry(root->rb_node);
+	if (!node || node->subtree_gap < length)
+		return NULL;
+
+	while (true) {
+		/* Visit left subtree if it looks promising */
+		gap_end = node->gap_end;
+		if (gap_end >= low_limit && node->rb.rb_left) {
+			struct vtb_node *left = vtb_entry(node->rb.rb_left);
+
+			if (left->subtree_gap >= length) {
+				node = left;
+				continue;
+			}
+		}
+
+		gap_start = node->gap_start;
+check_current:
+		/* Check if current node has a suitable gap */
+		if (gap_start > high_limit)
+			return ERR_PTR(-ENOMEM);
+		if (gap_end >= low_limit &&
+		    gap_end > gap_start && gap_end - gap_start >= length)
+			return node->vma;
+
+		/* Visit right subtree if it looks promising */
+		if (node->rb.rb_right) {
+			struct vtb_node *right = vtb_entry(node->rb.rb_right);
+
+			if (right->subtree_gap >= length) {
+				node = right;
+				continue;
+			}
+		}
+
+		/* Go back up the rbtree to find next candidate node */
+		while (true) {
+			struct rb_node *prev = &node->rb;
+
+			if (!rb_parent(prev))
+				return NULL;
+			node = vtb_entry(rb_parent(prev));
+			if (prev == node->rb.rb_left) {
+				gap_start = node->gap_start;
+				gap_end = node->gap_end;
+				goto check_current;
+			}
+		}
+	}
+}
+
+static struct vm_area_struct *vtb_find_gap_topdown(struct rb_root *root,
+		unsigned long length, unsigned long low_limit,
+		unsigned long high_limit)
+{
+	struct vtb_node *node;
+	unsigned long gap_start, gap_end;
+
+	node = vtb_entry(root->rb_node);
+	if (!node || node->subtree_gap < length)
+		return NULL;
+
+	while (true) {
+		/* Visit right subtree if it looks promising */
+		gap_start = node->gap_start;
+		if (gap_start <= high_limit && node->rb.rb_right) {
+			struct vtb_node *right = vtb_entry(node->rb.rb_right);
+
+			if (right->subtree_gap >= length) {
+				node = right;
+				continue;
+			}
+		}
+
+check_current:
+		/* Check if current node has a suitable gap */
+		gap_end = node->gap_end;
+		if (gap_end < low_limit)
+			return NULL;
+		if (gap_start <= high_limit &&
+		    gap_end > gap_start && gap_end - gap_start >= length)
+			return node->vma;
+
+		/* Visit left subtree if it looks promising */
+		if (node->rb.rb_left) {
+			struct vtb_node *left = vtb_entry(node->rb.rb_left);
+
+			if (left->subtree_gap >= length) {
+				node = left;
+				continue;
+			}
+		}
+
+		/* Go back up the rbtree to find next candidate node */
+		while (true) {
+			struct rb_node *prev = &node->rb;
+
+			if (!rb_parent(prev))
+				return NULL;
+			node = vtb_entry(rb_parent(prev));
+			if (prev == node->rb.rb_right) {
+				gap_start = node->gap_start;
+				goto check_current;
+			}
+		}
+	}
+}
+
+/* The same pseudo random sequence of addresses for both trees */
+static unsigned long next_addr(u64 *state, unsigned long start,
+			       unsigned long span)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return start + (*state % span);
+}
+
+/*
+ * The searches may give up at different points once there is no gap left,
+ * both ways of failing end up as -ENOMEM in unmapped_area().
+ */
+static struct vm_area_struct *gap_result(struct mm_struct *mm,
+		struct vm_area_struct *vma, unsigned long high_limit)
+{
+	if (!vma && mm->highest_vm_end > high_limit)
+		return ERR_PTR(-ENOMEM);
+	return vma;
+}
+
+static int __vma_tree_benchmark_ioctl(struct mm_struct *mm,
+		struct vma_tree_benchmark *vtb)
+{
+	unsigned long start, span, length, low_limit, high_limit;
+	struct vm_area_struct *rb, *tree;
+	struct rb_root root = RB_ROOT;
+	struct vtb_node *nodes;
+	ktime_t start_time;
+	u64 i, state;
+
+	length = PAGE_ALIGN(vtb->gap_length ? : PAGE_SIZE);
+	if (length > TASK_SIZE - mmap_min_addr)
+		return -EINVAL;
+	low_limit = mmap_min_addr + length;
+	high_limit = TASK_SIZE - length;
+
+	if (down_read_killable(&mm->mmap_sem))
+		return -EINTR;
+
+	nodes = vtb_build(mm, &root);
+	if (!nodes) {
+		up_read(&mm->mmap_sem);
+		return -ENOMEM;
+	}
+
+	vtb->map_count = mm->map_count;
+	vtb->mismatches = 0;
+	start = mm->mmap ? mm->mmap->vm_start : 0;
+	span = max(mm->highest_vm_end - start, 1UL);
+
+	state = 0x2545f4914f6cdd1dULL;
+	start_time = ktime_get();
+	for (i = 0; i < vtb->nr_lookups; i++)
+		vtb_find(&root, next_addr(&state, start, span));
+	vtb->find_rb_usec = ktime_us_delta(ktime_get(), start_time);
+
+	state = 0x2545f4914f6cdd1dULL;
+	start_time = ktime_get();
+	for (i = 0; i < vtb->nr_lookups; i++)
+		vma_tree_find(mm, next_addr(&state, start, span));
+	vtb->find_tree_usec = ktime_us_delta(ktime_get(), start_time);
+
+	start_time = ktime_get();
+	for (i = 0; i < vtb->nr_lookups; i++) {
+		vtb_find_gap(&root, length, low_limit, high_limit);
+		vtb_find_gap_topdown(&root, length, low_limit, high_limit);
+	}
+	vtb->gap_rb_usec = ktime_us_delta(ktime_get(), start_time);
+
+	start_time = ktime_get();
+	for (i = 0; i < vtb->nr_lookups; i++) {
+		vma_tree_find_gap(mm, length, low_limit, high_limit);
+		vma_tree_find_gap_topdown(mm, length, low_limit, high_limit);
+	}
+	vtb->gap_tree_usec = ktime_us_delta(ktime_get(), start_time);
+
+	/* Both must agree, check a sample outside of the timed loops */
+	state = 0x2545f4914f6cdd1dULL;
+	for (i = 0; i < min_t(u64, vtb->nr_lookups, 4096); i++) {
+		unsigned long addr = next_addr(&state, start, span);
+
+		if (vtb_find(&root, addr) != vma_tree_find(mm, addr))
+			vtb->mismatches++;
+	}
+	rb = gap_result(mm, vtb_find_gap(&root, length, low_limit, high_limit),
+			high_limit);
+	tree = gap_result(mm, vma_tree_find_gap(mm, length, low_limit,
+						high_limit), high_limit);
+	if (rb != tree)
+		vtb->mismatches++;
+	rb = vtb_find_gap_topdown(&root, length, low_limit, high_limit);
+	tree = vma_tree_find_gap_topdown(mm, length, low_limit, high_limit);
+	if (rb != tree)
+		vtb->mismatches++;
+
+	up_read(&mm->mmap_sem);
+	kvfree(nodes);
+	return 0;
+}
+
+static long vma_tree_benchmark_ioctl(struct file *filep, unsigned int cmd,
+		unsigned long arg)
+{
+	struct vma_tree_benchmark vtb;
+	int ret;
+
+	if (cmd != VMA_TREE_BENCHMARK)
+		return -EINVAL;
+
+	if (copy_from_user(&vtb, (void __user *)arg, sizeof(vtb)))
+		return -EFAULT;
+
+	ret = __vma_tree_benchmark_ioctl(current->mm, &vtb);
+	if (ret)
+		return ret;
+
+	if (copy_to_user((void __user *)arg, &vtb, sizeof(vtb)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static const struct file_operations vma_tree_benchmark_fops = {
+	.open = nonseekable_open,
+	.unlocked_ioctl = vma_tree_benchmark_ioctl,
+};
+
+static int vma_tree_benchmark_init(void)
+{
+	void *ret;
+
+	ret = debugfs_create_file_unsafe("vma_tree_benchmark", 0600, NULL,
+			NULL, &vma_tree_benchmark_fops);
+	if (!ret)
+		pr_warn("Failed to create vma_tree_benchmark in debugfs");
+
+	return 0;
+}
+
+late_initcall(vma_tree_benchmark_init);
@@ -22,7 +22,7 @@
 #include <linux/kallsyms.h>
 #include <linux/list.h>
 #include <linux/notifier.h>
-#include <linux/rbtree.h>
+#include <linux/rbtree_augmented.h>
 #include <linux/radix-tree.h>
 #include <linux/rcupdate.h>
 #include <linux/pfn.h>
@@ -33,6 +33,8 @@
 #include <linux/bitops.h>
 
 #include <linux/uaccess.h>
+#include <linux/hugetlb.h>
+#include <linux/io.h>
 #include <asm/tlbflush.h>
 #include <asm/shmparam.h>
 
@@ -46,6 +48,41 @@ static DEFINE_PER_CPU(struct vfree_deferred, vfree_deferred);
 
 static void __vunmap(const void *, int);
 
+#ifdef CONFIG_HUGE_VMALLOC
+static bool __ro_after_init vmap_allow_huge = true;
+
+static int __init set_nohugevmalloc(char *str)
+{
+	vmap_allow_huge = false;
+	return 0;
+}
+early_param("nohugevmalloc", set_nohugevmalloc);
+
+static inline unsigned int vm_area_page_order(struct vm_struct *vm)
+{
+	return vm->page_order;
+}
+
+static inline void set_vm_area_page_order(struct vm_struct *vm,
+					  unsigned int order)
+{
+	vm->page_order = order;
+}
+#else
+static const bool vmap_allow_huge = false;
+
+static inline unsigned int vm_area_page_order(struct vm_struct *vm)
+{
+	return 0;
+}
+
+static inline void set_vm_area_page_order(struct vm_struct *vm,
+					  unsigned int order)
+{
+	BUG_ON(order != 0);
+}
+#endif
+
 static void free_work(struct work_struct *w)
 {
 	struct vfree_deferred *p = container_of(w, struct vfree_deferred, wq);
@@ -157,8 +194,27 @@ static int vmap_pte_range(pmd_t *pmd, unsigned long addr,
 	return 0;
 }
 
+/*
+ * Map [addr, end) with a single huge pmd if it covers the whole pmd and the
+ * pages backing it are physically contiguous and aligned.  The latter holds
+ * for areas whose pages were allocated PMD_SHIFT at a time.
+ */
+static int vmap_try_huge_pmd(pmd_t *pmd, unsigned long addr,
+		unsigned long end, pgprot_t prot, struct page *page)
+{
+	if (end - addr != PMD_SIZE)
+		return 0;
+	if (!IS_ALIGNED(page_to_pfn(page), PMD_SIZE >> PAGE_SHIFT))
+		return 0;
+	/* a pte table left behind by an earlier mapping */
+	if (pmd_present(*pmd) && !pmd_free_pte_page(pmd, addr))
+		return 0;
+	return pmd_set_huge(pmd, page_to_phys(page), prot);
+}
+
 static int vmap_pmd_range(pud_t *pud, unsigned long addr,
-		unsigned long end, pgprot_t prot, struct page **pages, int *nr)
+		unsigned long end, pgprot_t prot, struct page **pages, int *nr,
+		unsigned int page_shift)
 {
 	pmd_t *pmd;
 	unsigned long next;
@@ -168,6 +224,11 @@ static int vmap_pmd_range(pud_t *pud, unsigned long addr,
 		return -ENOMEM;
 	do {
 		next = pmd_addr_end(addr, end);
+		if (page_shift == PMD_SHIFT &&
+		    vmap_try_huge_pmd(pmd, addr, next, prot, pages[*nr])) {
+			*nr += PMD_SIZE >> PAGE_SHIFT;
+			continue;
+		}
 		if (vmap_pte_range(pmd, addr, next, prot, pages, nr))
 			return -ENOMEM;
 	} while (pmd++, addr = next, addr != end);
@@ -175,7 +236,8 @@ static int vmap_pmd_range(pud_t *pud, unsigned long addr,
 }
 
 static int vmap_pud_range(p4d_t *p4d, unsigned long addr,
-		unsigned long end, pgprot_t prot, struct page **pages, int *nr)
+		unsigned long end, pgprot_t prot, struct page **pages, int *nr,
+		unsigned int page_shift)
 {
 	pud_t *pud;
 	unsigned long next;
@@ -185,14 +247,16 @@ static int vmap_pud_range(p4d_t *p4d, unsigned long addr,
 		return -ENOMEM;
 	do {
 		next = pud_addr_end(addr, end);
-		if (vmap_pmd_range(pud, addr, next, prot, pages, nr))
+		if (vmap_pmd_range(pud, addr, next, prot, pages, nr,
+				   page_shift))
 			return -ENOMEM;
 	} while (pud++, addr = next, addr != end);
 	return 0;
 }
 
 static int vmap_p4d_range(pgd_t *pgd, unsigned long addr,
-		unsigned long end, pgprot_t prot, struct page **pages, int *nr)
+		unsigned long end, pgprot_t prot, struct page **pages, int *nr,
+		unsigned int page_shift)
 {
 	p4d_t *p4d;
 	unsigned long next;
@@ -202,7 +266,8 @@ static int vmap_p4d_range(pgd_t *pgd, unsigned long addr,
 		return -ENOMEM;
 	do {
 		next = p4d_addr_end(addr, end);
-		if (vmap_pud_range(p4d, addr, next, prot, pages, nr))
+		if (vmap_pud_range(p4d, addr, next, prot, pages, nr,
+				   page_shift))
 			return -ENOMEM;
 	} while (p4d++, addr = next, addr != end);
 	return 0;
@@ -213,9 +278,13 @@ static int vmap_p4d_range(pgd_t *pgd, unsigned long addr,
  * will have pfns corresponding to the "pages" array.
  *
  * Ie. pte at addr+N*PAGE_SIZE shall point to pfn corresponding to pages[N]
+ *
+ * With a page_shift of PMD_SHIFT, every PMD_SIZE chunk of pages must be
+ * physically contiguous, and is mapped by a huge pmd where possible.
  */
 static int vmap_page_range_noflush(unsigned long start, unsigned long end,
-				   pgprot_t prot, struct page **pages)
+				   pgprot_t prot, struct page **pages,
+				   unsigned int page_shift)
 {
 	pgd_t *pgd;
 	unsigned long next;
@@ -227,7 +296,8 @@ static int vmap_page_range_noflush(unsigned long start, unsigned long end,
 	pgd = pgd_offset_k(addr);
 	do {
 		next = pgd_addr_end(addr, end);
-		err = vmap_p4d_range(pgd, addr, next, prot, pages, &nr);
+		err = vmap_p4d_range(pgd, addr, next, prot, pages, &nr,
+				     page_shift);
 		if (err)
 			return err;
 	} while (pgd++, addr = next, addr != end);
@@ -236,11 +306,12 @@ static int vmap_page_range_noflush(unsigned long start, unsigned long end,
 }
 
 static int vmap_page_range(unsigned long start, unsigned long end,
-			   pgprot_t prot, struct page **pages)
+			   pgprot_t prot, struct page **pages,
+			   unsigned int page_shift)
 {
 	int ret;
 
-	ret = vmap_page_range_noflush(start, end, prot, pages);
+	ret = vmap_page_range_noflush(start, end, prot, pages, page_shift);
 	flush_cache_vmap(start, end);
 	return ret;
 }
@@ -293,11 +364,16 @@ struct page *vmalloc_to_page(const void *vmalloc_addr)
 	 * identified as vmalloc addresses by is_vmalloc_addr(), but are
 	 * not [unambiguously] associated with a struct page, so there is
 	 * no correct value to return for them.
+	 *
+	 * The exception are huge pmds set up by vmalloc() itself, which
+	 * map the pages of the area.
 	 */
 	WARN_ON_ONCE(pud_bad(*pud));
 	if (pud_none(*pud) || pud_bad(*pud))
 		return NULL;
 	pmd = pmd_offset(pud, addr);
+	if (vmap_allow_huge && pmd_huge(*pmd))
+		return pmd_page(*pmd) + ((addr & ~PMD_MASK) >> PAGE_SHIFT);
 	WARN_ON_ONCE(pmd_bad(*pmd));
 	if (pmd_none(*pmd) || pmd_bad(*pmd))
 		return NULL;
@@ -326,19 +402,84 @@ EXPORT_SYMBOL(vmalloc_to_pfn);
 #define VM_LAZY_FREE	0x02
 #define VM_VM_AREA	0x04
 
+/*
+ * Busy areas live in vmap_area_root and vmap_area_list under
+ * vmap_area_lock.  The holes between them are vmap_areas of their own,
+ * kept in free_vmap_area_root and free_vmap_area_list under
+ * free_vmap_area_lock.  Lazily freed areas stay busy until they are
+ * purged, then get merged back into the free tree.
+ */
 static DEFINE_SPINLOCK(vmap_area_lock);
+static DEFINE_SPINLOCK(free_vmap_area_lock);
 /* Export for kexec only */
 LIST_HEAD(vmap_area_list);
 static LLIST_HEAD(vmap_purge_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
+static struct rb_root free_vmap_area_root = RB_ROOT;
+static LIST_HEAD(free_vmap_area_list);
+
+static struct kmem_cache *vmap_area_cachep;
+
+/*
+ * Carving a block out of the middle of a hole needs a second vmap_area.
+ * One is preloaded per CPU before free_vmap_area_lock is taken, so that
+ * the split does not have to allocate under the lock.
+ */
+static DEFINE_PER_CPU(struct vmap_area *, ne_fit_preload_node);
+
+/*
+ * Small areas, such as vmapped stacks or BPF images, are handed out from a
+ * per-CPU cache that is refilled from the free tree VMAP_PCP_BATCH areas
+ * at a time, so that most of them never touch free_vmap_area_lock.  There
+ * is one cache per size in pages.  The caches only hold areas of the
+ * VMALLOC_START..VMALLOC_END range and only serve requests for that whole
+ * range, so that callers with a narrower range, such as module loading,
+ * neither hoard areas of their range nor get areas outside of it.  All
+ * the caches are given back to the free tree before an allocation is
+ * allowed to fail.
+ */
+#define VMAP_PCP_MAX_PAGES	8
+#define VMAP_PCP_BATCH		8
+
+struct vmap_area_pcp {
+	spinlock_t lock;
+	unsigned int nr[VMAP_PCP_MAX_PAGES];
+	struct vmap_area *areas[VMAP_PCP_MAX_PAGES][VMAP_PCP_BATCH];
+};
+
+static DEFINE_PER_CPU(struct vmap_area_pcp, vmap_area_pcp);
+
+static __always_inline unsigned long va_size(struct vmap_area *va)
+{
+	return va->va_end - va->va_start;
+}
+
+static __always_inline unsigned long
+get_subtree_max_size(struct rb_node *node)
+{
+	struct vmap_area *va;
 
-static unsigned long vmap_area_pcpu_hole;
+	va = rb_entry_safe(node, struct vmap_area, rb_node);
+	return va ? va->subtree_max_size : 0;
+}
+
+/*
+ * Every node of the free tree caches the size of the biggest hole in its
+ * subtree, which lets find_vmap_lowest_match() skip whole subtrees that
+ * cannot fit a request.
+ */
+static __always_inline unsigned long
+compute_subtree_max_size(struct vmap_area *va)
+{
+	return max3(va_size(va),
+		get_subtree_max_size(va->rb_node.rb_left),
+		get_subtree_max_size(va->rb_node.rb_right));
+}
+
+RB_DECLARE_CALLBACKS(static, free_vmap_area_rb_augment_cb,
+	struct vmap_area, rb_node, unsigned long, subtree_max_size,
+	compute_subtree_max_size)
 
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
@@ -359,36 +500,508 @@ static struct vmap_area *__find_vmap_area(unsigned long addr)
 	return NULL;
 }
 
-static void __insert_vmap_area(struct vmap_area *va)
+/*
+ * Find the link in @root that @va is to be attached to, and its parent.
+ * Overlapping areas are a bug.
+ */
+static __always_inline struct rb_node **
+find_va_links(struct vmap_area *va, struct rb_root *root,
+	struct rb_node **parent)
+{
+	struct vmap_area *tmp_va;
+	struct rb_node **link = &root->rb_node;
+
+	*parent = NULL;
+	while (*link) {
+		*parent = *link;
+		tmp_va = rb_entry(*link, struct vmap_area, rb_node);
+
+		if (va->va_end <= tmp_va->va_start)
+			link = &(*link)->rb_left;
+		else if (va->va_start >= tmp_va->va_end)
+			link = &(*link)->rb_right;
+		else
+			BUG();
+	}
+
+	return link;
+}
+
+/*
+ * The list entry that follows the place found by find_va_links(), or NULL
+ * if the tree is empty.
+ */
+static __always_inline struct list_head *
+get_va_next_sibling(struct rb_node *parent, struct rb_node **link)
 {
-	struct rb_node **p = &vmap_area_root.rb_node;
-	struct rb_node *parent = NULL;
-	struct rb_node *tmp;
+	struct list_head *list;
 
-	while (*p) {
-		struct vmap_area *tmp_va;
+	if (unlikely(!parent))
+		return NULL;
 
-		parent = *p;
-		tmp_va = rb_entry(parent, struct vmap_area, rb_node);
-		if (va->va_start < tmp_va->va_end)
-			p = &(*p)->rb_left;
-		else if (va->va_end > tmp_va->va_start)
-			p = &(*p)->rb_right;
-		else
-			BUG();
+	list = &rb_entry(parent, struct vmap_area, rb_node)->list;
+	return &parent->rb_right == link ? list->next : list;
+}
+
+static __always_inline void
+link_va(struct vmap_area *va, struct rb_root *root,
+	struct rb_node *parent, struct rb_node **link, struct list_head *head)
+{
+	/* The list entry @va goes after, to keep the list address sorted */
+	if (likely(parent)) {
+		head = &rb_entry(parent, struct vmap_area, rb_node)->list;
+		if (&parent->rb_right != link)
+			head = head->prev;
+	}
+
+	rb_link_node(&va->rb_node, parent, link);
+	if (root == &free_vmap_area_root) {
+		/*
+		 * Rotations while inserting may look at the new node before
+		 * it has a valid size cached; zero is a safe lower bound and
+		 * augment_tree_propagate_from() fixes the path up afterwards.
+		 */
+		va->subtree_max_size = 0;
+		rb_insert_augmented(&va->rb_node, root,
+				    &free_vmap_area_rb_augment_cb);
+	} else {
+		rb_insert_color(&va->rb_node, root);
 	}
 
-	rb_link_node(&va->rb_node, parent, p);
-	rb_insert_color(&va->rb_node, &vmap_area_root);
+	list_add(&va->list, head);
+}
 
-	/* address-sort this list */
-	tmp = rb_prev(&va->rb_node);
-	if (tmp) {
-		struct vmap_area *prev;
-		prev = rb_entry(tmp, struct vmap_area, rb_node);
-		list_add_rcu(&va->list, &prev->list);
-	} else
-		list_add_rcu(&va->list, &vmap_area_list);
+static __always_inline void
+unlink_va(struct vmap_area *va, struct rb_root *root)
+{
+	if (WARN_ON(RB_EMPTY_NODE(&va->rb_node)))
+		return;
+
+	if (root == &free_vmap_area_root)
+		rb_erase_augmented(&va->rb_node, root,
+				   &free_vmap_area_rb_augment_cb);
+	else
+		rb_erase(&va->rb_node, root);
+
+	list_del(&va->list);
+	RB_CLEAR_NODE(&va->rb_node);
+}
+
+/*
+ * Walk up from @va after its size changed, refreshing the cached subtree
+ * maximums until one of them is already right.
+ */
+static __always_inline void
+augment_tree_propagate_from(struct vmap_area *va)
+{
+	struct rb_node *node = &va->rb_node;
+	unsigned long new_max;
+
+	while (node) {
+		va = rb_entry(node, struct vmap_area, rb_node);
+		new_max = compute_subtree_max_size(va);
+		if (va->subtree_max_size == new_max)
+			break;
+
+		va->subtree_max_size = new_max;
+		node = rb_parent(&va->rb_node);
+	}
+}
+
+static void
+insert_vmap_area(struct vmap_area *va,
+	struct rb_root *root, struct list_head *head)
+{
+	struct rb_node **link;
+	struct rb_node *parent;
+
+	link = find_va_links(va, root, &parent);
+	link_va(va, root, parent, link, head);
+}
+
+static void
+insert_vmap_area_augment(struct vmap_area *va,
+	struct rb_root *root, struct list_head *head)
+{
+	insert_vmap_area(va, root, head);
+	augment_tree_propagate_from(va);
+}
+
+/*
+ * Give @va back to the free tree, merging it with the holes right before
+ * and after it.  @va itself is freed if it got merged.
+ */
+static void
+merge_or_add_vmap_area(struct vmap_area *va,
+	struct rb_root *root, struct list_head *head)
+{
+	struct vmap_area *sibling;
+	struct list_head *next;
+	struct rb_node **link;
+	struct rb_node *parent;
+	bool merged = false;
+
+	link = find_va_links(va, root, &parent);
+	next = get_va_next_sibling(parent, link);
+	if (unlikely(!next))
+		goto insert;
+
+	/* |<--- va --->|<--- next --->| */
+	if (next != head) {
+		sibling = list_entry(next, struct vmap_area, list);
+		if (sibling->va_start == va->va_end) {
+			sibling->va_start = va->va_start;
+			augment_tree_propagate_from(sibling);
+			kmem_cache_free(vmap_area_cachep, va);
+
+			va = sibling;
+			merged = true;
+		}
+	}
+
+	/* |<--- prev --->|<--- va --->| */
+	if (next->prev != head) {
+		sibling = list_entry(next->prev, struct vmap_area, list);
+		if (sibling->va_end == va->va_start) {
+			sibling->va_end = va->va_end;
+			augment_tree_propagate_from(sibling);
+			if (merged)
+				unlink_va(va, root);
+			kmem_cache_free(vmap_area_cachep, va);
+			return;
+		}
+	}
+
+insert:
+	if (!merged) {
+		link_va(va, root, parent, link, head);
+		augment_tree_propagate_from(va);
+	}
+}
+
+static __always_inline bool
+is_within_this_va(struct vmap_area *va, unsigned long size,
+	unsigned long align, unsigned long vstart)
+{
+	unsigned long nva_start_addr;
+
+	if (va->va_start > vstart)
+		nva_start_addr = ALIGN(va->va_start, align);
+	else
+		nva_start_addr = ALIGN(vstart, align);
+
+	/* Can overflow because of a big size or alignment */
+	if (nva_start_addr + size < nva_start_addr ||
+			nva_start_addr < vstart)
+		return false;
+
+	return nva_start_addr + size <= va->va_end;
+}
+
+/*
+ * Find the lowest hole at or above @vstart that fits @size at @align, in
+ * O(log n): subtrees whose biggest hole is too small are never entered.
+ */
+static __always_inline struct vmap_area *
+find_vmap_lowest_match(unsigned long size,
+	unsigned long align, unsigned long vstart)
+{
+	struct vmap_area *va;
+	struct rb_node *node;
+	unsigned long length;
+
+	node = free_vmap_area_root.rb_node;
+
+	/* Account for the worst case alignment overhead */
+	length = size + align - 1;
+
+	while (node) {
+		va = rb_entry(node, struct vmap_area, rb_node);
+
+		if (get_subtree_max_size(node->rb_left) >= length &&
+				vstart < va->va_start) {
+			node = node->rb_left;
+		} else {
+			if (is_within_this_va(va, size, align, vstart))
+				return va;
+
+			if (get_subtree_max_size(node->rb_right) >= length) {
+				node = node->rb_right;
+				continue;
+			}
+
+			/*
+			 * Nothing fits below, so go back up to the first
+			 * right subtree that can fit the request.  Moving
+			 * vstart past the parent keeps us from walking down
+			 * into the subtree that was just ruled out again.
+			 */
+			while ((node = rb_parent(node))) {
+				va = rb_entry(node, struct vmap_area, rb_node);
+				if (is_within_this_va(va, size, align, vstart))
+					return va;
+
+				if (get_subtree_max_size(node->rb_right) >= length &&
+						vstart <= va->va_start) {
+					vstart = va->va_start + 1;
+					node = node->rb_right;
+					break;
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+enum fit_type {
+	NOTHING_FIT = 0,
+	FL_FIT_TYPE = 1,	/* full fit */
+	LE_FIT_TYPE = 2,	/* left edge fit */
+	RE_FIT_TYPE = 3,	/* right edge fit */
+	NE_FIT_TYPE = 4		/* no edge fit */
+};
+
+static __always_inline enum fit_type
+classify_va_fit_type(struct vmap_area *va,
+	unsigned long nva_start_addr, unsigned long size)
+{
+	if (nva_start_addr < va->va_start ||
+			nva_start_addr + size > va->va_end)
+		return NOTHING_FIT;
+
+	if (va->va_start == nva_start_addr) {
+		if (va->va_end == nva_start_addr + size)
+			return FL_FIT_TYPE;
+		return LE_FIT_TYPE;
+	}
+	if (va->va_end == nva_start_addr + size)
+		return RE_FIT_TYPE;
+	return NE_FIT_TYPE;
+}
+
+/*
+ * Cut [nva_start_addr, nva_start_addr + size) out of the free area @va.
+ */
+static __always_inline int
+adjust_va_to_fit_type(struct vmap_area *va,
+	unsigned long nva_start_addr, unsigned long size,
+	enum fit_type type)
+{
+	struct vmap_area *lva = NULL;
+
+	switch (type) {
+	case FL_FIT_TYPE:
+		unlink_va(va, &free_vmap_area_root);
+		kmem_cache_free(vmap_area_cachep, va);
+		return 0;
+	case LE_FIT_TYPE:
+		va->va_start += size;
+		break;
+	case RE_FIT_TYPE:
+		va->va_end = nva_start_addr;
+		break;
+	case NE_FIT_TYPE:
+		lva = __this_cpu_xchg(ne_fit_preload_node, NULL);
+		if (unlikely(!lva)) {
+			lva = kmem_cache_alloc(vmap_area_cachep, GFP_NOWAIT);
+			if (!lva)
+				return -ENOMEM;
+		}
+		lva->va_start = va->va_start;
+		lva->va_end = nva_start_addr;
+		va->va_start = nva_start_addr + size;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	augment_tree_propagate_from(va);
+	if (lva)
+		insert_vmap_area_augment(lva, &free_vmap_area_root,
+					 &free_vmap_area_list);
+	return 0;
+}
+
+/*
+ * Take a block of @size at @align within [@vstart, @vend) from the free
+ * tree.  Returns its address, or @vend if there is none.  Called with
+ * free_vmap_area_lock held.
+ */
+static unsigned long
+__alloc_vmap_area(unsigned long size, unsigned long align,
+	unsigned long vstart, unsigned long vend)
+{
+	unsigned long nva_start_addr;
+	struct vmap_area *va;
+	enum fit_type type;
+
+	va = find_vmap_lowest_match(size, align, vstart);
+	if (unlikely(!va))
+		return vend;
+
+	if (va->va_start > vstart)
+		nva_start_addr = ALIGN(va->va_start, align);
+	else
+		nva_start_addr = ALIGN(vstart, align);
+
+	if (nva_start_addr + size > vend)
+		return vend;
+
+	type = classify_va_fit_type(va, nva_start_addr, size);
+	if (WARN_ON_ONCE(type == NOTHING_FIT))
+		return vend;
+
+	if (adjust_va_to_fit_type(va, nva_start_addr, size, type))
+		return vend;
+
+	return nva_start_addr;
+}
+
+/*
+ * Make sure this CPU has a spare vmap_area for a NE_FIT_TYPE split, then
+ * take free_vmap_area_lock.  The spare is allocated with the caller's gfp
+ * mask outside the lock; if that fails the split falls back to GFP_NOWAIT.
+ */
+static void preload_free_vmap_area_lock(gfp_t gfp_mask, int node)
+{
+	struct vmap_area *pva = NULL;
+
+	if (!this_cpu_read(ne_fit_preload_node))
+		pva = kmem_cache_alloc_node(vmap_area_cachep, gfp_mask, node);
+
+	spin_lock(&free_vmap_area_lock);
+
+	if (pva && __this_cpu_cmpxchg(ne_fit_preload_node, NULL, pva))
+		kmem_cache_free(vmap_area_cachep, pva);
+}
+
+static struct vmap_area *vmap_pcp_get(unsigned long size, unsigned long align)
+{
+	unsigned int idx = (size >> PAGE_SHIFT) - 1;
+	struct vmap_area_pcp *pcp;
+	struct vmap_area *va;
+	unsigned int i;
+
+	pcp = raw_cpu_ptr(&vmap_area_pcp);
+	spin_lock(&pcp->lock);
+	for (i = pcp->nr[idx]; i-- > 0;) {
+		va = pcp->areas[idx][i];
+		if (IS_ALIGNED(va->va_start, align)) {
+			pcp->areas[idx][i] = pcp->areas[idx][--pcp->nr[idx]];
+			spin_unlock(&pcp->lock);
+			return va;
+		}
+	}
+	spin_unlock(&pcp->lock);
+
+	return NULL;
+}
+
+/*
+ * Stash @nr free areas of @size in this CPU's cache.  Returns how many did
+ * not fit.
+ */
+static unsigned int vmap_pcp_put(unsigned long size, struct vmap_area **vas,
+				 unsigned int nr)
+{
+	unsigned int idx = (size >> PAGE_SHIFT) - 1;
+	struct vmap_area_pcp *pcp;
+
+	pcp = raw_cpu_ptr(&vmap_area_pcp);
+	spin_lock(&pcp->lock);
+	while (nr && pcp->nr[idx] < VMAP_PCP_BATCH)
+		pcp->areas[idx][pcp->nr[idx]++] = vas[--nr];
+	spin_unlock(&pcp->lock);
+
+	return nr;
+}
+
+/*
+ * Give every cached area back to the free tree, so that it can be merged
+ * into bigger holes or handed out to other ranges.
+ */
+static void vmap_pcp_drain_all(void)
+{
+	struct vmap_area *va, *n_va;
+	struct vmap_area_pcp *pcp;
+	unsigned int idx;
+	LIST_HEAD(list);
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		pcp = per_cpu_ptr(&vmap_area_pcp, cpu);
+		spin_lock(&pcp->lock);
+		for (idx = 0; idx < VMAP_PCP_MAX_PAGES; idx++) {
+			while (pcp->nr[idx])
+				list_add(&pcp->areas[idx][--pcp->nr[idx]]->list,
+					 &list);
+		}
+		spin_unlock(&pcp->lock);
+	}
+
+	if (list_empty(&list))
+		return;
+
+	spin_lock(&free_vmap_area_lock);
+	list_for_each_entry_safe(va, n_va, &list, list)
+		merge_or_add_vmap_area(va, &free_vmap_area_root,
+				       &free_vmap_area_list);
+	spin_unlock(&free_vmap_area_lock);
+}
+
+/*
+ * Get a small area from this CPU's cache, refilling the cache with a batch
+ * taken from the free tree under a single lock round trip if it has
+ * nothing suitable.
+ */
+static struct vmap_area *vmap_pcp_alloc(unsigned long size, unsigned long align,
+					int node, gfp_t gfp_mask)
+{
+	struct vmap_area *vas[VMAP_PCP_BATCH];
+	unsigned long addr;
+	unsigned int nr, got, left;
+
+	vas[0] = vmap_pcp_get(size, align);
+	if (vas[0])
+		return vas[0];
+
+	nr = kmem_cache_alloc_bulk(vmap_area_cachep, gfp_mask,
+				   VMAP_PCP_BATCH, (void **)vas);
+	if (!nr)
+		return NULL;
+
+	preload_free_vmap_area_lock(gfp_mask, node);
+	for (got = 0; got < nr; got++) {
+		addr = __alloc_vmap_area(size, align, VMALLOC_START,
+					 VMALLOC_END);
+		if (addr == VMALLOC_END)
+			break;
+		vas[got]->va_start = addr;
+		vas[got]->va_end = addr + size;
+	}
+	spin_unlock(&free_vmap_area_lock);
+
+	if (got < nr)
+		kmem_cache_free_bulk(vmap_area_cachep, nr - got,
+				     (void **)&vas[got]);
+	if (!got)
+		return NULL;
+
+	for (nr = 0; nr < got; nr++)
+		kmemleak_scan_area(&vas[nr]->rb_node, SIZE_MAX, gfp_mask);
+
+	/* Somebody else may have refilled the cache in the meantime */
+	left = vmap_pcp_put(size, &vas[1], got - 1);
+	if (left) {
+		spin_lock(&free_vmap_area_lock);
+		while (left)
+			merge_or_add_vmap_area(vas[left--], &free_vmap_area_root,
+					       &free_vmap_area_list);
+		spin_unlock(&free_vmap_area_lock);
+	}
+
+	return vas[0];
 }
 
 static void purge_vmap_area_lazy(void);
@@ -405,19 +1018,24 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				int node, gfp_t gfp_mask)
 {
 	struct vmap_area *va;
-	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
 
 	BUG_ON(!size);
 	BUG_ON(offset_in_page(size));
 	BUG_ON(!is_power_of_2(align));
 
 	might_sleep();
+	gfp_mask &= GFP_RECLAIM_MASK;
 
-	va = kmalloc_node(sizeof(struct vmap_area),
-			gfp_mask & GFP_RECLAIM_MASK, node);
+	if (size <= VMAP_PCP_MAX_PAGES << PAGE_SHIFT &&
+	    vstart == VMALLOC_START && vend == VMALLOC_END) {
+		va = vmap_pcp_alloc(size, align, node, gfp_mask);
+		if (va)
+			goto insert;
+	}
+
+	va = kmem_cache_alloc_node(vmap_area_cachep, gfp_mask, node);
 	if (unlikely(!va))
 		return ERR_PTR(-ENOMEM);
 
@@ -425,91 +1043,22 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	 * Only scan the relevant parts containing pointers to other objects
 	 * to avoid false negatives.
 	 */
-	kmemleak_scan_area(&va->rb_node, SIZE_MAX, gfp_mask & GFP_RECLAIM_MASK);
+	kmemleak_scan_area(&va->rb_node, SIZE_MAX, gfp_mask);
 
 retry:
-	spin_lock(&vmap_area_lock);
-	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
-	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
-	}
-
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size < addr)
-			goto overflow;
-
-		if (list_is_last(&first->list, &vmap_area_list))
-			goto found;
+	preload_free_vmap_area_lock(gfp_mask, node);
+	addr = __alloc_vmap_area(size, align, vstart, vend);
+	spin_unlock(&free_vmap_area_lock);
 
-		first = list_next_entry(first, list);
-	}
-
-found:
-	/*
-	 * Check also calculated address against the vstart,
-	 * because it can be 0 because of big align request.
-	 */
-	if (addr + size > vend || addr < vstart)
+	if (unlikely(addr == vend))
 		goto overflow;
 
 	va->va_start = addr;
 	va->va_end = addr + size;
+insert:
 	va->flags = 0;
-	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
+	spin_lock(&vmap_area_lock);
+	insert_vmap_area(va, &vmap_area_root, &vmap_area_list);
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(!IS_ALIGNED(va->va_start, align));
@@ -519,8 +1068,8 @@ found:
 	return va;
 
 overflow:
-	spin_unlock(&vmap_area_lock);
 	if (!purged) {
+		vmap_pcp_drain_all();
 		purge_vmap_area_lazy();
 		purged = 1;
 		goto retry;
@@ -538,7 +1087,7 @@ overflow:
 	if (!(gfp_mask & __GFP_NOWARN) && printk_ratelimit())
 		pr_warn("vmap allocation for size %lu failed: use vmalloc=<size> to increase size\n",
 			size);
-	kfree(va);
+	kmem_cache_free(vmap_area_cachep, va);
 	return ERR_PTR(-EBUSY);
 }
 
@@ -554,49 +1103,18 @@ int unregister_vmap_purge_notifier(struct notifier_block *nb)
 }
 EXPORT_SYMBOL_GPL(unregister_vmap_purge_notifier);
 
-static void __free_vmap_area(struct vmap_area *va)
-{
-	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
-
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
-	rb_erase(&va->rb_node, &vmap_area_root);
-	RB_CLEAR_NODE(&va->rb_node);
-	list_del_rcu(&va->list);
-
-	/*
-	 * Track the highest possible candidate for pcpu area
-	 * allocation.  Areas outside of vmalloc area can be returned
-	 * here too, consider only end addresses which fall inside
-	 * vmalloc area proper.
-	 */
-	if (va->va_end > VMALLOC_START && va->va_end <= VMALLOC_END)
-		vmap_area_pcpu_hole = max(vmap_area_pcpu_hole, va->va_end);
-
-	kfree_rcu(va, rcu_head);
-}
-
 /*
  * Free a region of KVA allocated by alloc_vmap_area
  */
 static void free_vmap_area(struct vmap_area *va)
 {
 	spin_lock(&vmap_area_lock);
-	__free_vmap_area(va);
+	unlink_va(va, &vmap_area_root);
 	spin_unlock(&vmap_area_lock);
+
+	spin_lock(&free_vmap_area_lock);
+	merge_or_add_vmap_area(va, &free_vmap_area_root, &free_vmap_area_list);
+	spin_unlock(&free_vmap_area_lock);
 }
 
 /*
@@ -680,14 +1198,23 @@ static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end)
 	flush_tlb_kernel_range(start, end);
 
 	spin_lock(&vmap_area_lock);
+	llist_for_each_entry(va, valist, purge_list) {
+		unlink_va(va, &vmap_area_root);
+		cond_resched_lock(&vmap_area_lock);
+	}
+	spin_unlock(&vmap_area_lock);
+
+	spin_lock(&free_vmap_area_lock);
 	llist_for_each_entry_safe(va, n_va, valist, purge_list) {
 		int nr = (va->va_end - va->va_start) >> PAGE_SHIFT;
 
-		__free_vmap_area(va);
+		/* va may be merged into a neighbour and freed here */
+		merge_or_add_vmap_area(va, &free_vmap_area_root,
+				       &free_vmap_area_list);
 		atomic_sub(nr, &vmap_lazy_nr);
-		cond_resched_lock(&vmap_area_lock);
+		cond_resched_lock(&free_vmap_area_lock);
 	}
-	spin_unlock(&vmap_area_lock);
+	spin_unlock(&free_vmap_area_lock);
 	return true;
 }
 
@@ -1182,7 +1709,7 @@ void *vm_map_ram(struct page **pages, unsigned int count, int node, pgprot_t pro
 		addr = va->va_start;
 		mem = (void *)addr;
 	}
-	if (vmap_page_range(addr, addr + size, prot, pages) < 0) {
+	if (vmap_page_range(addr, addr + size, prot, pages, PAGE_SHIFT) < 0) {
 		vm_unmap_ram(mem, count);
 		return NULL;
 	}
@@ -1242,12 +1769,50 @@ void __init vm_area_register_early(struct vm_struct *vm, size_t align)
 	vm_area_add_early(vm);
 }
 
+/*
+ * Describe the whole address space outside of the busy areas imported at
+ * boot as free, so that alloc_vmap_area() can serve any vstart/vend range.
+ */
+static void __init vmap_init_free_space(void)
+{
+	unsigned long vmap_start = 1;
+	const unsigned long vmap_end = ULONG_MAX;
+	struct vmap_area *busy, *free;
+
+	list_for_each_entry(busy, &vmap_area_list, list) {
+		if (busy->va_start > vmap_start) {
+			free = kmem_cache_zalloc(vmap_area_cachep, GFP_NOWAIT);
+			if (!WARN_ON_ONCE(!free)) {
+				free->va_start = vmap_start;
+				free->va_end = busy->va_start;
+				insert_vmap_area_augment(free,
+					&free_vmap_area_root,
+					&free_vmap_area_list);
+			}
+		}
+
+		vmap_start = busy->va_end;
+	}
+
+	if (vmap_end > vmap_start) {
+		free = kmem_cache_zalloc(vmap_area_cachep, GFP_NOWAIT);
+		if (!WARN_ON_ONCE(!free)) {
+			free->va_start = vmap_start;
+			free->va_end = vmap_end;
+			insert_vmap_area_augment(free, &free_vmap_area_root,
+						 &free_vmap_area_list);
+		}
+	}
+}
+
 void __init vmalloc_init(void)
 {
 	struct vmap_area *va;
 	struct vm_struct *tmp;
 	int i;
 
+	vmap_area_cachep = KMEM_CACHE(vmap_area, SLAB_PANIC);
+
 	for_each_possible_cpu(i) {
 		struct vmap_block_queue *vbq;
 		struct vfree_deferred *p;
@@ -1258,19 +1823,28 @@ void __init vmalloc_init(void)
 		p = &per_cpu(vfree_deferred, i);
 		init_llist_head(&p->list);
 		INIT_WORK(&p->wq, free_work);
+		spin_lock_init(&per_cpu(vmap_area_pcp, i).lock);
 	}
 
 	/* Import existing vmlist entries. */
 	for (tmp = vmlist; tmp; tmp = tmp->next) {
-		va = kzalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+		va = kmem_cache_zalloc(vmap_area_cachep, GFP_NOWAIT);
+		if (WARN_ON_ONCE(!va))
+			continue;
+
 		va->flags = VM_VM_AREA;
 		va->va_start = (unsigned long)tmp->addr;
 		va->va_end = va->va_start + tmp->size;
 		va->vm = tmp;
-		__insert_vmap_area(va);
+		insert_vmap_area(va, &vmap_area_root, &vmap_area_list);
 	}
 
-	vmap_area_pcpu_hole = VMALLOC_END;
+	vmap_init_free_space();
+
+#ifdef CONFIG_HUGE_VMALLOC
+	if (!arch_ioremap_pmd_supported())
+		vmap_allow_huge = false;
+#endif
 
 	vmap_initialized = true;
 }
@@ -1297,7 +1871,8 @@ void __init vmalloc_init(void)
 int map_kernel_range_noflush(unsigned long addr, unsigned long size,
 			     pgprot_t prot, struct page **pages)
 {
-	return vmap_page_range_noflush(addr, addr + size, prot, pages);
+	return vmap_page_range_noflush(addr, addr + size, prot, pages,
+				       PAGE_SHIFT);
 }
 
 /**
@@ -1344,7 +1919,8 @@ int map_vm_area(struct vm_struct *area, pgprot_t prot, struct page **pages)
 	unsigned long end = addr + get_vm_area_size(area);
 	int err;
 
-	err = vmap_page_range(addr, end, prot, pages);
+	err = vmap_page_range(addr, end, prot, pages,
+			      PAGE_SHIFT + vm_area_page_order(area));
 
 	return err > 0 ? 0 : err;
 }
@@ -1654,13 +2230,33 @@ EXPORT_SYMBOL(vmap);
 static void *__vmalloc_node(unsigned long size, unsigned long align,
 			    gfp_t gfp_mask, pgprot_t prot,
 			    int node, const void *caller);
+/* Pages handed to the bulk allocator per interrupt disabled section */
+#define VMALLOC_BULK_PAGES	100U
+
+/*
+ * The bulk allocator fills from a single node, only use it where
+ * alloc_page() would not have spread the pages by mempolicy.
+ */
+static inline bool vmalloc_bulk_allowed(int node)
+{
+#ifdef CONFIG_NUMA
+	if (node == NUMA_NO_NODE && current->mempolicy)
+		return false;
+#endif
+	return true;
+}
+
 static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
-				 pgprot_t prot, int node)
+				 pgprot_t prot, unsigned int page_shift,
+				 int node)
 {
 	struct page **pages;
 	unsigned int nr_pages, array_size, i;
+	const unsigned int page_order = page_shift - PAGE_SHIFT;
 	const gfp_t nested_gfp = (gfp_mask & GFP_RECLAIM_MASK) | __GFP_ZERO;
-	const gfp_t alloc_mask = gfp_mask | __GFP_NOWARN;
+	/* Huge pages are opportunistic, the caller falls back to small ones */
+	const gfp_t alloc_mask = gfp_mask | __GFP_NOWARN |
+				 (page_order ? __GFP_NORETRY : 0);
 	const gfp_t highmem_mask = (gfp_mask & (GFP_DMA | GFP_DMA32)) ?
 					0 :
 					__GFP_HIGHMEM;
@@ -1682,21 +2278,53 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 		kfree(area);
 		return NULL;
 	}
+	set_vm_area_page_order(area, page_order);
+
+	i = 0;
+	if (!page_order && vmalloc_bulk_allowed(node)) {
+		/*
+		 * Take pages from the pcplists in batches, bounded so that
+		 * interrupts are not disabled for long and we still get to
+		 * reschedule.  Whatever the batches leave unpopulated goes
+		 * to the single page allocator below, which can reclaim.
+		 */
+		while (i < nr_pages) {
+			unsigned int nr = min(nr_pages - i, VMALLOC_BULK_PAGES);
+			unsigned int got;
+
+			got = alloc_pages_bulk_array_node(alloc_mask|highmem_mask,
+							  node, nr, pages + i);
+			i += got;
+			if (gfpflags_allow_blocking(gfp_mask|highmem_mask))
+				cond_resched();
+			if (got != nr)
+				break;
+		}
+	}
 
-	for (i = 0; i < area->nr_pages; i++) {
+	for (; i < area->nr_pages; i += 1U << page_order) {
 		struct page *page;
+		unsigned int j;
 
 		if (node == NUMA_NO_NODE)
-			page = alloc_page(alloc_mask|highmem_mask);
+			page = alloc_pages(alloc_mask|highmem_mask, page_order);
 		else
-			page = alloc_pages_node(node, alloc_mask|highmem_mask, 0);
+			page = alloc_pages_node(node, alloc_mask|highmem_mask,
+						page_order);
 
 		if (unlikely(!page)) {
 			/* Successfully allocated i pages, free them in __vunmap() */
 			area->nr_pages = i;
 			goto fail;
 		}
-		area->pages[i] = page;
+		/*
+		 * Keep area->pages[] a plain array of small pages, so that
+		 * __vunmap() and remap_vmalloc_range() need not care.
+		 */
+		if (page_order)
+			split_page(page, page_order);
+		for (j = 0; j < 1U << page_order; j++)
+			area->pages[i + j] = page + j;
 		if (gfpflags_allow_blocking(gfp_mask|highmem_mask))
 			cond_resched();
 	}
@@ -1706,7 +2334,8 @@ static void *__vmalloc_area_node(struct vm_struct *area, gfp_t gfp_mask,
 	return area->addr;
 
 fail:
-	warn_alloc(gfp_mask, NULL,
+	if (!page_order)
+		warn_alloc(gfp_mask, NULL,
 			  "vmalloc: allocation failure, allocated %ld of %ld bytes",
 			  (area->nr_pages*PAGE_SIZE), area->size);
 	vfree(area->addr);
@@ -1728,6 +2357,11 @@ fail:
  *	Allocate enough pages to cover @size from the page level
  *	allocator with @gfp_mask flags.  Map them into contiguous
  *	kernel virtual space, using a pagetable protection of @prot.
+ *
+ *	Areas of at least PMD_SIZE are mapped with huge pages where the
+ *	architecture supports it, unless @vm_flags has %VM_NO_HUGE_VMAP.
+ *	Callers that change the protection or mapping of parts of the
+ *	area must pass %VM_NO_HUGE_VMAP.
  */
 void *__vmalloc_node_range(unsigned long size, unsigned long align,
 			unsigned long start, unsigned long end, gfp_t gfp_mask,
@@ -1737,19 +2371,43 @@ void *__vmalloc_node_range(unsigned long size, unsigned long align,
 	struct vm_struct *area;
 	void *addr;
 	unsigned long real_size = size;
+	unsigned long real_align = align;
+	unsigned int shift = PAGE_SHIFT;
 
 	size = PAGE_ALIGN(size);
 	if (!size || (size >> PAGE_SHIFT) > totalram_pages)
 		goto fail;
 
+	/*
+	 * Huge pages would be charged to the memcg as a whole but are freed
+	 * one small page at a time, so keep accounted areas small.
+	 */
+	if (vmap_allow_huge && !(vm_flags & VM_NO_HUGE_VMAP) &&
+	    !(gfp_mask & __GFP_ACCOUNT)) {
+		unsigned long size_per_node = size;
+
+		/* Without a node, mempolicy may spread the pages */
+		if (node == NUMA_NO_NODE)
+			size_per_node /= num_online_nodes();
+		if (size_per_node >= PMD_SIZE) {
+			shift = PMD_SHIFT;
+			align = max(real_align, 1UL << shift);
+			size = ALIGN(real_size, 1UL << shift);
+		}
+	}
+
+again:
 	area = __get_vm_area_node(size, align, VM_ALLOC | VM_UNINITIALIZED |
 				vm_flags, start, end, node, gfp_mask, caller);
 	if (!area)
 		goto fail;
 
-	addr = __vmalloc_area_node(area, gfp_mask, prot, node);
-	if (!addr)
+	addr = __vmalloc_area_node(area, gfp_mask, prot, shift, node);
+	if (!addr) {
+		if (shift > PAGE_SHIFT)
+			goto fallback;
 		return NULL;
+	}
 
 	/*
 	 * First make sure the mappings are removed from all page-tables
@@ -1769,9 +2427,18 @@ void *__vmalloc_node_range(unsigned long size, unsigned long align,
 	return addr;
 
 fail:
+	if (shift > PAGE_SHIFT)
+		goto fallback;
 	warn_alloc(gfp_mask, NULL,
 			  "vmalloc: allocation failure: %lu bytes", real_size);
 	return NULL;
+
+fallback:
+	/* Out of huge pages or of aligned address space: use small pages */
+	shift = PAGE_SHIFT;
+	align = real_align;
+	size = PAGE_ALIGN(real_size);
+	goto again;
 }
 
 /**
@@ -1839,6 +2506,24 @@ void *vmalloc(unsigned long size)
 }
 EXPORT_SYMBOL(vmalloc);
 
+/**
+ *	vmalloc_no_huge  -  allocate virtually contiguous memory using small pages
+ *	@size:		allocation size
+ *	Allocate enough non-huge pages to cover @size from the page level
+ *	allocator and map them into contiguous kernel virtual space, for
+ *	callers that work on the mapping at PAGE_SIZE granularity.
+ *
+ *	For tight control over page level allocator and protection flags
+ *	use __vmalloc() instead.
+ */
+void *vmalloc_no_huge(unsigned long size)
+{
+	return __vmalloc_node_range(size, 1, VMALLOC_START, VMALLOC_END,
+				    GFP_KERNEL, PAGE_KERNEL, VM_NO_HUGE_VMAP,
+				    NUMA_NO_NODE, __builtin_return_address(0));
+}
+EXPORT_SYMBOL(vmalloc_no_huge);
+
 /**
  *	vzalloc - allocate virtually contiguous memory with zero fill
  *	@size:	allocation size
@@ -2375,81 +3060,59 @@ static struct vmap_area *node_to_va(struct rb_node *n)
 }
 
 /**
- * pvm_find_next_prev - find the next and prev vmap_area surrounding @end
- * @end: target address
- * @pnext: out arg for the next vmap_area
- * @pprev: out arg for the previous vmap_area
- *
- * Returns: %true if either or both of next and prev are found,
- *	    %false if no vmap_area exists
+ * pvm_find_va_enclose_addr - find the free vmap_area @addr belongs to
+ * @addr: target address
  *
- * Find vmap_areas end addresses of which enclose @end.  ie. if not
- * NULL, *pnext->va_end > @end and *pprev->va_end <= @end.
+ * Returns: the free vmap_area containing @addr if there is one, otherwise
+ *	    the highest free vmap_area below @addr, or %NULL if there is no
+ *	    free area below @addr at all.
  */
-static bool pvm_find_next_prev(unsigned long end,
-			       struct vmap_area **pnext,
-			       struct vmap_area **pprev)
+static struct vmap_area *pvm_find_va_enclose_addr(unsigned long addr)
 {
-	struct rb_node *n = vmap_area_root.rb_node;
-	struct vmap_area *va = NULL;
+	struct vmap_area *va = NULL, *tmp;
+	struct rb_node *n = free_vmap_area_root.rb_node;
 
 	while (n) {
-		va = rb_entry(n, struct vmap_area, rb_node);
-		if (end < va->va_end)
-			n = n->rb_left;
-		else if (end > va->va_end)
+		tmp = rb_entry(n, struct vmap_area, rb_node);
+		if (tmp->va_start <= addr) {
+			va = tmp;
+			if (tmp->va_end >= addr)
+				break;
+
 			n = n->rb_right;
-		else
-			break;
+		} else {
+			n = n->rb_left;
+		}
 	}
 
-	if (!va)
-		return false;
-
-	if (va->va_end > end) {
-		*pnext = va;
-		*pprev = node_to_va(rb_prev(&(*pnext)->rb_node));
-	} else {
-		*pprev = va;
-		*pnext = node_to_va(rb_next(&(*pprev)->rb_node));
-	}
-	return true;
+	return va;
 }
 
 /**
- * pvm_determine_end - find the highest aligned address between two vmap_areas
- * @pnext: in/out arg for the next vmap_area
- * @pprev: in/out arg for the previous vmap_area
+ * pvm_determine_end_from_reverse - find the highest aligned end address
+ * of a free vmap_area below VMALLOC_END
+ * @va: in - the free vmap_area to start the search from, downwards;
+ *	out - the free vmap_area with the highest aligned end address
  * @align: alignment
  *
- * Returns: determined end address
- *
- * Find the highest aligned address between *@pnext and *@pprev below
- * VMALLOC_END.  *@pnext and *@pprev are adjusted so that the aligned
- * down address is between the end addresses of the two vmap_areas.
- *
- * Please note that the address returned by this function may fall
- * inside *@pnext vmap_area.  The caller is responsible for checking
- * that.
+ * Returns: determined end address within *@va, or 0 if there is none
  */
-static unsigned long pvm_determine_end(struct vmap_area **pnext,
-				       struct vmap_area **pprev,
-				       unsigned long align)
+static unsigned long
+pvm_determine_end_from_reverse(struct vmap_area **va, unsigned long align)
 {
 	const unsigned long vmalloc_end = VMALLOC_END & ~(align - 1);
 	unsigned long addr;
 
-	if (*pnext)
-		addr = min((*pnext)->va_start & ~(align - 1), vmalloc_end);
-	else
-		addr = vmalloc_end;
-
-	while (*pprev && (*pprev)->va_end > addr) {
-		*pnext = *pprev;
-		*pprev = node_to_va(rb_prev(&(*pnext)->rb_node));
+	if (likely(*va)) {
+		list_for_each_entry_from_reverse((*va),
+				&free_vmap_area_list, list) {
+			addr = min((*va)->va_end & ~(align - 1), vmalloc_end);
+			if ((*va)->va_start < addr)
+				return addr;
+		}
 	}
 
-	return addr;
+	return 0;
 }
 
 /**
@@ -2470,10 +3133,10 @@ static unsigned long pvm_determine_end(struct vmap_area **pnext,
  * areas are allocated from top.
  *
  * Despite its complicated look, this allocator is rather simple.  It
- * does everything top-down and scans areas from the end looking for
- * matching slot.  While scanning, if any of the areas overlaps with
- * existing vmap_area, the base address is pulled down to fit the
- * area.  Scanning is repeated till all the areas fit and then all
+ * does everything top-down and scans free blocks from the end looking
+ * for matching base.  While scanning, if any of the areas does not fit
+ * the free block it falls into, the base address is pulled down to fit
+ * the area.  Scanning is repeated till all the areas fit and then all
  * necessary data structures are inserted and the result is returned.
  */
 struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
@@ -2482,11 +3145,12 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 {
 	const unsigned long vmalloc_start = ALIGN(VMALLOC_START, align);
 	const unsigned long vmalloc_end = VMALLOC_END & ~(align - 1);
-	struct vmap_area **vas, *prev, *next;
+	struct vmap_area **vas, *va;
 	struct vm_struct **vms;
 	int area, area2, last_area, term_area;
-	unsigned long base, start, end, last_end;
+	unsigned long base, start, size, end, last_end;
 	bool purged = false;
+	enum fit_type type;
 
 	/* verify parameters and allocate data structures */
 	BUG_ON(offset_in_page(align) || !is_power_of_2(align));
@@ -2522,62 +3186,51 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 		goto err_free2;
 
 	for (area = 0; area < nr_vms; area++) {
-		vas[area] = kzalloc(sizeof(struct vmap_area), GFP_KERNEL);
+		vas[area] = kmem_cache_zalloc(vmap_area_cachep, GFP_KERNEL);
 		vms[area] = kzalloc(sizeof(struct vm_struct), GFP_KERNEL);
 		if (!vas[area] || !vms[area])
 			goto err_free;
 	}
 retry:
-	spin_lock(&vmap_area_lock);
+	spin_lock(&free_vmap_area_lock);
 
 	/* start scanning - we scan from the top, begin with the last area */
 	area = term_area = last_area;
 	start = offsets[area];
 	end = start + sizes[area];
 
-	if (!pvm_find_next_prev(vmap_area_pcpu_hole, &next, &prev)) {
-		base = vmalloc_end - last_end;
-		goto found;
-	}
-	base = pvm_determine_end(&next, &prev, align) - end;
+	va = pvm_find_va_enclose_addr(vmalloc_end);
+	base = pvm_determine_end_from_reverse(&va, align) - end;
 
 	while (true) {
-		BUG_ON(next && next->va_end <= base + end);
-		BUG_ON(prev && prev->va_end > base + end);
-
 		/*
 		 * base might have underflowed, add last_end before
 		 * comparing.
 		 */
-		if (base + last_end < vmalloc_start + last_end) {
-			spin_unlock(&vmap_area_lock);
-			if (!purged) {
-				purge_vmap_area_lazy();
-				purged = true;
-				goto retry;
-			}
-			goto err_free;
-		}
+		if (base + last_end < vmalloc_start + last_end)
+			goto overflow;
+
+		/* No fitting base has been found */
+		if (!va)
+			goto overflow;
 
 		/*
-		 * If next overlaps, move base downwards so that it's
-		 * right below next and then recheck.
+		 * If the area goes past the end of the free block, move
+		 * base downwards and then recheck.
 		 */
-		if (next && next->va_start < base + end) {
-			base = pvm_determine_end(&next, &prev, align) - end;
+		if (base + end > va->va_end) {
+			base = pvm_determine_end_from_reverse(&va, align) - end;
 			term_area = area;
 			continue;
 		}
 
 		/*
-		 * If prev overlaps, shift down next and prev and move
-		 * base so that it's right below new next and then
-		 * recheck.
+		 * If the area starts below the free block, move base
+		 * below the previous free block and then recheck.
 		 */
-		if (prev && prev->va_end > base + start)  {
-			next = prev;
-			prev = node_to_va(rb_prev(&next->rb_node));
-			base = pvm_determine_end(&next, &prev, align) - end;
+		if (base + start < va->va_start) {
+			va = node_to_va(rb_prev(&va->rb_node));
+			base = pvm_determine_end_from_reverse(&va, align) - end;
 			term_area = area;
 			continue;
 		}
@@ -2589,22 +3242,37 @@ retry:
 		area = (area + nr_vms - 1) % nr_vms;
 		if (area == term_area)
 			break;
+
 		start = offsets[area];
 		end = start + sizes[area];
-		pvm_find_next_prev(base + end, &next, &prev);
+		va = pvm_find_va_enclose_addr(base + end);
 	}
-found:
-	/* we've found a fitting base, insert all va's */
+
+	/* we've found a fitting base, carve all va's out of the free tree */
 	for (area = 0; area < nr_vms; area++) {
-		struct vmap_area *va = vas[area];
+		start = base + offsets[area];
+		size = sizes[area];
 
-		va->va_start = base + offsets[area];
-		va->va_end = va->va_start + sizes[area];
-		__insert_vmap_area(va);
-	}
+		/* Failing any of these is a bug, but try to recover */
+		va = pvm_find_va_enclose_addr(start);
+		if (WARN_ON_ONCE(!va))
+			goto recovery;
 
-	vmap_area_pcpu_hole = base + offsets[last_area];
+		type = classify_va_fit_type(va, start, size);
+		if (WARN_ON_ONCE(type == NOTHING_FIT))
+			goto recovery;
 
+		if (unlikely(adjust_va_to_fit_type(va, start, size, type)))
+			goto recovery;
+
+		vas[area]->va_start = start;
+		vas[area]->va_end = start + size;
+	}
+	spin_unlock(&free_vmap_area_lock);
+
+	spin_lock(&vmap_area_lock);
+	for (area = 0; area < nr_vms; area++)
+		insert_vmap_area(vas[area], &vmap_area_root, &vmap_area_list);
 	spin_unlock(&vmap_area_lock);
 
 	/* insert all vm's */
@@ -2615,9 +3283,39 @@ found:
 	kfree(vas);
 	return vms;
 
+recovery:
+	/* Give back what was carved; the va's get merged and freed */
+	while (area--) {
+		merge_or_add_vmap_area(vas[area], &free_vmap_area_root,
+				       &free_vmap_area_list);
+		vas[area] = NULL;
+	}
+
+overflow:
+	spin_unlock(&free_vmap_area_lock);
+	if (!purged) {
+		vmap_pcp_drain_all();
+		purge_vmap_area_lazy();
+		purged = true;
+
+		for (area = 0; area < nr_vms; area++) {
+			if (vas[area])
+				continue;
+
+			vas[area] = kmem_cache_zalloc(vmap_area_cachep,
+						      GFP_KERNEL);
+			if (!vas[area])
+				goto err_free;
+		}
+
+		goto retry;
+	}
+
 err_free:
 	for (area = 0; area < nr_vms; area++) {
-		kfree(vas[area]);
+		if (vas[area])
+			kmem_cache_free(vmap_area_cachep, vas[area]);
+
 		kfree(vms[area]);
 	}
 err_free2:
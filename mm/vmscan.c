@@ -55,6 +55,10 @@
 
 #include <linux/swapops.h>
 #include <linux/balloon_compaction.h>
+#include <linux/migrate.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/psi.h>
 
 #include "internal.h"
 
@@ -96,6 +100,9 @@ struct scan_control {
 
 	unsigned int hibernation_mode:1;
 
+	/* Reclaim the pages rather than demote them to a slower node */
+	unsigned int no_demotion:1;
+
 	/* One of the zones is ready for compaction */
 	unsigned int compaction_ready:1;
 
@@ -918,8 +925,18 @@ static int __remove_mapping(struct address_space *mapping, struct page *page,
 
 	if (PageSwapCache(page)) {
 		swp_entry_t swap = { .val = page_private(page) };
+		void *shadow = NULL;
+
+		/*
+		 * Like for file cache below, remember a shadow entry in
+		 * the swap cache to detect refaults of anon pages.  It
+		 * has to be taken before mem_cgroup_swapout() moves the
+		 * charge away from the page.
+		 */
+		if (reclaimed)
+			shadow = workingset_eviction(mapping, page);
 		mem_cgroup_swapout(page, swap);
-		__delete_from_swap_cache(page);
+		__delete_from_swap_cache(page, shadow);
 		xa_unlock_irqrestore(&mapping->i_pages, flags);
 		put_swap_page(page, swap);
 	} else {
@@ -1087,6 +1104,148 @@ static void page_check_dirty_writeback(struct page *page,
 		mapping->a_ops->is_dirty_writeback(page, dirty, writeback);
 }
 
+static bool can_demote(int nid, struct scan_control *sc)
+{
+	if (!numa_demotion_enabled)
+		return false;
+	if (sc && sc->no_demotion)
+		return false;
+	/*
+	 * Demoted pages stay charged to the memcg, so they would count as
+	 * reclaimed without bringing the usage below the limit.
+	 */
+	if (sc && !global_reclaim(sc))
+		return false;
+
+	return next_demotion_node(nid) != NUMA_NO_NODE;
+}
+
+#if defined(CONFIG_MIGRATION) && defined(CONFIG_NUMA)
+/*
+ * Count @nr demotion candidates for @pgdat and tell whether the current
+ * one-second window has already seen more than
+ * vm.numa_demote_rate_limit_MBps of them.  Pages over the limit are
+ * reclaimed instead, so that a burst of reclaim doesn't flood the slower
+ * node.
+ */
+static bool numa_demotion_rate_limit(struct pglist_data *pgdat, int nr)
+{
+	unsigned long rate_limit, nr_cand, start;
+
+	rate_limit = (unsigned long)READ_ONCE(sysctl_numa_demote_rate_limit) <<
+		     (20 - PAGE_SHIFT);
+	mod_node_page_state(pgdat, PGDEMOTE_CANDIDATE, nr);
+	nr_cand = node_page_state(pgdat, PGDEMOTE_CANDIDATE);
+	start = READ_ONCE(pgdat->demote_rl_start);
+	if (time_after(jiffies, start + HZ) &&
+	    cmpxchg(&pgdat->demote_rl_start, start, jiffies) == start)
+		WRITE_ONCE(pgdat->demote_rl_nr_cand, nr_cand);
+
+	return nr_cand - READ_ONCE(pgdat->demote_rl_nr_cand) >= rate_limit;
+}
+#else
+static inline bool numa_demotion_rate_limit(struct pglist_data *pgdat, int nr)
+{
+	return false;
+}
+#endif
+
+/* Anon pages can leave the node through swap or through demotion */
+static bool can_reclaim_anon_pages(struct mem_cgroup *memcg, int nid,
+				   struct scan_control *sc)
+{
+	if (mem_cgroup_get_nr_swap_pages(memcg) > 0)
+		return true;
+
+	return can_demote(nid, sc);
+}
+
+struct demote_control {
+	int nid;
+	/* Base pages allocated on @nid and not handed back */
+	unsigned int nr_demoted;
+};
+
+static struct page *alloc_demote_page(struct page *page, unsigned long private)
+{
+	struct demote_control *dc = (struct demote_control *)private;
+	struct page *newpage;
+
+	/*
+	 * Don't reclaim on the target node from reclaim on this one, just
+	 * let its kswapd know; failing here leaves the page to be
+	 * reclaimed normally.
+	 */
+	if (PageTransHuge(page)) {
+		newpage = alloc_pages_node(dc->nid,
+				GFP_TRANSHUGE_LIGHT | __GFP_THISNODE,
+				HPAGE_PMD_ORDER);
+		if (newpage)
+			prep_transhuge_page(newpage);
+	} else {
+		newpage = alloc_pages_node(dc->nid,
+				(GFP_HIGHUSER_MOVABLE & ~__GFP_RECLAIM) |
+				__GFP_THISNODE | __GFP_NOWARN |
+				__GFP_NOMEMALLOC | __GFP_KSWAPD_RECLAIM, 0);
+	}
+
+	if (newpage)
+		dc->nr_demoted += hpage_nr_pages(newpage);
+	return newpage;
+}
+
+static void free_demote_page(struct page *page, unsigned long private)
+{
+	struct demote_control *dc = (struct demote_control *)private;
+
+	dc->nr_demoted -= hpage_nr_pages(page);
+	put_page(page);
+}
+
+/*
+ * Migrate the pages on @demote_pages to the next tier.  Pages that failed
+ * permanently are put back on the LRU by migrate_pages(), the ones that
+ * are left on the list can be retried for reclaim.  Returns the number of
+ * demoted pages.
+ */
+static unsigned int demote_page_list(struct list_head *demote_pages,
+				     struct pglist_data *pgdat)
+{
+	struct demote_control dc = {
+		.nid = next_demotion_node(pgdat->node_id),
+	};
+	struct page *page;
+
+	if (list_empty(demote_pages) || dc.nid == NUMA_NO_NODE)
+		return 0;
+
+	/*
+	 * migrate_pages() drops NR_ISOLATED for every page it is done with,
+	 * but our caller drops it for all the pages it isolated: account
+	 * them once more, and undo that for the pages that come back.
+	 */
+	list_for_each_entry(page, demote_pages, lru)
+		mod_node_page_state(pgdat, NR_ISOLATED_ANON +
+				    page_is_file_cache(page),
+				    hpage_nr_pages(page));
+
+	/* Demotion ignores all cpuset and mempolicy settings */
+	migrate_pages(demote_pages, alloc_demote_page, free_demote_page,
+		      (unsigned long)&dc, MIGRATE_ASYNC, MR_DEMOTION);
+
+	list_for_each_entry(page, demote_pages, lru)
+		mod_node_page_state(pgdat, NR_ISOLATED_ANON +
+				    page_is_file_cache(page),
+				    -hpage_nr_pages(page));
+
+	if (current_is_kswapd())
+		mod_node_page_state(pgdat, PGDEMOTE_KSWAPD, dc.nr_demoted);
+	else
+		mod_node_page_state(pgdat, PGDEMOTE_DIRECT, dc.nr_demoted);
+
+	return dc.nr_demoted;
+}
+
 /*
  * shrink_page_list() returns the number of reclaimed pages
  */
@@ -1099,6 +1258,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 {
 	LIST_HEAD(ret_pages);
 	LIST_HEAD(free_pages);
+	LIST_HEAD(demote_pages);
 	int pgactivate = 0;
 	unsigned nr_unqueued_dirty = 0;
 	unsigned nr_dirty = 0;
@@ -1108,9 +1268,12 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 	unsigned nr_immediate = 0;
 	unsigned nr_ref_keep = 0;
 	unsigned nr_unmap_fail = 0;
+	bool do_demote_pass;
 
 	cond_resched();
+	do_demote_pass = can_demote(pgdat->node_id, sc);
 
+retry:
 	while (!list_empty(page_list)) {
 		struct address_space *mapping;
 		struct page *page;
@@ -1261,6 +1424,20 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			; /* try to reclaim the page below */
 		}
 
+		/*
+		 * Before reclaiming the page, try to move it to the slower
+		 * node below this one.  Dirty file pages can't be migrated
+		 * asynchronously by every filesystem, leave them to writeback.
+		 */
+		if (do_demote_pass &&
+		    (thp_migration_supported() || !PageTransHuge(page)) &&
+		    !(page_is_file_cache(page) && PageDirty(page)) &&
+		    !numa_demotion_rate_limit(pgdat, hpage_nr_pages(page))) {
+			list_add(&page->lru, &demote_pages);
+			unlock_page(page);
+			continue;
+		}
+
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
@@ -1483,6 +1660,14 @@ keep:
 		VM_BUG_ON_PAGE(PageLRU(page) || PageUnevictable(page), page);
 	}
 
+	nr_reclaimed += demote_page_list(&demote_pages, pgdat);
+	/* Retry the pages that could not be demoted with normal reclaim */
+	if (!list_empty(&demote_pages)) {
+		list_splice_init(&demote_pages, page_list);
+		do_demote_pass = false;
+		goto retry;
+	}
+
 	mem_cgroup_uncharge_list(&free_pages);
 	try_to_unmap_flush();
 	free_unref_page_list(&free_pages);
@@ -1510,6 +1695,7 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 		.gfp_mask = GFP_KERNEL,
 		.priority = DEF_PRIORITY,
 		.may_unmap = 1,
+		.no_demotion = 1,
 	};
 	unsigned long ret;
 	struct page *page, *next;
@@ -1530,6 +1716,66 @@ unsigned long reclaim_clean_pages_from_list(struct zone *zone,
 	return ret;
 }
 
+static unsigned long reclaim_node_pages(struct list_head *page_list, int nid)
+{
+	struct reclaim_stat dummy_stat;
+	unsigned long nr_reclaimed;
+	struct page *page;
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.priority = DEF_PRIORITY,
+		.may_writepage = 1,
+		.may_unmap = 1,
+		.may_swap = 1,
+		.no_demotion = 1,
+	};
+
+	nr_reclaimed = shrink_page_list(page_list, NODE_DATA(nid), &sc, 0,
+					&dummy_stat, false);
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		list_del(&page->lru);
+		putback_lru_page(page);
+	}
+
+	return nr_reclaimed;
+}
+
+/*
+ * Reclaim a list of isolated pages, such as the pages of a range hinted
+ * with MADV_PAGEOUT, and put back the ones that could not be reclaimed.
+ * Returns the number of reclaimed pages.
+ */
+unsigned long reclaim_pages(struct list_head *page_list)
+{
+	int nid = -1;
+	unsigned long nr_reclaimed = 0;
+	LIST_HEAD(node_page_list);
+	struct page *page;
+
+	while (!list_empty(page_list)) {
+		page = lru_to_page(page_list);
+		if (nid == -1) {
+			nid = page_to_nid(page);
+			INIT_LIST_HEAD(&node_page_list);
+		}
+
+		if (nid == page_to_nid(page)) {
+			ClearPageActive(page);
+			list_move(&page->lru, &node_page_list);
+			continue;
+		}
+
+		nr_reclaimed += reclaim_node_pages(&node_page_list, nid);
+		nid = -1;
+	}
+
+	if (!list_empty(&node_page_list))
+		nr_reclaimed += reclaim_node_pages(&node_page_list, nid);
+
+	return nr_reclaimed;
+}
+
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
@@ -1730,6 +1976,435 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 	return nr_taken;
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-gen LRU: see struct lru_gen_struct.  When enabled, evictable pages
+ * live on the per-generation lists instead of the active/inactive lists and
+ * the functions below replace shrink_active_list() and isolate_lru_pages().
+ */
+DEFINE_STATIC_KEY_FALSE(lru_gen_key);
+
+/* all mm_structs that the aging walks, in the order they were created */
+static struct {
+	struct list_head fifo;
+	spinlock_t lock;
+} lru_gen_mm_list = {
+	.fifo = LIST_HEAD_INIT(lru_gen_mm_list.fifo),
+	.lock = __SPIN_LOCK_UNLOCKED(lru_gen_mm_list.lock),
+};
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_list.lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list.fifo);
+	spin_unlock(&lru_gen_mm_list.lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_list.lock);
+	list_del(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_list.lock);
+}
+
+void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	int gen, type, zone;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	lrugen->max_seq = MIN_NR_GENS;
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		lrugen->timestamps[gen] = jiffies;
+		for (type = 0; type < ANON_AND_FILE; type++)
+			for (zone = 0; zone < MAX_NR_ZONES; zone++)
+				INIT_LIST_HEAD(&lrugen->lists[gen][type][zone]);
+	}
+}
+
+static int get_nr_gens(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	return lrugen->max_seq - lrugen->min_seq[type] + 1;
+}
+
+static bool lru_gen_mm_eligible(struct mm_struct *mm, struct mem_cgroup *memcg)
+{
+	if (!memcg || mem_cgroup_is_root(memcg))
+		return true;
+
+	return mm_match_cgroup(mm, memcg);
+}
+
+static bool lru_gen_can_swap(struct mem_cgroup *memcg, struct scan_control *sc)
+{
+	return sc->may_swap && mem_cgroup_swappiness(memcg) &&
+	       mem_cgroup_get_nr_swap_pages(memcg) > 0;
+}
+
+/* Moves the pages of @type in @zone from @old_gen into @new_gen */
+static void lru_gen_move_zone(struct lruvec *lruvec, int type, int zone,
+			      int old_gen, int new_gen)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct list_head *head = &lrugen->lists[old_gen][type][zone];
+	long nr_pages = lrugen->nr_pages[old_gen][type][zone];
+	enum lru_list lru = type * LRU_FILE;
+	struct page *page;
+
+	list_for_each_entry(page, head, lru)
+		set_mask_bits(&page->flags, LRU_GEN_MASK,
+			      (new_gen + 1UL) << LRU_GEN_PGOFF);
+
+	/* older pages stay closer to the tail */
+	list_splice_tail_init(head, &lrugen->lists[new_gen][type][zone]);
+	lrugen->nr_pages[new_gen][type][zone] += nr_pages;
+	lrugen->nr_pages[old_gen][type][zone] = 0;
+
+	if (lru_gen_is_active(lruvec, old_gen) !=
+	    lru_gen_is_active(lruvec, new_gen)) {
+		update_lru_size(lruvec, lru + lru_gen_is_active(lruvec, old_gen),
+				zone, -nr_pages);
+		update_lru_size(lruvec, lru + lru_gen_is_active(lruvec, new_gen),
+				zone, nr_pages);
+	}
+}
+
+/*
+ * Moves the oldest generation of @type into the next one so that the aging
+ * can make room for a new generation.  Only used when all MAX_NR_GENS are
+ * in use, in which case both generations are inactive.
+ */
+static void inc_min_seq(struct lruvec *lruvec, int type)
+{
+	int zone;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int new_gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+
+	for (zone = 0; zone < MAX_NR_ZONES; zone++)
+		lru_gen_move_zone(lruvec, type, zone, old_gen, new_gen);
+
+	WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+}
+
+/* Retires the oldest generations of @type that have become empty */
+static bool try_to_inc_min_seq(struct lruvec *lruvec, int type)
+{
+	int zone;
+	bool success = false;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	while (get_nr_gens(lruvec, type) > MIN_NR_GENS) {
+		int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+			if (!list_empty(&lrugen->lists[gen][type][zone]))
+				return success;
+		}
+
+		WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+		success = true;
+	}
+
+	return success;
+}
+
+static void inc_max_seq(struct lruvec *lruvec)
+{
+	int prev, type, zone;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		if (get_nr_gens(lruvec, type) == MAX_NR_GENS)
+			inc_min_seq(lruvec, type);
+	}
+
+	/* the second youngest generation is about to become inactive */
+	prev = lru_gen_from_seq(lrugen->max_seq - 1);
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+			enum lru_list lru = type * LRU_FILE;
+			long delta = lrugen->nr_pages[prev][type][zone];
+
+			if (!delta)
+				continue;
+
+			update_lru_size(lruvec, lru + LRU_ACTIVE, zone, -delta);
+			update_lru_size(lruvec, lru, zone, delta);
+		}
+	}
+
+	WRITE_ONCE(lrugen->max_seq, lrugen->max_seq + 1);
+	lrugen->timestamps[lru_gen_from_seq(lrugen->max_seq)] = jiffies;
+}
+
+#define LRU_GEN_WALK_BATCH	32
+
+struct lru_gen_walk {
+	struct lruvec *lruvec;
+	struct pglist_data *pgdat;
+	/* the generation that young pages are moved into */
+	unsigned long max_seq;
+	bool can_swap;
+	int nr;
+	struct page *pages[LRU_GEN_WALK_BATCH];
+};
+
+/*
+ * Moves a batch of young pages into the youngest generation.  Called with the
+ * page table lock held, which keeps the pages from being freed.
+ */
+static void lru_gen_promote_batch(struct lru_gen_walk *walk)
+{
+	int i;
+	struct lruvec *lruvec = walk->lruvec;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int new_gen = lru_gen_from_seq(walk->max_seq);
+
+	if (!walk->nr)
+		return;
+
+	spin_lock_irq(&walk->pgdat->lru_lock);
+	for (i = 0; i < walk->nr && lrugen->max_seq == walk->max_seq; i++) {
+		struct page *page = walk->pages[i];
+		int old_gen = page_lru_gen(page);
+
+		if (!PageLRU(page) || old_gen < 0 || old_gen == new_gen ||
+		    mem_cgroup_page_lruvec(page, walk->pgdat) != lruvec)
+			continue;
+
+		lru_gen_update_size(lruvec, page, old_gen, new_gen);
+		set_mask_bits(&page->flags, LRU_GEN_MASK,
+			      (new_gen + 1UL) << LRU_GEN_PGOFF);
+		list_move(&page->lru, &lrugen->lists[new_gen]
+			  [page_is_file_cache(page)][page_zonenum(page)]);
+	}
+	spin_unlock_irq(&walk->pgdat->lru_lock);
+
+	walk->nr = 0;
+}
+
+static bool lru_gen_page_eligible(struct page *page, struct lru_gen_walk *walk)
+{
+	if (page_to_nid(page) != walk->pgdat->node_id)
+		return false;
+
+	if (!walk->can_swap && !page_is_file_cache(page))
+		return false;
+
+	return mem_cgroup_page_lruvec(page, walk->pgdat) == walk->lruvec;
+}
+
+static void lru_gen_walk_add(struct lru_gen_walk *walk, struct page *page)
+{
+	walk->pages[walk->nr++] = page;
+	if (walk->nr == LRU_GEN_WALK_BATCH)
+		lru_gen_promote_batch(walk);
+}
+
+static int lru_gen_walk_pmd_range(pmd_t *pmd, unsigned long addr,
+				  unsigned long end, struct mm_walk *mm_walk)
+{
+	struct lru_gen_walk *walk = mm_walk->private;
+	struct vm_area_struct *vma = mm_walk->vma;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		if (pmd_trans_huge(*pmd) && pmd_young(*pmd)) {
+			struct page *page = pmd_page(*pmd);
+
+			if (lru_gen_page_eligible(page, walk) &&
+			    pmdp_test_and_clear_young(vma, addr, pmd))
+				lru_gen_walk_add(walk, page);
+		}
+		lru_gen_promote_batch(walk);
+		spin_unlock(ptl);
+		return 0;
+	}
+#endif
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		struct page *page;
+
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page)
+			continue;
+
+		page = compound_head(page);
+		if (!lru_gen_page_eligible(page, walk))
+			continue;
+
+		if (ptep_test_and_clear_young(vma, addr, pte))
+			lru_gen_walk_add(walk, page);
+	}
+	lru_gen_promote_batch(walk);
+	pte_unmap_unlock(orig_pte, ptl);
+
+	cond_resched();
+	return 0;
+}
+
+static int lru_gen_walk_test(unsigned long start, unsigned long end,
+			     struct mm_walk *mm_walk)
+{
+	struct vm_area_struct *vma = mm_walk->vma;
+	struct lru_gen_walk *walk = mm_walk->private;
+
+	if (vma->vm_flags & (VM_LOCKED | VM_SPECIAL | VM_HUGETLB))
+		return 1;
+
+	/* anon pages cannot be reclaimed without swap */
+	if (!walk->can_swap && vma_is_anonymous(vma))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Harvests the accessed bit from the page tables of all mm_structs that
+ * belong to @memcg, moving young pages into the youngest generation, then
+ * creates a new generation.  Compared with page_referenced(), each page table
+ * is visited once per aging cycle and pages are moved in batches.
+ */
+static void lru_gen_age(struct lruvec *lruvec, struct mem_cgroup *memcg,
+			bool can_swap)
+{
+	struct mm_struct *mm, *prev = NULL;
+	struct list_head *pos;
+	struct lru_gen_walk walk = {
+		.lruvec = lruvec,
+		.pgdat = lruvec_pgdat(lruvec),
+		.max_seq = READ_ONCE(lruvec->lrugen.max_seq),
+		.can_swap = can_swap,
+	};
+	struct mm_walk mm_walk = {
+		.pmd_entry = lru_gen_walk_pmd_range,
+		.test_walk = lru_gen_walk_test,
+		.private = &walk,
+	};
+
+	spin_lock(&lru_gen_mm_list.lock);
+	pos = lru_gen_mm_list.fifo.next;
+	while (pos != &lru_gen_mm_list.fifo) {
+		mm = list_entry(pos, struct mm_struct, lru_gen_list);
+		pos = pos->next;
+
+		if (!lru_gen_mm_eligible(mm, memcg) || !mmget_not_zero(mm))
+			continue;
+
+		/* the reference keeps mm, and hence pos, on the list */
+		spin_unlock(&lru_gen_mm_list.lock);
+
+		if (prev)
+			mmput(prev);
+		prev = mm;
+
+		if (down_read_trylock(&mm->mmap_sem)) {
+			mm_walk.mm = mm;
+			walk_page_range(0, mm->highest_vm_end, &mm_walk);
+			up_read(&mm->mmap_sem);
+		}
+
+		cond_resched();
+		spin_lock(&lru_gen_mm_list.lock);
+		pos = mm->lru_gen_list.next;
+	}
+	spin_unlock(&lru_gen_mm_list.lock);
+
+	if (prev)
+		mmput(prev);
+
+	spin_lock_irq(&walk.pgdat->lru_lock);
+	/* another reclaimer may have finished the aging first */
+	if (lruvec->lrugen.max_seq == walk.max_seq)
+		inc_max_seq(lruvec);
+	spin_unlock_irq(&walk.pgdat->lru_lock);
+}
+
+/*
+ * The multi-gen counterpart of isolate_lru_pages(): takes pages of @type from
+ * the oldest generation, from the highest eligible zone down.  Must be called
+ * with the lru_lock held.
+ */
+static unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+		struct lruvec *lruvec, struct list_head *dst,
+		unsigned long *nr_scanned, struct scan_control *sc,
+		isolate_mode_t mode, int type)
+{
+	int zone;
+	unsigned long scan = 0;
+	unsigned long nr_taken = 0;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+
+	/* the two youngest generations are never evicted */
+	if (get_nr_gens(lruvec, type) <= MIN_NR_GENS)
+		goto done;
+
+	for (zone = sc->reclaim_idx; zone >= 0 && nr_taken < nr_to_scan; zone--) {
+		struct list_head *src = &lrugen->lists[gen][type][zone];
+
+		while (!list_empty(src) && scan < nr_to_scan &&
+		       nr_taken < nr_to_scan) {
+			struct page *page = lru_to_page(src);
+
+			prefetchw_prev_lru_page(page, src, flags);
+			VM_BUG_ON_PAGE(!PageLRU(page), page);
+
+			scan++;
+			if (__isolate_lru_page(page, mode)) {
+				/* else it is being freed elsewhere */
+				list_move(&page->lru, src);
+				continue;
+			}
+
+			nr_taken += hpage_nr_pages(page);
+			lru_gen_del_page(lruvec, page);
+			list_add(&page->lru, dst);
+		}
+	}
+
+	if (!nr_taken) {
+		int next = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+
+		/*
+		 * Whatever is left of the oldest generation may belong to zones
+		 * above sc->reclaim_idx, which this reclaim cannot take.  Age
+		 * those pages into the next generation so that min_seq can move
+		 * on to pages it can take, rather than stalling on them.
+		 */
+		for (zone = sc->reclaim_idx + 1; zone < MAX_NR_ZONES; zone++)
+			lru_gen_move_zone(lruvec, type, zone, gen, next);
+		try_to_inc_min_seq(lruvec, type);
+	}
+done:
+	*nr_scanned = scan;
+	return nr_taken;
+}
+
+#else /* !CONFIG_LRU_GEN */
+
+static unsigned long lru_gen_isolate_pages(unsigned long nr_to_scan,
+		struct lruvec *lruvec, struct list_head *dst,
+		unsigned long *nr_scanned, struct scan_control *sc,
+		isolate_mode_t mode, int type)
+{
+	return 0;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 /**
  * isolate_lru_page - tries to isolate a page from its LRU list
  * @page: page to isolate from its LRU list
@@ -1773,6 +2448,9 @@ int isolate_lru_page(struct page *page)
 			int lru = page_lru(page);
 			get_page(page);
 			ClearPageLRU(page);
+			/* keep the generation's activeness across the isolation */
+			if (lru_gen_page_active(lruvec, page))
+				SetPageActive(page);
 			del_page_from_lru_list(page, lruvec, lru);
 			ret = 0;
 		}
@@ -1851,6 +2529,7 @@ putback_inactive_pages(struct lruvec *lruvec, struct list_head *page_list)
 			int file = is_file_lru(lru);
 			int numpages = hpage_nr_pages(page);
 			reclaim_stat->recent_rotated[file] += numpages;
+			workingset_age_nonresident(lruvec, numpages);
 		}
 		if (put_page_testzero(page)) {
 			__ClearPageLRU(page);
@@ -1925,8 +2604,13 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 
 	spin_lock_irq(&pgdat->lru_lock);
 
-	nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &page_list,
-				     &nr_scanned, sc, isolate_mode, lru);
+	if (lru_gen_enabled())
+		nr_taken = lru_gen_isolate_pages(nr_to_scan, lruvec, &page_list,
+						 &nr_scanned, sc, isolate_mode,
+						 file);
+	else
+		nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &page_list,
+					     &nr_scanned, sc, isolate_mode, lru);
 
 	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + file, nr_taken);
 	reclaim_stat->recent_scanned[file] += nr_taken;
@@ -2039,8 +2723,8 @@ static unsigned move_active_pages_to_lru(struct lruvec *lruvec,
 		SetPageLRU(page);
 
 		nr_pages = hpage_nr_pages(page);
-		update_lru_size(lruvec, lru, page_zonenum(page), nr_pages);
-		list_move(&page->lru, &lruvec->lists[lru]);
+		list_del(&page->lru);
+		add_page_to_lru_list(page, lruvec, lru);
 
 		if (put_page_testzero(page)) {
 			__ClearPageLRU(page);
@@ -2208,10 +2892,11 @@ static bool inactive_list_is_low(struct lruvec *lruvec, bool file,
 	unsigned long gb;
 
 	/*
-	 * If we don't have swap space, anonymous page deactivation
-	 * is pointless.
+	 * If we don't have swap space or a node to demote to, anonymous
+	 * page deactivation is pointless.
 	 */
-	if (!file && !total_swap_pages)
+	if (!file && !total_swap_pages &&
+	    !can_demote(lruvec_pgdat(lruvec)->node_id, sc))
 		return false;
 
 	inactive = lruvec_lru_size(lruvec, inactive_lru, sc->reclaim_idx);
@@ -2222,8 +2907,9 @@ static bool inactive_list_is_low(struct lruvec *lruvec, bool file,
 	 * is being established. Disable active list protection to get
 	 * rid of the stale workingset quickly.
 	 */
-	refaults = lruvec_page_state(lruvec, WORKINGSET_ACTIVATE);
-	if (file && lruvec->refaults != refaults) {
+	refaults = lruvec_page_state(lruvec, file ? WORKINGSET_ACTIVATE :
+				     WORKINGSET_ACTIVATE_ANON);
+	if (lruvec->refaults[file] != refaults) {
 		inactive_ratio = 0;
 	} else {
 		gb = (inactive + active) >> (30 - PAGE_SHIFT);
@@ -2286,7 +2972,8 @@ static void get_scan_count(struct lruvec *lruvec, struct mem_cgroup *memcg,
 	enum lru_list lru;
 
 	/* If we have no swap space, do not bother scanning anon pages. */
-	if (!sc->may_swap || mem_cgroup_get_nr_swap_pages(memcg) <= 0) {
+	if (!sc->may_swap ||
+	    !can_reclaim_anon_pages(memcg, pgdat->node_id, sc)) {
 		scan_balance = SCAN_FILE;
 		goto out;
 	}
@@ -2470,6 +3157,100 @@ out:
 	}
 }
 
+#ifdef CONFIG_LRU_GEN
+/* Evicts the type whose oldest generation is older; file pages on ties */
+static int lru_gen_pick_type(struct lruvec *lruvec, bool can_swap)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	if (!can_swap)
+		return 1;
+
+	return READ_ONCE(lrugen->min_seq[1]) <= READ_ONCE(lrugen->min_seq[0]);
+}
+
+static unsigned long lru_gen_evictable_size(struct lruvec *lruvec,
+				struct scan_control *sc, bool can_swap)
+{
+	int gen, type, zone;
+	unsigned long size = 0;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	for (type = !can_swap; type < ANON_AND_FILE; type++) {
+		for (gen = 0; gen < MAX_NR_GENS; gen++) {
+			for (zone = 0; zone <= sc->reclaim_idx; zone++)
+				size += max(READ_ONCE(lrugen->nr_pages[gen][type][zone]), 0L);
+		}
+	}
+
+	return size;
+}
+
+/*
+ * The multi-gen counterpart of the list balancing below: ages the lruvec
+ * when only the two youngest generations are left, and otherwise evicts
+ * from the oldest generation through shrink_inactive_list().
+ */
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec, struct mem_cgroup *memcg,
+				  struct scan_control *sc, unsigned long *lru_pages)
+{
+	unsigned long nr_to_scan;
+	unsigned long nr_reclaimed = 0;
+	bool can_swap = lru_gen_can_swap(memcg, sc);
+	struct blk_plug plug;
+
+	*lru_pages = lru_gen_evictable_size(lruvec, sc, can_swap);
+	nr_to_scan = *lru_pages >> sc->priority;
+
+	blk_start_plug(&plug);
+	while (nr_to_scan) {
+		unsigned long batch = min(nr_to_scan, SWAP_CLUSTER_MAX);
+		int type = lru_gen_pick_type(lruvec, can_swap);
+
+		if (get_nr_gens(lruvec, type) <= MIN_NR_GENS)
+			lru_gen_age(lruvec, memcg, can_swap);
+
+		nr_reclaimed += shrink_inactive_list(batch, lruvec, sc,
+						     type * LRU_FILE);
+		nr_to_scan -= batch;
+
+		if (nr_reclaimed >= sc->nr_to_reclaim)
+			break;
+
+		cond_resched();
+	}
+	blk_finish_plug(&plug);
+	sc->nr_reclaimed += nr_reclaimed;
+}
+
+/* kswapd keeps a generation ready for eviction, like age_active_anon() */
+static void lru_gen_age_node(struct pglist_data *pgdat, struct scan_control *sc)
+{
+	struct mem_cgroup *memcg;
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
+		bool can_swap = lru_gen_can_swap(memcg, sc);
+
+		if (get_nr_gens(lruvec, lru_gen_pick_type(lruvec, can_swap)) <=
+		    MIN_NR_GENS)
+			lru_gen_age(lruvec, memcg, can_swap);
+
+		memcg = mem_cgroup_iter(NULL, memcg, NULL);
+	} while (memcg);
+}
+#else
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec, struct mem_cgroup *memcg,
+				  struct scan_control *sc, unsigned long *lru_pages)
+{
+}
+
+static void lru_gen_age_node(struct pglist_data *pgdat, struct scan_control *sc)
+{
+}
+#endif /* CONFIG_LRU_GEN */
+
 /*
  * This is a basic per-node page freer.  Used by both kswapd and direct reclaim.
  */
@@ -2486,6 +3267,11 @@ static void shrink_node_memcg(struct pglist_data *pgdat, struct mem_cgroup *memc
 	struct blk_plug plug;
 	bool scan_adjusted;
 
+	if (lru_gen_enabled()) {
+		lru_gen_shrink_lruvec(lruvec, memcg, sc, lru_pages);
+		return;
+	}
+
 	get_scan_count(lruvec, memcg, sc, nr, lru_pages);
 
 	/* Record the original scan target for proportional adjustments later */
@@ -2979,12 +3765,13 @@ static void snapshot_refaults(struct mem_cgroup *root_memcg, pg_data_t *pgdat)
 
 	memcg = mem_cgroup_iter(root_memcg, NULL, NULL);
 	do {
-		unsigned long refaults;
 		struct lruvec *lruvec;
 
 		lruvec = mem_cgroup_lruvec(pgdat, memcg);
-		refaults = lruvec_page_state(lruvec, WORKINGSET_ACTIVATE);
-		lruvec->refaults = refaults;
+		lruvec->refaults[0] = lruvec_page_state(lruvec,
+						WORKINGSET_ACTIVATE_ANON);
+		lruvec->refaults[1] = lruvec_page_state(lruvec,
+						WORKINGSET_ACTIVATE);
 	} while ((memcg = mem_cgroup_iter(root_memcg, memcg, NULL)));
 }
 
@@ -3291,6 +4078,7 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 	struct zonelist *zonelist;
 	unsigned long nr_reclaimed;
 	int nid;
+	unsigned long pflags;
 	unsigned int noreclaim_flag;
 	struct scan_control sc = {
 		.nr_to_reclaim = max(nr_pages, SWAP_CLUSTER_MAX),
@@ -3318,9 +4106,13 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 					    sc.gfp_mask,
 					    sc.reclaim_idx);
 
+	psi_memstall_enter(&pflags);
 	noreclaim_flag = memalloc_noreclaim_save();
+
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
+
 	memalloc_noreclaim_restore(noreclaim_flag);
+	psi_memstall_leave(&pflags);
 
 	trace_mm_vmscan_memcg_reclaim_end(nr_reclaimed);
 
@@ -3333,7 +4125,12 @@ static void age_active_anon(struct pglist_data *pgdat,
 {
 	struct mem_cgroup *memcg;
 
-	if (!total_swap_pages)
+	if (lru_gen_enabled()) {
+		lru_gen_age_node(pgdat, sc);
+		return;
+	}
+
+	if (!total_swap_pages && !can_demote(pgdat->node_id, sc))
 		return;
 
 	memcg = mem_cgroup_iter(NULL, NULL, NULL);
@@ -3486,6 +4283,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 	unsigned long nr_soft_reclaimed;
 	unsigned long nr_soft_scanned;
 	struct zone *zone;
+	unsigned long pflags;
 	struct scan_control sc = {
 		.gfp_mask = GFP_KERNEL,
 		.order = order,
@@ -3495,6 +4293,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 		.may_swap = 1,
 	};
 
+	psi_memstall_enter(&pflags);
 	__fs_reclaim_acquire();
 
 	count_vm_event(PAGEOUTRUN);
@@ -3596,6 +4395,7 @@ static int balance_pgdat(pg_data_t *pgdat, int order, int classzone_idx)
 out:
 	snapshot_refaults(NULL, pgdat);
 	__fs_reclaim_release();
+	psi_memstall_leave(&pflags);
 	/*
 	 * Return the order kswapd stopped reclaiming at as
 	 * prepare_kswapd_sleep() takes it into account. If another caller
@@ -4204,3 +5004,247 @@ void check_move_unevictable_pages(struct page **pages, int nr_pages)
 	}
 }
 #endif /* CONFIG_SHMEM */
+
+#ifdef CONFIG_LRU_GEN
+static DEFINE_MUTEX(lru_gen_state_mutex);
+
+/* Moves at most MAX_LRU_BATCH pages; returns true when the lruvec is done */
+#define MAX_LRU_BATCH	(SWAP_CLUSTER_MAX * 8)
+
+static bool lru_gen_fill_lruvec(struct lruvec *lruvec)
+{
+	enum lru_list lru;
+	int remaining = MAX_LRU_BATCH;
+
+	for_each_evictable_lru(lru) {
+		struct list_head *head = &lruvec->lists[lru];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+
+			/* PG_active picks the youngest generation */
+			del_page_from_lru_list(page, lruvec, lru);
+			add_page_to_lru_list(page, lruvec, lru);
+
+			if (!--remaining)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static bool lru_gen_drain_lruvec(struct lruvec *lruvec)
+{
+	int gen, type, zone;
+	int remaining = MAX_LRU_BATCH;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		for (type = 0; type < ANON_AND_FILE; type++) {
+			for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+				struct list_head *head = &lrugen->lists[gen][type][zone];
+
+				while (!list_empty(head)) {
+					struct page *page = lru_to_page(head);
+					bool active = lru_gen_is_active(lruvec, gen);
+
+					del_page_from_lru_list(page, lruvec,
+							       page_lru(page));
+					if (active)
+						SetPageActive(page);
+					add_page_to_lru_list(page, lruvec,
+							     page_lru(page));
+
+					if (!--remaining)
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Flips the static key first so that pages added from now on go to the new
+ * lists, then moves the existing pages over in batches, dropping the lru_lock
+ * in between.
+ */
+static void lru_gen_change_state(bool enable)
+{
+	int nid;
+	struct mem_cgroup *memcg;
+
+	mutex_lock(&lru_gen_state_mutex);
+
+	if (enable == lru_gen_enabled())
+		goto unlock;
+
+	if (enable)
+		static_branch_enable(&lru_gen_key);
+	else
+		static_branch_disable(&lru_gen_key);
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		for_each_node(nid) {
+			struct pglist_data *pgdat = NODE_DATA(nid);
+			struct lruvec *lruvec = mem_cgroup_lruvec(pgdat, memcg);
+			bool done;
+
+			if (!pgdat)
+				continue;
+
+			do {
+				spin_lock_irq(&pgdat->lru_lock);
+				if (enable)
+					done = lru_gen_fill_lruvec(lruvec);
+				else
+					done = lru_gen_drain_lruvec(lruvec);
+				spin_unlock_irq(&pgdat->lru_lock);
+
+				cond_resched();
+			} while (!done);
+		}
+
+		memcg = mem_cgroup_iter(NULL, memcg, NULL);
+	} while (memcg);
+unlock:
+	mutex_unlock(&lru_gen_state_mutex);
+}
+
+static ssize_t lru_gen_enabled_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", lru_gen_enabled());
+}
+
+static ssize_t lru_gen_enabled_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	bool enable;
+	int err;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return err;
+
+	lru_gen_change_state(enable);
+
+	return count;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, lru_gen_enabled_show, lru_gen_enabled_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group lru_gen_attr_group = {
+	.name = "lru_gen",
+	.attrs = lru_gen_attrs,
+};
+
+#ifdef CONFIG_DEBUG_FS
+static void lru_gen_show_memcg(struct seq_file *m, struct mem_cgroup *memcg,
+			       char *path)
+{
+	int nid;
+
+#ifdef CONFIG_MEMCG
+	if (memcg)
+		cgroup_path(memcg->css.cgroup, path, PATH_MAX);
+	else
+#endif
+		strcpy(path, "/");
+
+	seq_printf(m, "memcg %5hu %s\n", memcg ? mem_cgroup_id(memcg) : 0, path);
+
+	for_each_node_state(nid, N_MEMORY) {
+		struct lruvec *lruvec = mem_cgroup_lruvec(NODE_DATA(nid), memcg);
+		struct lru_gen_struct *lrugen = &lruvec->lrugen;
+		unsigned long max_seq = READ_ONCE(lrugen->max_seq);
+		unsigned long min_seq = min(READ_ONCE(lrugen->min_seq[0]),
+					    READ_ONCE(lrugen->min_seq[1]));
+		unsigned long seq;
+
+		seq_printf(m, " node %5d\n", nid);
+
+		for (seq = min_seq; seq <= max_seq; seq++) {
+			int type, zone;
+			int gen = lru_gen_from_seq(seq);
+			unsigned long birth = READ_ONCE(lrugen->timestamps[gen]);
+
+			seq_printf(m, " %10lu %10u", seq,
+				   jiffies_to_msecs(jiffies - birth));
+
+			for (type = 0; type < ANON_AND_FILE; type++) {
+				long size = 0;
+
+				if (seq >= READ_ONCE(lrugen->min_seq[type])) {
+					for (zone = 0; zone < MAX_NR_ZONES; zone++)
+						size += READ_ONCE(lrugen->nr_pages[gen][type][zone]);
+				}
+				seq_printf(m, " %10ld%c", max(size, 0L),
+					   type ? 'F' : 'A');
+			}
+			seq_putc(m, '\n');
+		}
+	}
+}
+
+/*
+ * Lists each memcg and node, followed by one line per generation:
+ *   seq  age_in_ms  nr_anon_pages  nr_file_pages
+ */
+static int lru_gen_debugfs_show(struct seq_file *m, void *v)
+{
+	struct mem_cgroup *memcg;
+	char *path;
+
+	path = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		lru_gen_show_memcg(m, memcg, path);
+		memcg = mem_cgroup_iter(NULL, memcg, NULL);
+	} while (memcg);
+
+	kfree(path);
+	return 0;
+}
+
+static int lru_gen_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, lru_gen_debugfs_show, NULL);
+}
+
+static const struct file_operations lru_gen_debugfs_fops = {
+	.open		= lru_gen_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif /* CONFIG_DEBUG_FS */
+
+static int __init lru_gen_init(void)
+{
+	if (IS_ENABLED(CONFIG_LRU_GEN_ENABLED))
+		lru_gen_change_state(true);
+
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		pr_err("lru_gen: failed to create sysfs group\n");
+
+#ifdef CONFIG_DEBUG_FS
+	debugfs_create_file("lru_gen", 0444, NULL, NULL, &lru_gen_debugfs_fops);
+#endif
+	return 0;
+}
+late_initcall(lru_gen_init);
+#endif /* CONFIG_LRU_GEN */
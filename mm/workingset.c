@@ -6,6 +6,7 @@
  */
 
 #include <linux/memcontrol.h>
+#include <linux/mm_inline.h>
 #include <linux/writeback.h>
 #include <linux/shmem_fs.h>
 #include <linux/pagemap.h>
@@ -19,13 +20,13 @@
 /*
  *		Double CLOCK lists
  *
- * Per node, two clock lists are maintained for file pages: the
- * inactive and the active list.  Freshly faulted pages start out at
- * the head of the inactive list and page reclaim scans pages from the
- * tail.  Pages that are accessed multiple times on the inactive list
- * are promoted to the active list, to protect them from reclaim,
- * whereas active pages are demoted to the inactive list when the
- * active list grows too big.
+ * Per node, two clock lists are maintained for file pages and for
+ * anonymous pages: the inactive and the active list.  Freshly faulted
+ * pages start out at the head of the inactive list and page reclaim
+ * scans pages from the tail.  Pages that are accessed multiple times
+ * on the inactive list are promoted to the active list, to protect
+ * them from reclaim, whereas active pages are demoted to the inactive
+ * list when the active list grows too big.
  *
  *   fault ------------------------+
  *                                 |
@@ -142,10 +143,22 @@
  * and the used pages get to stay in cache.
  *
  *
+ *		Refaulting anonymous pages
+ *
+ * Anonymous pages are evicted to swap, and the swap cache keeps their
+ * shadow entries until the swap slot is freed.  Their refault
+ * distance competes with the whole file cache and the active anon
+ * list: a thrashing anon page can only stay resident at the expense
+ * of file pages or other anon pages.  Likewise, when swap is
+ * available, refaulting file pages also compete with anon pages.
+ * The activations this causes feed the per-type rotation statistics
+ * that balance scanning between the anon and file lists.
+ *
+ *
  *		Implementation
  *
- * For each node's file LRU lists, a counter for inactive evictions
- * and activations is maintained (node->inactive_age).
+ * For each node's LRU lists, a counter for inactive evictions and
+ * activations is maintained (lruvec->inactive_age).
  *
  * On eviction, a snapshot of this counter (along with some bits to
  * identify the node) is stored in the now empty page cache radix tree
@@ -197,13 +210,28 @@ static void unpack_shadow(void *shadow, int *memcgidp, pg_data_t **pgdat,
 	*evictionp = entry << bucket_order;
 }
 
+/**
+ * workingset_age_nonresident - age non-resident entries as LRU ages
+ * @lruvec: the lruvec that was aged
+ * @nr_pages: the number of pages to count
+ *
+ * As in-memory pages are aged, non-resident pages need to be aged as
+ * well, in the namespace of the lruvec that the pages were evicted
+ * from.
+ */
+void workingset_age_nonresident(struct lruvec *lruvec, unsigned long nr_pages)
+{
+	atomic_long_add(nr_pages, &lruvec->inactive_age);
+}
+
 /**
  * workingset_eviction - note the eviction of a page from memory
  * @mapping: address space the page was backing
  * @page: the page being evicted
  *
  * Returns a shadow entry to be stored in @mapping->i_pages in place
- * of the evicted @page so that a later refault can be detected.
+ * of the evicted @page so that a later refault can be detected.  For
+ * anonymous pages, @mapping is the swap address space of the slot.
  */
 void *workingset_eviction(struct address_space *mapping, struct page *page)
 {
@@ -225,6 +253,7 @@ void *workingset_eviction(struct address_space *mapping, struct page *page)
 
 /**
  * workingset_refault - evaluate the refault of a previously evicted page
+ * @page: the freshly allocated replacement page
  * @shadow: shadow entry of the evicted page
  *
  * Calculates and evaluates the refault distance of the previously
@@ -232,10 +261,11 @@ void *workingset_eviction(struct address_space *mapping, struct page *page)
  *
  * Returns %true if the page should be activated, %false otherwise.
  */
-bool workingset_refault(void *shadow)
+bool workingset_refault(struct page *page, void *shadow)
 {
+	bool file = page_is_file_cache(page);
+	unsigned long workingset_size;
 	unsigned long refault_distance;
-	unsigned long active_file;
 	struct mem_cgroup *memcg;
 	unsigned long eviction;
 	struct lruvec *lruvec;
@@ -269,7 +299,6 @@ bool workingset_refault(void *shadow)
 	}
 	lruvec = mem_cgroup_lruvec(pgdat, memcg);
 	refault = atomic_long_read(&lruvec->inactive_age);
-	active_file = lruvec_lru_size(lruvec, LRU_ACTIVE_FILE, MAX_NR_ZONES);
 
 	/*
 	 * The unsigned subtraction here gives an accurate distance
@@ -289,10 +318,31 @@ bool workingset_refault(void *shadow)
 	 */
 	refault_distance = (refault - eviction) & EVICTION_MASK;
 
-	inc_lruvec_state(lruvec, WORKINGSET_REFAULT);
+	inc_lruvec_state(lruvec, file ? WORKINGSET_REFAULT :
+			 WORKINGSET_REFAULT_ANON);
 
-	if (refault_distance <= active_file) {
-		inc_lruvec_state(lruvec, WORKINGSET_ACTIVATE);
+	/*
+	 * Compare the distance to the existing workingset size.  A
+	 * refaulting anon page competes with the whole file cache and
+	 * the active anon pages.  File pages can only push out anon
+	 * pages when there is swap to put them in.
+	 */
+	workingset_size = lruvec_lru_size(lruvec, LRU_ACTIVE_FILE,
+					  MAX_NR_ZONES);
+	if (!file)
+		workingset_size += lruvec_lru_size(lruvec, LRU_INACTIVE_FILE,
+						   MAX_NR_ZONES);
+	if (total_swap_pages > 0) {
+		workingset_size += lruvec_lru_size(lruvec, LRU_ACTIVE_ANON,
+						   MAX_NR_ZONES);
+		if (file)
+			workingset_size += lruvec_lru_size(lruvec,
+						LRU_INACTIVE_ANON, MAX_NR_ZONES);
+	}
+
+	if (refault_distance <= workingset_size) {
+		inc_lruvec_state(lruvec, file ? WORKINGSET_ACTIVATE :
+				 WORKINGSET_ACTIVATE_ANON);
 		rcu_read_unlock();
 		return true;
 	}
@@ -321,7 +371,7 @@ void workingset_activation(struct page *page)
 	if (!mem_cgroup_disabled() && !memcg)
 		goto out;
 	lruvec = mem_cgroup_lruvec(page_pgdat(page), memcg);
-	atomic_long_inc(&lruvec->inactive_age);
+	workingset_age_nonresident(lruvec, hpage_nr_pages(page));
 out:
 	rcu_read_unlock();
 }
@@ -376,7 +426,9 @@ static unsigned long count_shadow_nodes(struct shrinker *shrinker,
 	 *
 	 * The size of the active list converges toward 100% of
 	 * overall page cache as memory grows, with only a tiny
-	 * inactive list. Assume the total cache size for that.
+	 * inactive list. Assume the total cache size for that, and
+	 * include anon pages when their shadows can be kept in the
+	 * swap cache.
 	 *
 	 * Nodes might be sparsely populated, with only one shadow
 	 * entry in the extreme case. Obviously, we cannot keep one
@@ -393,9 +445,17 @@ static unsigned long count_shadow_nodes(struct shrinker *shrinker,
 	if (sc->memcg) {
 		cache = mem_cgroup_node_nr_lru_pages(sc->memcg, sc->nid,
 						     LRU_ALL_FILE);
+		if (total_swap_pages > 0)
+			cache += mem_cgroup_node_nr_lru_pages(sc->memcg,
+							sc->nid, LRU_ALL_ANON);
 	} else {
-		cache = node_page_state(NODE_DATA(sc->nid), NR_ACTIVE_FILE) +
-			node_page_state(NODE_DATA(sc->nid), NR_INACTIVE_FILE);
+		pg_data_t *pgdat = NODE_DATA(sc->nid);
+
+		cache = node_page_state(pgdat, NR_ACTIVE_FILE) +
+			node_page_state(pgdat, NR_INACTIVE_FILE);
+		if (total_swap_pages > 0)
+			cache += node_page_state(pgdat, NR_ACTIVE_ANON) +
+				 node_page_state(pgdat, NR_INACTIVE_ANON);
 	}
 	max_nodes = cache >> (RADIX_TREE_MAP_SHIFT - 3);
 
@@ -467,7 +527,7 @@ static enum lru_status shadow_lru_isolate(struct list_head *item,
 	}
 	if (WARN_ON_ONCE(node->exceptional))
 		goto out_invalid;
-	inc_lruvec_page_state(virt_to_page(node), WORKINGSET_NODERECLAIM);
+	__inc_lruvec_slab_state(node, WORKINGSET_NODERECLAIM);
 	__radix_tree_delete_node(&mapping->i_pages, node,
 				 workingset_lookup_update(mapping));
 
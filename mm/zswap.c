@@ -35,6 +35,8 @@
 #include <linux/crypto.h>
 #include <linux/mempool.h>
 #include <linux/zpool.h>
+#include <linux/memcontrol.h>
+#include <linux/workqueue.h>
 
 #include <linux/mm_types.h>
 #include <linux/page-flags.h>
@@ -61,10 +63,12 @@ static atomic_t zswap_same_filled_pages = ATOMIC_INIT(0);
 
 /* Pool limit was hit (see zswap_max_pool_percent) */
 static u64 zswap_pool_limit_hit;
-/* Pages written back when pool limit was reached */
+/* Pages written back when pool limit was reached or by the shrinker */
 static u64 zswap_written_back_pages;
-/* Store failed due to a reclaim failure after pool limit was reached */
+/* Background writeback failed to free space in the pool */
 static u64 zswap_reject_reclaim_fail;
+/* Store failed because the memcg reached its memory.zswap.max */
+static u64 zswap_reject_memcg_limit;
 /* Compressed page was too big for the allocator to (optimally) store */
 static u64 zswap_reject_compress_poor;
 /* Store failed because underlying allocator could not get memory */
@@ -118,6 +122,18 @@ module_param_cb(zpool, &zswap_zpool_param_ops, &zswap_zpool_type, 0644);
 static unsigned int zswap_max_pool_percent = 20;
 module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
 
+/*
+ * Once the pool got full, stores are rejected until background writeback
+ * took it below this percentage of max_pool_percent
+ */
+static unsigned int zswap_accept_thr_percent = 90;
+module_param_named(accept_threshold_percent, zswap_accept_thr_percent,
+		   uint, 0644);
+
+/* Let memory reclaim write back the oldest entries of each memcg */
+static bool zswap_shrinker_enabled = true;
+module_param_named(shrinker_enabled, zswap_shrinker_enabled, bool, 0644);
+
 /* Enable/disable handling same-value filled pages (enabled by default) */
 static bool zswap_same_filled_pages_enabled = true;
 module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
@@ -132,7 +148,8 @@ struct zswap_pool {
 	struct crypto_comp * __percpu *tfm;
 	struct kref kref;
 	struct list_head list;
-	struct work_struct work;
+	struct work_struct release_work;
+	struct work_struct shrink_work;
 	struct hlist_node node;
 	char tfm_name[CRYPTO_MAX_ALG_NAME];
 };
@@ -145,6 +162,10 @@ struct zswap_pool {
  *
  * rbnode - links the entry into red-black tree for the appropriate swap type
  * offset - the swap offset for the entry.  Index into the red-black tree.
+ * type - the swap type of the entry, for writing it back from the lru
+ * lru - links the entry into the lru of its memcg, oldest first.  Entries
+ *       of same-value filled pages are not on any lru.
+ * memcg - the memcg the entry is charged to, NULL for the root memcg
  * refcount - the number of outstanding reference to the entry. This is needed
  *            to protect against premature freeing of the entry by code
  *            concurrent calls to load, invalidate, and writeback.  The lock
@@ -160,6 +181,9 @@ struct zswap_pool {
 struct zswap_entry {
 	struct rb_node rbnode;
 	pgoff_t offset;
+	unsigned int type;
+	struct list_head lru;
+	struct mem_cgroup *memcg;
 	int refcount;
 	unsigned int length;
 	struct zswap_pool *pool;
@@ -201,6 +225,18 @@ static bool zswap_init_failed;
 /* init completed, but couldn't create the initial pool */
 static bool zswap_has_pool;
 
+/* the pool got full, reject stores until it is below the accept threshold */
+static bool zswap_pool_reached_full;
+
+static struct workqueue_struct *shrink_wq;
+
+/* Entries of the root memcg, or of all pages without memcg */
+static struct zswap_lru zswap_lru = {
+	.list = LIST_HEAD_INIT(zswap_lru.list),
+};
+/* protects the lrus, their counts and entry->lru */
+static DEFINE_SPINLOCK(zswap_lru_lock);
+
 /*********************************
 * helpers and fwd declarations
 **********************************/
@@ -210,6 +246,7 @@ static bool zswap_has_pool;
 		 zpool_get_type((p)->zpool))
 
 static int zswap_writeback_entry(struct zpool *pool, unsigned long handle);
+static void shrink_worker(struct work_struct *w);
 static int zswap_pool_get(struct zswap_pool *pool);
 static void zswap_pool_put(struct zswap_pool *pool);
 
@@ -223,6 +260,13 @@ static bool zswap_is_full(void)
 		DIV_ROUND_UP(zswap_pool_total_size, PAGE_SIZE);
 }
 
+static bool zswap_can_accept(void)
+{
+	return totalram_pages * zswap_accept_thr_percent / 100 *
+				zswap_max_pool_percent / 100 >
+			DIV_ROUND_UP(zswap_pool_total_size, PAGE_SIZE);
+}
+
 static void zswap_update_total_size(void)
 {
 	struct zswap_pool *pool;
@@ -261,6 +305,8 @@ static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
 	if (!entry)
 		return NULL;
 	entry->refcount = 1;
+	entry->memcg = NULL;
+	INIT_LIST_HEAD(&entry->lru);
 	RB_CLEAR_NODE(&entry->rbnode);
 	return entry;
 }
@@ -270,6 +316,95 @@ static void zswap_entry_cache_free(struct zswap_entry *entry)
 	kmem_cache_free(zswap_entry_cache, entry);
 }
 
+/*********************************
+* memcg and lru functions
+**********************************/
+static struct shrinker zswap_shrinker;
+
+#ifdef CONFIG_MEMCG
+/* Returns the memcg @page is charged to, with a reference, or NULL */
+static struct mem_cgroup *zswap_get_page_memcg(struct page *page)
+{
+	struct mem_cgroup *memcg = page->mem_cgroup;
+
+	if (mem_cgroup_disabled() || !memcg || mem_cgroup_is_root(memcg))
+		return NULL;
+
+	css_get(&memcg->css);
+	return memcg;
+}
+
+static void zswap_put_memcg(struct mem_cgroup *memcg)
+{
+	if (memcg)
+		css_put(&memcg->css);
+}
+
+static struct zswap_lru *zswap_memcg_lru(struct mem_cgroup *memcg)
+{
+	if (!memcg || mem_cgroup_is_root(memcg))
+		return &zswap_lru;
+	return &memcg->zswap_lru;
+}
+
+static void zswap_memcg_charge(struct zswap_entry *entry)
+{
+	if (entry->memcg)
+		mem_cgroup_charge_zswap(entry->memcg, entry->length);
+}
+
+static void zswap_memcg_uncharge(struct zswap_entry *entry)
+{
+	if (entry->memcg) {
+		mem_cgroup_uncharge_zswap(entry->memcg, entry->length);
+		zswap_put_memcg(entry->memcg);
+	}
+}
+#else
+static struct mem_cgroup *zswap_get_page_memcg(struct page *page)
+{
+	return NULL;
+}
+
+static void zswap_put_memcg(struct mem_cgroup *memcg) { }
+
+static struct zswap_lru *zswap_memcg_lru(struct mem_cgroup *memcg)
+{
+	return &zswap_lru;
+}
+
+static void zswap_memcg_charge(struct zswap_entry *entry) { }
+static void zswap_memcg_uncharge(struct zswap_entry *entry) { }
+#endif
+
+/* caller must hold the tree lock, so that the entry can't be freed */
+static void zswap_lru_add(struct zswap_entry *entry, int nid)
+{
+	struct zswap_lru *lru = zswap_memcg_lru(entry->memcg);
+
+	spin_lock(&zswap_lru_lock);
+	list_add_tail(&entry->lru, &lru->list);
+	lru->nr++;
+	spin_unlock(&zswap_lru_lock);
+
+#ifdef CONFIG_MEMCG_KMEM
+	if (entry->memcg)
+		memcg_set_shrinker_bit(entry->memcg, nid, zswap_shrinker.id);
+#endif
+}
+
+static void zswap_lru_del(struct zswap_entry *entry)
+{
+	struct zswap_lru *lru = zswap_memcg_lru(entry->memcg);
+
+	spin_lock(&zswap_lru_lock);
+	if (!list_empty(&entry->lru)) {
+		list_del_init(&entry->lru);
+		lru->nr--;
+	}
+	spin_unlock(&zswap_lru_lock);
+}
+
 /*********************************
 * rbtree functions
 **********************************/
@@ -326,11 +461,14 @@ static void zswap_rb_erase(struct rb_root *root, struct zswap_entry *entry)
 }
 
 /*
- * Carries out the common pattern of freeing and entry's zpool allocation,
- * freeing the entry itself, and decrementing the number of stored pages.
+ * Carries out the common pattern of taking an entry off its lru, uncharging
+ * it from its memcg, freeing the entry's zpool allocation, freeing the
+ * entry itself, and decrementing the number of stored pages.
  */
 static void zswap_free_entry(struct zswap_entry *entry)
 {
+	zswap_lru_del(entry);
+	zswap_memcg_uncharge(entry);
 	if (!entry->length)
 		atomic_dec(&zswap_same_filled_pages);
 	else {
@@ -560,6 +698,7 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	 */
 	kref_init(&pool->kref);
 	INIT_LIST_HEAD(&pool->list);
+	INIT_WORK(&pool->shrink_work, shrink_worker);
 
 	zswap_pool_debug("created", pool);
 
@@ -633,7 +772,8 @@ static int __must_check zswap_pool_get(struct zswap_pool *pool)
 
 static void __zswap_pool_release(struct work_struct *work)
 {
-	struct zswap_pool *pool = container_of(work, typeof(*pool), work);
+	struct zswap_pool *pool = container_of(work, typeof(*pool),
+						release_work);
 
 	synchronize_rcu();
 
@@ -656,8 +796,8 @@ static void __zswap_pool_empty(struct kref *kref)
 
 	list_del_rcu(&pool->list);
 
-	INIT_WORK(&pool->work, __zswap_pool_release);
-	schedule_work(&pool->work);
+	INIT_WORK(&pool->release_work, __zswap_pool_release);
+	schedule_work(&pool->release_work);
 
 	spin_unlock(&zswap_pools_lock);
 }
@@ -846,10 +986,8 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
  * the swap cache, the compressed version stored by zswap can be
  * freed.
  */
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+static int zswap_writeback_swpentry(swp_entry_t swpentry)
 {
-	struct zswap_header *zhdr;
-	swp_entry_t swpentry;
 	struct zswap_tree *tree;
 	pgoff_t offset;
 	struct zswap_entry *entry;
@@ -862,12 +1000,10 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 		.sync_mode = WB_SYNC_NONE,
 	};
 
-	/* extract swpentry from data */
-	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
-	swpentry = zhdr->swpentry; /* here */
-	zpool_unmap_handle(pool, handle);
 	tree = zswap_trees[swp_type(swpentry)];
 	offset = swp_offset(swpentry);
+	if (!tree)
+		return -ENOENT;
 
 	/* find and ref zswap entry */
 	spin_lock(&tree->lock);
@@ -895,8 +1031,10 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	case ZSWAP_SWAPCACHE_NEW: /* page is locked */
 		/* decompress */
 		dlen = PAGE_SIZE;
-		src = (u8 *)zpool_map_handle(entry->pool->zpool, entry->handle,
-				ZPOOL_MM_RO) + sizeof(struct zswap_header);
+		src = zpool_map_handle(entry->pool->zpool, entry->handle,
+				       ZPOOL_MM_RO);
+		if (zpool_evictable(entry->pool->zpool))
+			src += sizeof(struct zswap_header);
 		dst = kmap_atomic(page);
 		tfm = *get_cpu_ptr(entry->pool->tfm);
 		ret = crypto_comp_decompress(tfm, src, entry->length,
@@ -952,22 +1090,134 @@ end:
 	return ret;
 }
 
-static int zswap_shrink(void)
+/* zpool evict callback, used by zpool_shrink() */
+static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 {
-	struct zswap_pool *pool;
-	int ret;
+	struct zswap_header *zhdr;
+	swp_entry_t swpentry;
 
-	pool = zswap_pool_last_get();
-	if (!pool)
+	/* extract swpentry from data */
+	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
+	swpentry = zhdr->swpentry; /* here */
+	zpool_unmap_handle(pool, handle);
+
+	return zswap_writeback_swpentry(swpentry);
+}
+
+/*
+ * Write back the oldest entry on @lru.  It is rotated to the tail first,
+ * so that an entry that can't be written back right now doesn't keep the
+ * ones behind it from being tried.
+ */
+static int zswap_writeback_oldest(struct zswap_lru *lru)
+{
+	struct zswap_entry *entry;
+	swp_entry_t swpentry;
+
+	spin_lock(&zswap_lru_lock);
+	if (list_empty(&lru->list)) {
+		spin_unlock(&zswap_lru_lock);
 		return -ENOENT;
+	}
+	entry = list_first_entry(&lru->list, struct zswap_entry, lru);
+	list_move_tail(&entry->lru, &lru->list);
+	swpentry = swp_entry(entry->type, entry->offset);
+	spin_unlock(&zswap_lru_lock);
+
+	return zswap_writeback_swpentry(swpentry);
+}
 
-	ret = zpool_shrink(pool->zpool, 1, NULL);
+#define ZSWAP_SHRINK_RETRIES 16
 
+/*
+ * Background writeback.  Queued when the pool hits max_pool_percent, it
+ * writes back the oldest entry of each memcg's lru in turn until the pool
+ * is below the accept threshold again, so that stores never wait for
+ * writeback themselves.  Going through the lrus rather than zpool_shrink()
+ * works whatever the zpool, zsmalloc included.
+ */
+static void shrink_worker(struct work_struct *w)
+{
+	struct zswap_pool *pool = container_of(w, typeof(*pool),
+						shrink_work);
+	struct mem_cgroup *memcg;
+	int ret, failures = 0;
+	bool progress;
+
+	do {
+		progress = false;
+		/* NULL when memcg is off, which is the global lru */
+		memcg = mem_cgroup_iter(NULL, NULL, NULL);
+		do {
+			ret = zswap_writeback_oldest(zswap_memcg_lru(memcg));
+			if (!ret)
+				progress = true;
+			else if (ret != -ENOENT)
+				zswap_reject_reclaim_fail++;
+			cond_resched();
+
+			if (zswap_can_accept()) {
+				mem_cgroup_iter_break(NULL, memcg);
+				goto out;
+			}
+			memcg = mem_cgroup_iter(NULL, memcg, NULL);
+		} while (memcg);
+
+		/* a whole round over the lrus without writing anything back */
+		if (!progress && ++failures == ZSWAP_SHRINK_RETRIES)
+			break;
+	} while (!zswap_can_accept());
+out:
 	zswap_pool_put(pool);
+}
 
-	return ret;
+static unsigned long zswap_shrinker_count(struct shrinker *shrinker,
+					  struct shrink_control *sc)
+{
+	struct zswap_lru *lru = zswap_memcg_lru(sc->memcg);
+	unsigned long nr = READ_ONCE(lru->nr);
+
+	if (!zswap_shrinker_enabled)
+		return 0;
+
+	return nr ? nr : SHRINK_EMPTY;
 }
 
+/*
+ * Memory reclaim of a memcg writes back that memcg's oldest entries, which
+ * works whatever the zpool and keeps one memcg's pressure from evicting
+ * the compressed pages of the others.
+ */
+static unsigned long zswap_shrinker_scan(struct shrinker *shrinker,
+					 struct shrink_control *sc)
+{
+	struct zswap_lru *lru = zswap_memcg_lru(sc->memcg);
+	unsigned long i, freed = 0;
+	int ret;
+
+	/* Writeback submits swap IO */
+	if (!(sc->gfp_mask & __GFP_IO))
+		return SHRINK_STOP;
+
+	for (i = 0; i < sc->nr_to_scan; i++) {
+		ret = zswap_writeback_oldest(lru);
+		if (ret == -ENOENT)
+			break;
+		if (!ret)
+			freed++;
+		cond_resched();
+	}
+
+	return freed;
+}
+
+static struct shrinker zswap_shrinker = {
+	.count_objects = zswap_shrinker_count,
+	.scan_objects = zswap_shrinker_scan,
+	.seeks = DEFAULT_SEEKS,
+	.flags = SHRINKER_MEMCG_AWARE,
+};
+
 static int zswap_is_page_same_filled(void *ptr, unsigned long *value)
 {
 	unsigned int pos;
@@ -999,6 +1249,8 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 {
 	struct zswap_tree *tree = zswap_trees[type];
 	struct zswap_entry *entry, *dupentry;
+	struct mem_cgroup *memcg = NULL;
+	struct zswap_pool *pool;
 	struct crypto_comp *tfm;
 	int ret;
 	unsigned int hlen, dlen = PAGE_SIZE;
@@ -1018,23 +1270,28 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto reject;
 	}
 
-	/* reclaim space if needed */
+	/*
+	 * Reclaim space in the background if needed.  Once the pool got
+	 * full, keep rejecting until writeback took it below the accept
+	 * threshold, rather than flapping around max_pool_percent.
+	 */
 	if (zswap_is_full()) {
 		zswap_pool_limit_hit++;
-		if (zswap_shrink()) {
-			zswap_reject_reclaim_fail++;
-			ret = -ENOMEM;
-			goto reject;
-		}
+		zswap_pool_reached_full = true;
+		goto shrink;
+	}
 
-		/* A second zswap_is_full() check after
-		 * zswap_shrink() to make sure it's now
-		 * under the max_pool_percent
-		 */
-		if (zswap_is_full()) {
-			ret = -ENOMEM;
-			goto reject;
-		}
+	if (zswap_pool_reached_full) {
+		if (!zswap_can_accept())
+			goto shrink;
+		zswap_pool_reached_full = false;
+	}
+
+	memcg = zswap_get_page_memcg(page);
+	if (memcg && !mem_cgroup_may_zswap(memcg)) {
+		zswap_reject_memcg_limit++;
+		ret = -ENOMEM;
+		goto reject;
 	}
 
 	/* allocate entry */
@@ -1102,6 +1359,10 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	entry->length = dlen;
 
 insert_entry:
+	entry->type = type;
+	entry->memcg = memcg;
+	zswap_memcg_charge(entry);
+
 	/* map */
 	spin_lock(&tree->lock);
 	do {
@@ -1113,6 +1374,8 @@ insert_entry:
 			zswap_entry_put(tree, dupentry);
 		}
 	} while (ret == -EEXIST);
+	if (entry->length)
+		zswap_lru_add(entry, page_to_nid(page));
 	spin_unlock(&tree->lock);
 
 	/* update stats */
@@ -1127,7 +1390,15 @@ put_dstmem:
 freepage:
 	zswap_entry_cache_free(entry);
 reject:
+	zswap_put_memcg(memcg);
 	return ret;
+
+shrink:
+	pool = zswap_pool_last_get();
+	if (pool && !queue_work(shrink_wq, &pool->shrink_work))
+		zswap_pool_put(pool);
+	ret = -ENOMEM;
+	goto reject;
 }
 
 /*
@@ -1269,6 +1540,8 @@ static int __init zswap_debugfs_init(void)
 			   zswap_debugfs_root, &zswap_pool_limit_hit);
 	debugfs_create_u64("reject_reclaim_fail", 0444,
 			   zswap_debugfs_root, &zswap_reject_reclaim_fail);
+	debugfs_create_u64("reject_memcg_limit", 0444,
+			   zswap_debugfs_root, &zswap_reject_memcg_limit);
 	debugfs_create_u64("reject_alloc_fail", 0444,
 			   zswap_debugfs_root, &zswap_reject_alloc_fail);
 	debugfs_create_u64("reject_kmemcache_fail", 0444,
@@ -1331,6 +1604,11 @@ static int __init init_zswap(void)
 	if (ret)
 		goto hp_fail;
 
+	shrink_wq = alloc_workqueue("zswap-shrink",
+				    WQ_UNBOUND | WQ_MEM_RECLAIM, 1);
+	if (!shrink_wq)
+		goto wq_fail;
+
 	pool = __zswap_pool_create_fallback();
 	if (pool) {
 		pr_info("loaded using pool %s/%s\n", pool->tfm_name,
@@ -1343,10 +1621,14 @@ static int __init init_zswap(void)
 	}
 
 	frontswap_register_ops(&zswap_frontswap_ops);
+	if (register_shrinker(&zswap_shrinker))
+		pr_warn("shrinker registration failed\n");
 	if (zswap_debugfs_init())
 		pr_warn("debugfs initialization failed\n");
 	return 0;
 
+wq_fail:
+	cpuhp_remove_multi_state(CPUHP_MM_ZSWP_POOL_PREPARE);
 hp_fail:
 	cpuhp_remove_state(CPUHP_MM_ZSWP_MEM_PREPARE);
 dstmem_fail:
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Monitor this process with the data access monitor while it keeps
+ * touching a small buffer and leaves a big one alone, and check that the
+ * monitored regions tell the two apart.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../kselftest.h"
+
+#define DAMON_DIR	"/sys/kernel/debug/damon/"
+#define HOT_SIZE	(16UL << 20)
+#define COLD_SIZE	(256UL << 20)
+#define RUN_SECONDS	5
+
+static int write_file(const char *name, const char *val)
+{
+	FILE *f = fopen(name, "w");
+	int ret;
+
+	if (!f)
+		return -1;
+	ret = fputs(val, f) < 0 ? -1 : 0;
+	if (fclose(f))
+		ret = -1;
+	return ret;
+}
+
+/* Size weighted average accesses of the regions within [start, end) */
+static double avg_accesses(FILE *f, unsigned long start, unsigned long end)
+{
+	unsigned long rstart, rend, sz, total = 0;
+	unsigned int accesses, age;
+	double sum = 0;
+	char line[256];
+
+	rewind(f);
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lx-%lx %u %u",
+			   &rstart, &rend, &accesses, &age) != 4)
+			continue;
+		if (rend <= start || end <= rstart)
+			continue;
+		if (rstart < start)
+			rstart = start;
+		if (rend > end)
+			rend = end;
+		sz = rend - rstart;
+		sum += (double)accesses * sz;
+		total += sz;
+	}
+
+	return total ? sum / total : -1;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long page_size = sysconf(_SC_PAGESIZE);
+	char *hot, *cold, buf[64];
+	double hot_acc, cold_acc;
+	unsigned long i;
+	time_t end;
+	FILE *f;
+	int ret = 0;
+
+	if (access(DAMON_DIR "monitor_on", W_OK)) {
+		printf("damon debugfs interface is not available, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	hot = mmap(NULL, HOT_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	cold = mmap(NULL, COLD_SIZE, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (hot == MAP_FAILED || cold == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	if (write_file(DAMON_DIR "attrs", "5000 100000 1000000 10 1000")) {
+		perror("damon attrs");
+		return 1;
+	}
+	snprintf(buf, sizeof(buf), "%d", getpid());
+	if (write_file(DAMON_DIR "target_ids", buf) ||
+	    write_file(DAMON_DIR "monitor_on", "on")) {
+		perror("damon start");
+		return 1;
+	}
+
+	end = time(NULL) + RUN_SECONDS;
+	while (time(NULL) < end)
+		for (i = 0; i < HOT_SIZE; i += page_size)
+			hot[i]++;
+
+	f = fopen(DAMON_DIR "regions", "r");
+	if (!f) {
+		perror("damon regions");
+		ret = 1;
+		goto out;
+	}
+	hot_acc = avg_accesses(f, (unsigned long)hot,
+			       (unsigned long)hot + HOT_SIZE);
+	cold_acc = avg_accesses(f, (unsigned long)cold,
+				(unsigned long)cold + COLD_SIZE);
+	fclose(f);
+
+	printf("average accesses: hot %.2f, cold %.2f\n", hot_acc, cold_acc);
+	if (hot_acc < 0 || cold_acc < 0 || hot_acc <= cold_acc) {
+		printf("hot and cold memory not told apart\n");
+		ret = 1;
+	}
+
+out:
+	write_file(DAMON_DIR "monitor_on", "off");
+	return ret;
+}
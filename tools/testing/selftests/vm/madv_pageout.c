@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Check that MADV_COLD keeps the pages of a range resident and that
+ * MADV_PAGEOUT reclaims them right away.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+
+#include "../kselftest.h"
+
+#ifndef MADV_COLD
+#define MADV_COLD	20
+#endif
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT	21
+#endif
+
+#define FILE_SIZE	(16UL << 20)
+
+static unsigned long nr_resident(char *p, unsigned long size,
+				 unsigned long page_size)
+{
+	unsigned long i, nr = 0, nr_pages = size / page_size;
+	unsigned char *vec = malloc(nr_pages);
+
+	if (!vec || mincore(p, size, vec)) {
+		perror("mincore");
+		exit(1);
+	}
+	for (i = 0; i < nr_pages; i++)
+		nr += vec[i] & 1;
+	free(vec);
+
+	return nr;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long page_size = sysconf(_SC_PAGESIZE);
+	unsigned long nr_pages = FILE_SIZE / page_size, nr, i;
+	char path[] = "madv_pageout.XXXXXX";
+	struct statfs sfs;
+	char *buf, *p;
+	int fd;
+
+	/* /tmp is often tmpfs, whose pages can only go to swap */
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	unlink(path);
+
+	if (fstatfs(fd, &sfs)) {
+		perror("fstatfs");
+		return 1;
+	}
+	if (sfs.f_type == TMPFS_MAGIC || sfs.f_type == RAMFS_MAGIC) {
+		printf("Cannot page out files in the current directory, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	buf = malloc(FILE_SIZE);
+	if (!buf) {
+		perror("malloc");
+		return 1;
+	}
+	memset(buf, 'x', FILE_SIZE);
+	if (write(fd, buf, FILE_SIZE) != FILE_SIZE || fsync(fd)) {
+		perror("write");
+		return 1;
+	}
+	free(buf);
+
+	p = mmap(NULL, FILE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	for (i = 0; i < FILE_SIZE; i += page_size)
+		((volatile char *)p)[i];
+
+	if (madvise(p, FILE_SIZE, MADV_COLD)) {
+		if (errno == EINVAL) {
+			printf("MADV_COLD is not supported, skipping\n");
+			return KSFT_SKIP;
+		}
+		perror("madvise(MADV_COLD)");
+		return 1;
+	}
+	nr = nr_resident(p, FILE_SIZE, page_size);
+	printf("MADV_COLD: %lu of %lu pages resident\n", nr, nr_pages);
+	if (nr != nr_pages) {
+		printf("MADV_COLD dropped pages\n");
+		return 1;
+	}
+
+	if (madvise(p, FILE_SIZE, MADV_PAGEOUT)) {
+		perror("madvise(MADV_PAGEOUT)");
+		return 1;
+	}
+	nr = nr_resident(p, FILE_SIZE, page_size);
+	printf("MADV_PAGEOUT: %lu of %lu pages resident\n", nr, nr_pages);
+	/* Allow for pages that were busy when reclaim got to them */
+	if (nr > nr_pages / 10) {
+		printf("MADV_PAGEOUT left too many pages resident\n");
+		return 1;
+	}
+
+	munmap(p, FILE_SIZE);
+	close(fd);
+	return 0;
+}
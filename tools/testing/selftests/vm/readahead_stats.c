@@ -0,0 +1,122 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Read a cold file sequentially and check the readahead state reported in
+ * its fdinfo: the window must not shrink, and readahead must have been
+ * found ahead of the reader.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define FILE_SIZE	(64UL << 20)
+#define CHUNK_SIZE	(64UL << 10)
+
+struct ra_info {
+	unsigned int pages;
+	unsigned int hits;
+	unsigned int misses;
+};
+
+static int read_ra_info(int fd, struct ra_info *ra)
+{
+	char path[64], line[128];
+	int found = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", fd);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+	while (fgets(line, sizeof(line), f)) {
+		found += sscanf(line, "ra_pages: %u", &ra->pages);
+		found += sscanf(line, "ra_hits: %u", &ra->hits);
+		found += sscanf(line, "ra_misses: %u", &ra->misses);
+	}
+	fclose(f);
+
+	return found == 3 ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+	char path[] = "./readahead_stats.XXXXXX";
+	struct ra_info before, after;
+	unsigned long off;
+	char *buf;
+	int fd;
+
+	/* tmpfs has no readahead, so default to the current directory */
+	if (argc > 1 && chdir(argv[1])) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	unlink(path);
+
+	buf = malloc(CHUNK_SIZE);
+	if (!buf) {
+		perror("malloc");
+		return 1;
+	}
+	memset(buf, 'x', CHUNK_SIZE);
+	for (off = 0; off < FILE_SIZE; off += CHUNK_SIZE) {
+		if (write(fd, buf, CHUNK_SIZE) != CHUNK_SIZE) {
+			perror("write");
+			return 1;
+		}
+	}
+	if (fsync(fd) || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED)) {
+		perror("fsync");
+		return 1;
+	}
+
+	if (read_ra_info(fd, &before)) {
+		printf("fdinfo has no readahead state, skipping\n");
+		return KSFT_SKIP;
+	}
+	if (!before.pages) {
+		printf("no readahead on this filesystem, skipping\n");
+		return KSFT_SKIP;
+	}
+
+	if (lseek(fd, 0, SEEK_SET)) {
+		perror("lseek");
+		return 1;
+	}
+	for (off = 0; off < FILE_SIZE; off += CHUNK_SIZE) {
+		if (read(fd, buf, CHUNK_SIZE) != CHUNK_SIZE) {
+			perror("read");
+			return 1;
+		}
+	}
+
+	read_ra_info(fd, &after);
+	printf("ra_pages %u -> %u, hits %u, misses %u\n", before.pages,
+	       after.pages, after.hits - before.hits,
+	       after.misses - before.misses);
+
+	if (after.pages < before.pages) {
+		printf("readahead window shrank on a sequential read\n");
+		return 1;
+	}
+	if (after.hits == before.hits) {
+		printf("readahead never ran ahead of the reader\n");
+		return 1;
+	}
+
+	free(buf);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,77 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Run the vmalloc stress test module, lib/test_vmalloc.c, and show the
+# allocation rates it reports.
+#
+# usage: test_vmalloc.sh [smoke|performance|stress] [module params...]
+#
+#  smoke        few allocations on every CPU, a quick sanity check
+#  performance  the default loop count on every CPU, then on one CPU,
+#               to see how the allocator scales
+#  stress       many more allocations on every CPU
+#
+# Extra arguments are passed to modprobe, e.g. run_test_mask=8.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+DRIVER="test_vmalloc"
+
+check_test_requirements()
+{
+	if [ "$(id -u)" -ne 0 ]; then
+		echo "$0: Must be run as root"
+		exit $ksft_skip
+	fi
+
+	if ! which modprobe > /dev/null 2>&1; then
+		echo "$0: You need modprobe installed"
+		exit $ksft_skip
+	fi
+
+	if ! modinfo $DRIVER > /dev/null 2>&1; then
+		echo "$0: You must have the following enabled in your kernel:"
+		echo "CONFIG_TEST_VMALLOC=m"
+		exit $ksft_skip
+	fi
+}
+
+# The module does all of its work on load and stays loaded
+run_test()
+{
+	modprobe -r $DRIVER > /dev/null 2>&1
+	echo "Run $DRIVER $*"
+	if ! modprobe $DRIVER "$@"; then
+		echo "[FAIL]"
+		exitcode=1
+	fi
+	modprobe -r $DRIVER > /dev/null 2>&1
+}
+
+check_test_requirements
+
+mode=${1:-performance}
+[ $# -gt 0 ] && shift
+exitcode=0
+
+dmesg -C > /dev/null 2>&1
+case "$mode" in
+smoke)
+	run_test test_loop_count=1000 "$@"
+	;;
+performance)
+	run_test "$@"
+	run_test nr_threads=1 "$@"
+	;;
+stress)
+	run_test test_loop_count=1000000 "$@"
+	;;
+*)
+	echo "usage: $0 [smoke|performance|stress] [module params...]"
+	exit 1
+	;;
+esac
+dmesg | grep "$DRIVER:"
+
+exit $exitcode
@@ -253,8 +253,10 @@ static struct uffd_test_ops shmem_uffd_test_ops = {
 	.alias_mapping = noop_alias_mapping,
 };
 
+/* UFFDIO_CONTINUE is only reported for ranges registered for minor faults */
 static struct uffd_test_ops hugetlb_uffd_test_ops = {
-	.expected_ioctls = UFFD_API_RANGE_IOCTLS_BASIC,
+	.expected_ioctls = UFFD_API_RANGE_IOCTLS_BASIC &
+			   ~((__u64)1 << _UFFDIO_CONTINUE),
 	.allocate_area	= hugetlb_allocate_area,
 	.release_pages	= hugetlb_release_pages,
 	.alias_mapping = hugetlb_alias_mapping,
@@ -439,6 +441,36 @@ static int copy_page(int ufd, unsigned long offset)
 	return __copy_page(ufd, offset, false);
 }
 
+static void wp_range(int ufd, __u64 start, __u64 len, bool wp)
+{
+	struct uffdio_writeprotect prms;
+
+	prms.range.start = start;
+	prms.range.len = len;
+	/* Undo write-protect, do wakeup after that */
+	prms.mode = wp ? UFFDIO_WRITEPROTECT_MODE_WP : 0;
+
+	if (ioctl(ufd, UFFDIO_WRITEPROTECT, &prms))
+		fprintf(stderr, "UFFDIO_WRITEPROTECT failed %Lx %Lx\n",
+			start, len), exit(1);
+}
+
+static void continue_range(int ufd, __u64 start, __u64 len)
+{
+	struct uffdio_continue req;
+
+	req.range.start = start;
+	req.range.len = len;
+	req.mode = 0;
+
+	if (ioctl(ufd, UFFDIO_CONTINUE, &req))
+		fprintf(stderr, "UFFDIO_CONTINUE failed for address 0x%Lx\n",
+			start), exit(1);
+	if (req.mapped != len)
+		fprintf(stderr, "UFFDIO_CONTINUE unexpected mapped %Ld\n",
+			req.mapped), exit(1);
+}
+
 static void *uffd_poll_thread(void *arg)
 {
 	unsigned long cpu = (unsigned long) arg;
@@ -482,11 +514,26 @@ static void *uffd_poll_thread(void *arg)
 				msg.event), exit(1);
 			break;
 		case UFFD_EVENT_PAGEFAULT:
-			if (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE)
-				fprintf(stderr, "unexpected write fault\n"), exit(1);
 			offset = (char *)(unsigned long)msg.arg.pagefault.address -
 				area_dst;
 			offset &= ~(page_size-1);
+			if (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WP) {
+				/* Write protect page faults */
+				wp_range(uffd, (unsigned long)area_dst + offset,
+					 page_size, false);
+				userfaults++;
+				break;
+			}
+			if (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_MINOR) {
+				/* The page is in the page cache: just map it */
+				continue_range(uffd,
+					       (unsigned long)area_dst + offset,
+					       page_size);
+				userfaults++;
+				break;
+			}
+			if (msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_WRITE)
+				fprintf(stderr, "unexpected write fault\n"), exit(1);
 			if (copy_page(uffd, offset))
 				userfaults++;
 			break;
@@ -1010,6 +1057,168 @@ static int userfaultfd_sig_test(void)
 	close(uffd);
 	return userfaults != 0;
 }
+/*
+ * Exercise UFFDIO_REGISTER_MODE_WP on anonymous memory: fill the area
+ * with write-protected UFFDIO_COPYs, write to every page, then protect
+ * it again with UFFDIO_WRITEPROTECT and write once more.  Every write
+ * must be reported as a write-protect fault and resolved by the
+ * monitor thread.
+ */
+static int userfaultfd_wp_test(void)
+{
+	struct uffdio_register uffdio_register;
+	struct uffdio_copy uffdio_copy;
+	unsigned long userfaults, nr, round;
+	pthread_t uffd_mon;
+	char c;
+
+	if (test_type != TEST_ANON)
+		return 0;
+
+	printf("testing write-protect faults: ");
+	fflush(stdout);
+
+	if (uffd_test_ops->release_pages(area_dst))
+		return 1;
+
+	if (userfaultfd_open(UFFD_FEATURE_PAGEFAULT_FLAG_WP) < 0)
+		return 1;
+	fcntl(uffd, F_SETFL, uffd_flags | O_NONBLOCK);
+
+	uffdio_register.range.start = (unsigned long) area_dst;
+	uffdio_register.range.len = nr_pages * page_size;
+	uffdio_register.mode = UFFDIO_REGISTER_MODE_MISSING |
+		UFFDIO_REGISTER_MODE_WP;
+	if (ioctl(uffd, UFFDIO_REGISTER, &uffdio_register)) {
+		if (errno != EINVAL)
+			fprintf(stderr, "register failure\n"), exit(1);
+		close(uffd);
+		printf("skipped, not supported.\n");
+		return 0;
+	}
+
+	if (!(uffdio_register.ioctls & ((__u64)1 << _UFFDIO_WRITEPROTECT)))
+		fprintf(stderr,
+			"unexpected missing UFFDIO_WRITEPROTECT ioctl\n"),
+			exit(1);
+
+	for (nr = 0; nr < nr_pages; nr++) {
+		uffdio_copy.dst = (unsigned long) area_dst + nr * page_size;
+		uffdio_copy.src = (unsigned long) area_src + nr * page_size;
+		uffdio_copy.len = page_size;
+		uffdio_copy.mode = UFFDIO_COPY_MODE_WP;
+		uffdio_copy.copy = 0;
+		if (ioctl(uffd, UFFDIO_COPY, &uffdio_copy) ||
+		    uffdio_copy.copy != page_size)
+			fprintf(stderr, "UFFDIO_COPY_MODE_WP error %Ld\n",
+				uffdio_copy.copy), exit(1);
+	}
+
+	if (pthread_create(&uffd_mon, &attr, uffd_poll_thread, NULL))
+		perror("uffd_poll_thread create"), exit(1);
+
+	for (round = 0; round < 2; round++) {
+		if (round)
+			wp_range(uffd, (unsigned long) area_dst,
+				 nr_pages * page_size, true);
+		for (nr = 0; nr < nr_pages; nr++)
+			*area_count(area_dst, nr) = round;
+	}
+
+	if (write(pipefd[1], &c, sizeof(c)) != sizeof(c))
+		perror("pipe write"), exit(1);
+	if (pthread_join(uffd_mon, (void **)&userfaults))
+		return 1;
+
+	close(uffd);
+	printf("userfaults: %ld\n", userfaults);
+
+	return userfaults != 2 * nr_pages;
+}
+
+/*
+ * Exercise UFFDIO_REGISTER_MODE_MINOR: populate the page cache through
+ * a second, unregistered mapping of the same file, then read every page
+ * through the registered one.  Each read must be reported as a minor
+ * fault and resolved with UFFDIO_CONTINUE, and must then see the data
+ * written through the alias.
+ */
+static int userfaultfd_minor_test(void)
+{
+	struct uffdio_register uffdio_register;
+	unsigned long userfaults, nr;
+	pthread_t uffd_mon;
+	char *alias;
+	int features;
+	char c;
+
+	if (test_type == TEST_SHMEM) {
+		/* a zero old_size mremap() duplicates a shared mapping */
+		alias = mremap(area_dst, 0, nr_pages * page_size,
+			       MREMAP_MAYMOVE);
+		if (alias == MAP_FAILED)
+			perror("mremap"), exit(1);
+		features = UFFD_FEATURE_MINOR_SHMEM;
+	} else if (test_type == TEST_HUGETLB && map_shared) {
+		alias = area_dst_alias;
+		features = UFFD_FEATURE_MINOR_HUGETLBFS;
+	} else {
+		return 0;
+	}
+
+	printf("testing minor faults: ");
+	fflush(stdout);
+
+	if (uffd_test_ops->release_pages(area_dst))
+		return 1;
+
+	if (userfaultfd_open(features) < 0)
+		return 1;
+	fcntl(uffd, F_SETFL, uffd_flags | O_NONBLOCK);
+
+	uffdio_register.range.start = (unsigned long) area_dst;
+	uffdio_register.range.len = nr_pages * page_size;
+	uffdio_register.mode = UFFDIO_REGISTER_MODE_MINOR;
+	if (ioctl(uffd, UFFDIO_REGISTER, &uffdio_register)) {
+		if (errno != EINVAL)
+			fprintf(stderr, "register failure\n"), exit(1);
+		close(uffd);
+		printf("skipped, not supported.\n");
+		goto out;
+	}
+
+	if (!(uffdio_register.ioctls & ((__u64)1 << _UFFDIO_CONTINUE)))
+		fprintf(stderr,
+			"unexpected missing UFFDIO_CONTINUE ioctl\n"),
+			exit(1);
+
+	for (nr = 0; nr < nr_pages; nr++)
+		*area_count(alias, nr) = nr;
+
+	if (pthread_create(&uffd_mon, &attr, uffd_poll_thread, NULL))
+		perror("uffd_poll_thread create"), exit(1);
+
+	for (nr = 0; nr < nr_pages; nr++)
+		if (*area_count(area_dst, nr) != nr)
+			fprintf(stderr, "nr %lu memory corruption %Lu\n",
+				nr, *area_count(area_dst, nr)), exit(1);
+
+	if (write(pipefd[1], &c, sizeof(c)) != sizeof(c))
+		perror("pipe write"), exit(1);
+	if (pthread_join(uffd_mon, (void **)&userfaults))
+		return 1;
+
+	close(uffd);
+	printf("userfaults: %ld\n", userfaults);
+	if (userfaults != nr_pages)
+		return 1;
+out:
+	if (test_type == TEST_SHMEM &&
+	    munmap(alias, nr_pages * page_size))
+		perror("munmap"), exit(1);
+	return 0;
+}
+
 static int userfaultfd_stress(void)
 {
 	void *area;
@@ -1200,7 +1409,8 @@ static int userfaultfd_stress(void)
 
 	close(uffd);
 	return userfaultfd_zeropage_test() || userfaultfd_sig_test()
-		|| userfaultfd_events_test();
+		|| userfaultfd_events_test() || userfaultfd_wp_test()
+		|| userfaultfd_minor_test();
 }
 
 /*
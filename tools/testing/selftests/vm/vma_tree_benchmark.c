@@ -0,0 +1,88 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include <linux/types.h>
+
+#define PAGE_SIZE sysconf(_SC_PAGESIZE)
+
+#define VMA_TREE_BENCHMARK	_IOWR('v', 1, struct vma_tree_benchmark)
+
+struct vma_tree_benchmark {
+	__u64 nr_lookups;
+	__u64 gap_length;
+	__u64 find_rb_usec;
+	__u64 find_tree_usec;
+	__u64 gap_rb_usec;
+	__u64 gap_tree_usec;
+	__u32 map_count;
+	__u32 mismatches;
+};
+
+int main(int argc, char **argv)
+{
+	struct vma_tree_benchmark vtb = { 0 };
+	unsigned long nr_vmas = 10000, lookups = 1000000;
+	int i, fd, opt, repeats = 1, gap_pages = 1;
+	char *p;
+
+	while ((opt = getopt(argc, argv, "v:n:r:g:")) != -1) {
+		switch (opt) {
+		case 'v':
+			nr_vmas = atol(optarg);
+			break;
+		case 'n':
+			lookups = atol(optarg);
+			break;
+		case 'r':
+			repeats = atoi(optarg);
+			break;
+		case 'g':
+			gap_pages = atoi(optarg);
+			break;
+		default:
+			return -1;
+		}
+	}
+
+	fd = open("/sys/kernel/debug/vma_tree_benchmark", O_RDWR);
+	if (fd == -1)
+		perror("open"), exit(1);
+
+	/*
+	 * Punch every other page out of one large mapping, leaving nr_vmas
+	 * single page vmas separated by one page holes.
+	 */
+	p = mmap(NULL, 2 * nr_vmas * PAGE_SIZE, PROT_READ,
+			MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (p == MAP_FAILED)
+		perror("mmap"), exit(1);
+	for (i = 0; i < nr_vmas; i++)
+		if (munmap(p + (2 * i + 1) * PAGE_SIZE, PAGE_SIZE))
+			perror("munmap"), exit(1);
+
+	vtb.nr_lookups = lookups;
+	vtb.gap_length = gap_pages * PAGE_SIZE;
+
+	for (i = 0; i < repeats; i++) {
+		if (ioctl(fd, VMA_TREE_BENCHMARK, &vtb))
+			perror("ioctl"), exit(1);
+
+		printf("%u vmas: find_vma rbtree %lld us, btree %lld us; "
+		       "gap search rbtree %lld us, btree %lld us\n",
+		       vtb.map_count, vtb.find_rb_usec, vtb.find_tree_usec,
+		       vtb.gap_rb_usec, vtb.gap_tree_usec);
+		if (vtb.mismatches) {
+			printf("%u mismatches between rbtree and btree\n",
+			       vtb.mismatches);
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -44,6 +44,7 @@ struct slabinfo {
 	unsigned long cmpxchg_double_cpu_fail, cmpxchg_double_fail;
 	unsigned long alloc_node_mismatch, deactivate_bypass;
 	unsigned long cpu_partial_alloc, cpu_partial_free;
+	unsigned long sheaf_alloc, sheaf_free, sheaf_refill, sheaf_flush;
 	int numa[MAX_NODES];
 	int numa_partial[MAX_NODES];
 } slabinfo[MAX_SLABS];
@@ -445,8 +446,8 @@ static void slab_stats(struct slabinfo *s)
 	if (!s->alloc_slab)
 		return;
 
-	total_alloc = s->alloc_fastpath + s->alloc_slowpath;
-	total_free = s->free_fastpath + s->free_slowpath;
+	total_alloc = s->alloc_fastpath + s->alloc_slowpath + s->sheaf_alloc;
+	total_free = s->free_fastpath + s->free_slowpath + s->sheaf_free;
 
 	if (!total_alloc)
 		return;
@@ -458,9 +459,13 @@ static void slab_stats(struct slabinfo *s)
 		s->alloc_fastpath, s->free_fastpath,
 		s->alloc_fastpath * 100 / total_alloc,
 		total_free ? s->free_fastpath * 100 / total_free : 0);
+	printf("Cpu sheaf            %8lu %8lu %3lu %3lu\n",
+		s->sheaf_alloc, s->sheaf_free,
+		s->sheaf_alloc * 100 / total_alloc,
+		total_free ? s->sheaf_free * 100 / total_free : 0);
 	printf("Slowpath             %8lu %8lu %3lu %3lu\n",
-		total_alloc - s->alloc_fastpath, s->free_slowpath,
-		(total_alloc - s->alloc_fastpath) * 100 / total_alloc,
+		s->alloc_slowpath, s->free_slowpath,
+		s->alloc_slowpath * 100 / total_alloc,
 		total_free ? s->free_slowpath * 100 / total_free : 0);
 	printf("Page Alloc           %8lu %8lu %3lu %3lu\n",
 		s->alloc_slab, s->free_slab,
@@ -491,6 +496,10 @@ static void slab_stats(struct slabinfo *s)
 	if (s->cpuslab_flush)
 		printf("Flushes %8lu\n", s->cpuslab_flush);
 
+	if (s->sheaf_refill || s->sheaf_flush)
+		printf("Sheaf refills %8lu flushes %8lu\n",
+			s->sheaf_refill, s->sheaf_flush);
+
 	total = s->deactivate_full + s->deactivate_empty +
 			s->deactivate_to_head + s->deactivate_to_tail + s->deactivate_bypass;
 
@@ -1252,6 +1261,10 @@ static void read_slab_dir(void)
 			slab->cpu_partial_free = get_obj("cpu_partial_free");
 			slab->alloc_node_mismatch = get_obj("alloc_node_mismatch");
 			slab->deactivate_bypass = get_obj("deactivate_bypass");
+			slab->sheaf_alloc = get_obj("sheaf_alloc");
+			slab->sheaf_free = get_obj("sheaf_free");
+			slab->sheaf_refill = get_obj("sheaf_refill");
+			slab->sheaf_flush = get_obj("sheaf_flush");
 			chdir("..");
 			if (slab->name[0] == ':')
 				alias_targets++;